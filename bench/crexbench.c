@@ -0,0 +1,466 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/* system includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <math.h>
+
+#include <libmseed.h>
+#include <libtidal.h>
+#include <libcrex.h>
+
+#include "crexout.h"
+
+#define PROGRAM "crexbench" /* program name */
+
+#ifndef PACKAGE_VERSION
+#define PACKAGE_VERSION "xxx"
+#endif
+
+#ifndef FIRFILTERS
+#define FIRFILTERS "filters.fir"
+#endif
+
+/*
+ * crexbench: process_crex time per sample, record at a time against contiguous records batched as msgts -k does
+ *
+ * A synthetic tide gauge signal is packed into Steim2 records by libmseed and decoded once. The records
+ * are then processed by process_crex one at a time, and again in batches of contiguous records, with the
+ * configured fir filters and tidal constituents, and the fastest pass of each is reported in nanoseconds
+ * per sample. The CREX text of both must be the same, so it exits with an error on any difference.
+ *
+ * With -c the same is repeated as the number of tidal constituents doubles, taken from a list of the
+ * usual harmonic constituents, which shows the cost of evaluating the tide at every sample against
+ * the rest of the processing.
+ */
+
+/* program variables */
+static char *program_name = PROGRAM;
+static char *program_version = PROGRAM " (" PACKAGE_VERSION ") (c) GNS 2014 (m.chadwick@gns.cri.nz)";
+static char *program_usage = PROGRAM " [-hv][-l <loops>][-n <records>][-k <records>][-s <samprate>][-N <firfile>][-F <filter> ...][-T <label/amp/lag> ...][-c <constituents>]";
+
+static int verbose = 0;
+static int loops = 3;
+static int nrecords = 2000;
+static int batching = 60;
+static double samprate = 1.0;
+static char *firfile = FIRFILTERS;
+static int nfirs = 0;
+static char *firnames[FIR_MAX_FILTERS];
+static crex_tidal_t tidal;
+static int sweep = 0; /* most constituents to time with */
+
+/* the usual harmonic constituents, largest first, for timing against the number evaluated */
+static const char *constituents[] = {
+    "M2", "S2", "N2", "K1", "O1", "K2", "P1", "Q1", "NU2", "MU2", "L2", "2N2", "T2", "J1", "M1", "OO1",
+    "M4", "MS4", "MN4", "M6", "2MS6", "M3", "MK3", "S4", "MF", "MM", "SSA", "SA", "LAM2", "EPS2", "2Q1", "RHO1"
+};
+
+typedef struct blocks_s {
+    int nblocks;
+    MSRecord **msrs;
+    long samples;
+} blocks_t;
+
+/* the CREX text of a run, in the order given */
+typedef struct output_s {
+    char *text;
+    size_t len;
+    size_t size;
+    int messages;
+} output_t;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1.0e9;
+}
+
+static void text_handler(char *srcname, hptime_t starttime, int sequence, char *text, int len, void *extra) {
+    output_t *output = (output_t *) extra;
+    char stamp[64];
+    int n;
+
+    (void) sequence;
+    if (output == NULL)
+        return;
+    n = snprintf(stamp, sizeof(stamp), "%s %lld\n", srcname, (long long) starttime);
+    if (output->len + n + len + 1 > output->size) {
+        output->size = 2 * (output->len + n + len + 1);
+        if ((output->text = (char *) realloc(output->text, output->size)) == NULL) {
+            fprintf(stderr, "error: memory error!\n"); exit(-1);
+        }
+    }
+    memcpy(output->text + output->len, stamp, n);
+    memcpy(output->text + output->len + n, text, len);
+    output->len += n + len;
+    output->text[output->len++] = '\n';
+    output->messages++;
+}
+
+static void pack_handler(char *record, int len, void *extra) {
+    blocks_t *records = (blocks_t *) extra;
+    MSRecord *msr = NULL;
+
+    if ((records->msrs = (MSRecord **) realloc(records->msrs, (records->nblocks + 1) * sizeof(MSRecord *))) == NULL) {
+        fprintf(stderr, "error: memory error!\n"); exit(-1);
+    }
+    if (msr_unpack(record, len, &msr, 1, 0) != MS_NOERROR) {
+        fprintf(stderr, "error: unable to unpack synthetic record\n"); exit(-1);
+    }
+    /* the header is kept, the raw record is only valid during the call */
+    msr->record = NULL;
+    records->msrs[records->nblocks++] = msr;
+    records->samples += msr->numsamples;
+}
+
+/* a semidiurnal and a diurnal tide, in counts, with a little noise, packed one record at a time */
+static int synthetic(blocks_t *records) {
+    MSRecord *msr;
+    int32_t *samples;
+    int64_t packed = 0;
+    unsigned int seed = 1;
+    double t;
+    int nsamples = nrecords * 100;
+    int n;
+
+    if ((samples = (int32_t *) malloc(nsamples * sizeof(int32_t))) == NULL)
+        return -1;
+    for (n = 0; n < nsamples; n++) {
+        t = (double) n / samprate;
+        seed = seed * 1103515245U + 12345U;
+        samples[n] = (int32_t) (20000.0 * sin(2.0 * M_PI * t / 44714.0) + 6000.0 * sin(2.0 * M_PI * t / 92950.0)) + (int32_t) ((seed >> 16) % 21) - 10;
+    }
+
+    if ((msr = msr_init(NULL)) == NULL) {
+        free(samples); return -1;
+    }
+    strcpy(msr->network, "XX");
+    strcpy(msr->station, "BENCH");
+    strcpy(msr->location, "40");
+    strcpy(msr->channel, "BTT");
+    msr->dataquality = 'D';
+    msr->starttime = ms_time2hptime(2014, 1, 0, 0, 0, 0);
+    msr->samprate = samprate;
+    msr->reclen = 512;
+    msr->encoding = DE_STEIM2;
+    msr->byteorder = 1;
+    msr->datasamples = samples;
+    msr->numsamples = nsamples;
+    msr->sampletype = 'i';
+
+    n = msr_pack(msr, pack_handler, records, &packed, 1, 0);
+
+    msr->datasamples = NULL;
+    msr_free(&msr);
+    free(samples);
+
+    return (n < 0) ? -1 : 0;
+}
+
+/* contiguous records joined in groups, each under the header of its first record, as msgts batches them */
+static int batch(blocks_t *records, blocks_t *batches) {
+    MSRecord *msr;
+    int32_t *samples;
+    int n, i, count;
+
+    for (n = 0; n < records->nblocks; n += batching) {
+        count = (n + batching <= records->nblocks) ? batching : records->nblocks - n;
+        if ((batches->msrs = (MSRecord **) realloc(batches->msrs, (batches->nblocks + 1) * sizeof(MSRecord *))) == NULL)
+            return -1;
+        if ((msr = msr_duplicate(records->msrs[n], 0)) == NULL)
+            return -1;
+        for (msr->numsamples = 0, i = n; i < n + count; i++)
+            msr->numsamples += records->msrs[i]->numsamples;
+        if ((samples = (int32_t *) malloc(msr->numsamples * sizeof(int32_t))) == NULL)
+            return -1;
+        for (msr->numsamples = 0, i = n; i < n + count; i++) {
+            memcpy(samples + msr->numsamples, records->msrs[i]->datasamples, records->msrs[i]->numsamples * sizeof(int32_t));
+            msr->numsamples += records->msrs[i]->numsamples;
+        }
+        /* and freed along with the header */
+        msr->datasamples = samples;
+        msr->samplecnt = msr->numsamples;
+        msr->sampletype = 'i';
+        batches->msrs[batches->nblocks++] = msr;
+        batches->samples += msr->numsamples;
+    }
+
+    return 0;
+}
+
+/* what msgts and slgts set up on the first record of a stream */
+static int setup(crex_stream_t *stream) {
+    int n;
+
+    memset(stream, 0, sizeof(crex_stream_t));
+    strcpy(stream->srcname, "XX_BENCH_40_BTT");
+    strncpy(stream->ctd.id, "BENCH", 24);
+    stream->beta = 10.0;
+    stream->ctd.temp = -1;
+    stream->ctd.autoQC = 11;
+    stream->ctd.manualQC = 7;
+    stream->ctd.increment = 1;
+    for (n = 0; n < CREX_BUF_SIZE; n++) {
+        stream->ctd.mes[n] = CREX_NO_DATA;
+        stream->ctd.res[n] = CREX_NO_DATA;
+    }
+
+    stream->nfirs = nfirs;
+    for (n = 0; n < stream->nfirs; n++) {
+        if (firfilter_find(firnames[n], &stream->firs[n]) < 0) {
+            fprintf(stderr, "error: could not find fir filter [%s]\n", firnames[n]); return -1;
+        }
+    }
+    stream->samprate = samprate;
+    for (n = 0; n < stream->nfirs; n++) {
+        stream->delay -= (hptime_t) MS_EPOCH2HPTIME(((stream->firs[n].minimum) ? 0.0 : ((double) stream->firs[n].length / 2.0 - 0.5) / stream->samprate));
+        stream->samprate /= (double) stream->firs[n].decimate;
+    }
+
+    return 0;
+}
+
+/* the fastest pass over the blocks in nanoseconds per sample, keeping the text of the first */
+static double timed(blocks_t *blocks, crex_tidal_t *model, crex_stream_t *stream, output_t *output) {
+    crexout_t crexout;
+    double t, fastest = 0.0;
+    int psamples;
+    int loop, n;
+
+    memset(&crexout, 0, sizeof(crexout));
+    crexout.text_handler = text_handler;
+    for (loop = 0; loop < loops; loop++) {
+        if (setup(stream) < 0)
+            return -1.0;
+        crexout.extra = (loop == 0) ? output : NULL;
+        t = now();
+        for (n = 0; n < blocks->nblocks; n++) {
+            if (process_crex(blocks->msrs[n], model, stream, crexout_handler, &crexout, &psamples, -1.0, 0) < 0) {
+                fprintf(stderr, "error: processing block %d\n", n); return -1.0;
+            }
+        }
+        t = now() - t;
+        if ((loop == 0) || (t < fastest))
+            fastest = t;
+    }
+
+    return (blocks->samples > 0) ? 1.0e9 * fastest / (double) blocks->samples : 0.0;
+}
+
+static void blocks_free(blocks_t *blocks) {
+    int n;
+
+    for (n = 0; n < blocks->nblocks; n++)
+        msr_free(&blocks->msrs[n]);
+    free(blocks->msrs);
+}
+
+/* a model of the first constituents of the list, with made up amplitudes and lags */
+static void model(crex_tidal_t *tides, int count) {
+    int n;
+
+    memset(tides, 0, sizeof(crex_tidal_t));
+    tides->latitude = tidal.latitude;
+    tides->zone = tidal.zone;
+    for (n = 0; (n < count) && (n < (int) (sizeof(constituents) / sizeof(constituents[0]))) && (n < LIBTIDAL_MAX_CONSTITUENTS); n++) {
+        strncpy(tides->tides[n].name, constituents[n], LIBTIDAL_CHARLEN - 1);
+        tides->tides[n].amplitude = 1.0 / (double) (n + 1);
+        tides->tides[n].lag = (double) (n * 37 % 360) / 360.0;
+        tides->num_tides++;
+    }
+}
+
+/* where the text of the two runs first parts, as a line number, or 0 if they are the same */
+static int differ(output_t *a, output_t *b) {
+    size_t n;
+    int line = 1;
+
+    for (n = 0; (n < a->len) && (n < b->len) && (a->text[n] == b->text[n]); n++) {
+        if (a->text[n] == '\n')
+            line++;
+    }
+
+    return ((n == a->len) && (n == b->len)) ? 0 : line;
+}
+
+/* time both ways with a tidal model, returning where the text differs, or -1 on any error */
+static int run(blocks_t *records, blocks_t *batches, crex_tidal_t *tides, crex_stream_t *stream, double *perrecord, double *perbatch) {
+    output_t single, batched;
+    int line = -1;
+
+    memset(&single, 0, sizeof(single));
+    memset(&batched, 0, sizeof(batched));
+
+    *perrecord = timed(records, tides, stream, &single);
+    *perbatch = timed(batches, tides, stream, &batched);
+
+    /* batching must not change anything libcrex writes */
+    if ((*perrecord >= 0.0) && (*perbatch >= 0.0) && ((line = differ(&single, &batched)) > 0)) {
+        fprintf(stderr, "error: batched crex text differs from line %d, with %d constituents\n", line, tides->num_tides);
+        if (verbose)
+            fprintf(stderr, "%.*s\n---\n%.*s\n", (int) single.len, single.text, (int) batched.len, batched.text);
+    }
+    if ((line == 0) && (!sweep))
+        printf("messages: %d per record, %d batched\n", single.messages, batched.messages);
+
+    free(single.text);
+    free(batched.text);
+
+    return line;
+}
+
+int main(int argc, char **argv) {
+    blocks_t records, batches;
+    crex_tidal_t tides;
+    crex_stream_t *stream;
+    double perrecord, perbatch;
+    int count, line;
+
+    int rc;
+    int option_index = 0;
+    struct option long_options[] = {
+        {"help", 0, 0, 'h'},
+        {"verbose", 0, 0, 'v'},
+        {"loops", 1, 0, 'l'},
+        {"records", 1, 0, 'n'},
+        {"batch", 1, 0, 'k'},
+        {"samprate", 1, 0, 's'},
+        {"firfile", 1, 0, 'N'},
+        {"filter", 1, 0, 'F'},
+        {"tide", 1, 0, 'T'},
+        {"constituents", 1, 0, 'c'},
+        {0, 0, 0, 0}
+    };
+
+    while ((rc = getopt_long(argc, argv, "hvl:n:k:s:N:F:T:c:", long_options, &option_index)) != EOF) {
+        switch(rc) {
+        case '?':
+            (void) fprintf(stderr, "usage: %s\n", program_usage);
+            exit(-1); /*NOTREACHED*/
+        case 'h':
+            (void) fprintf(stderr, "\n[%s] crex processing check and benchmark\n\n", program_name);
+            (void) fprintf(stderr, "usage:\n\t%s\n", program_usage);
+            (void) fprintf(stderr, "version:\n\t%s\n", program_version);
+            (void) fprintf(stderr, "options:\n");
+            (void) fprintf(stderr, "\t-h --help\tcommand line help (this)\n");
+            (void) fprintf(stderr, "\t-v --verbose\treport where the crex text differs\n");
+            (void) fprintf(stderr, "\t-l --loops\ttimed passes over the records [%d]\n", loops);
+            (void) fprintf(stderr, "\t-n --records\tsynthetic records of about 100 samples [%d]\n", nrecords);
+            (void) fprintf(stderr, "\t-k --batch\tcontiguous records in each batch [%d]\n", batching);
+            (void) fprintf(stderr, "\t-s --samprate\tsynthetic sample rate [%g]\n", samprate);
+            (void) fprintf(stderr, "\t-N --firfile\tfir-filters file [%s]\n", firfile);
+            (void) fprintf(stderr, "\t-F --filter\tadd a decimation firfilter\n");
+            (void) fprintf(stderr, "\t-T --tide\tadd tidal constants [<label>/<amplitude>/<lag>]\n");
+            (void) fprintf(stderr, "\t-c --constituents\ttime with 0, 1, 2, 4 ... up to this many of the usual constituents, in place of -T [%d]\n", sweep);
+            exit(0); /*NOTREACHED*/
+        case 'v':
+            verbose++;
+            break;
+        case 'l':
+            loops = atoi(optarg);
+            break;
+        case 'n':
+            nrecords = atoi(optarg);
+            break;
+        case 'k':
+            batching = atoi(optarg);
+            break;
+        case 's':
+            samprate = atof(optarg);
+            break;
+        case 'N':
+            firfile = optarg;
+            break;
+        case 'F':
+            if (nfirs < FIR_MAX_FILTERS)
+                firnames[nfirs++] = optarg;
+            break;
+        case 'T':
+            if (tidal.num_tides < LIBTIDAL_MAX_CONSTITUENTS) {
+                strncpy(tidal.tides[tidal.num_tides].name, strtok(strdup(optarg), "/"), LIBTIDAL_CHARLEN - 1);
+                tidal.tides[tidal.num_tides].amplitude = atof(strtok(NULL, "/"));
+                tidal.tides[tidal.num_tides].lag = atof(strtok(NULL, "/")) / 360.0;
+                tidal.num_tides++;
+            }
+            break;
+        case 'c':
+            sweep = atoi(optarg);
+            break;
+        }
+    }
+    if (loops < 1)
+        loops = 1;
+    if (sweep > (int) (sizeof(constituents) / sizeof(constituents[0])))
+        sweep = (int) (sizeof(constituents) / sizeof(constituents[0]));
+    if ((nrecords < 1) || (batching < 1) || (samprate <= 0.0) || (sweep < 0)) {
+        (void) fprintf(stderr, "usage: %s\n", program_usage);
+        exit(-1);
+    }
+    if ((nfirs > 0) && (firfilter_load(firfile) < 0)) {
+        fprintf(stderr, "error: could not load fir filter file [%s]\n", firfile); exit(-1);
+    }
+
+    memset(&records, 0, sizeof(records));
+    memset(&batches, 0, sizeof(batches));
+    if ((stream = (crex_stream_t *) malloc(sizeof(crex_stream_t))) == NULL) {
+        fprintf(stderr, "error: memory error!\n"); exit(-1);
+    }
+    if ((synthetic(&records) < 0) || (batch(&records, &batches) < 0)) {
+        fprintf(stderr, "error: unable to build synthetic records\n"); exit(-1);
+    }
+
+    printf("records: %d of %ld samples, %d batches\n", records.nblocks, records.samples, batches.nblocks);
+    if (sweep > 0) {
+        printf("%12s %14s %14s\n", "constituents", "per record", "batched");
+        for (count = 0; ; count = (2 * count > 0) ? 2 * count : 1) {
+            if (count > sweep)
+                count = sweep;
+            model(&tides, count);
+            if ((line = run(&records, &batches, &tides, stream, &perrecord, &perbatch)) != 0)
+                break;
+            printf("%12d %11.1f ns %11.1f ns\n", tides.num_tides, perrecord, perbatch);
+            if (count >= sweep)
+                break;
+        }
+    }
+    else if ((line = run(&records, &batches, &tidal, stream, &perrecord, &perbatch)) == 0) {
+        printf("per record: %.1f ns/sample\n", perrecord);
+        printf("batched: %.1f ns/sample\n", perbatch);
+    }
+
+    blocks_free(&records);
+    blocks_free(&batches);
+    free((char *) stream);
+
+    return((line != 0) ? 1 : 0);
+}
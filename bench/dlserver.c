@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/* system includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <signal.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#define PROGRAM "dlserver" /* program name */
+
+#ifndef PACKAGE_VERSION
+#define PACKAGE_VERSION "xxx"
+#endif
+
+/*
+ * dlserver: stub datalink server accepting packet writes, for testing the datalink output
+ *
+ */
+
+#define MAXPACKET 16384
+
+/* program variables */
+static char *program_name = PROGRAM;
+static char *program_version = PROGRAM " (" PACKAGE_VERSION ") (c) GNS 2014 (m.chadwick@gns.cri.nz)";
+static char *program_usage = PROGRAM " [-hv][-p <port>][-f <packets>][-l <log>]";
+
+static int verbose = 0; /* program verbosity */
+
+static int port = 16000;
+static int failafter = 0; /* drop the connection after this many packets, zero never */
+static char *recvlog = NULL;
+
+static volatile sig_atomic_t terminate = 0;
+
+static FILE *logfp = NULL;
+static long long pktid = 0;
+static unsigned long nreceived = 0;
+
+static void term_handler(int sig) {
+    terminate = 1;
+}
+
+static double now(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + (double) tv.tv_usec / 1.0e6;
+}
+
+static int readn(int fd, char *buf, size_t len) {
+    ssize_t n;
+
+    while (len > 0) {
+        if ((n = read(fd, buf, len)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (n == 0)
+            return -1;
+        buf += n; len -= (size_t) n;
+    }
+
+    return 0;
+}
+
+static int writen(int fd, char *buf, size_t len) {
+    ssize_t n;
+
+    while (len > 0) {
+        if ((n = write(fd, buf, len)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += n; len -= (size_t) n;
+    }
+
+    return 0;
+}
+
+/* a datalink packet is "DL", the header length, the header, then any data */
+static int send_packet(int fd, char *header, char *data, int len) {
+    char buf[512];
+    int hlen = (int) strlen(header);
+
+    buf[0] = 'D'; buf[1] = 'L'; buf[2] = (char) hlen;
+    memcpy(buf + 3, header, hlen);
+    if (writen(fd, buf, 3 + hlen) < 0)
+        return -1;
+
+    return (len > 0) ? writen(fd, data, len) : 0;
+}
+
+static int send_error(int fd, char *message) {
+    char header[64];
+
+    snprintf(header, sizeof(header), "ERROR 0 %d", (int) strlen(message));
+
+    return send_packet(fd, header, message, (int) strlen(message));
+}
+
+/* answer commands until the client goes away */
+static int serve(int fd) {
+    char header[256];
+    char data[MAXPACKET];
+    char streamid[100];
+    char flags[16];
+    long long start, end;
+    unsigned char pre[3];
+    int size;
+
+    while (!terminate) {
+        if (readn(fd, (char *) pre, 3) < 0)
+            return -1;
+        if ((pre[0] != 'D') || (pre[1] != 'L')) {
+            fprintf(stderr, "error: bad packet preheader\n"); return -1;
+        }
+        if (readn(fd, header, pre[2]) < 0)
+            return -1;
+        header[pre[2]] = '\0';
+
+        if (strncmp(header, "ID", 2) == 0) {
+            if (verbose)
+                fprintf(stderr, "[%s] client %s\n", program_name, header + 3);
+            if (send_packet(fd, "ID DataLink 2018.078 :: DLPROTO:1.0 PACKETSIZE:512 WRITE", NULL, 0) < 0)
+                return -1;
+        }
+        else if (strncmp(header, "WRITE", 5) == 0) {
+            if ((sscanf(header, "WRITE %99s %lld %lld %15s %d", streamid, &start, &end, flags, &size) != 5) || (size < 0) || (size > MAXPACKET)) {
+                (void) send_error(fd, "bad write header"); return -1;
+            }
+            if (readn(fd, data, size) < 0)
+                return -1;
+
+            nreceived++;
+            if (logfp != NULL)
+                fprintf(logfp, "%.6f %s %lld %d\n", now(), streamid, start, size);
+
+            /* simulate a failing server */
+            if ((failafter > 0) && ((nreceived % (unsigned long) failafter) == 0)) {
+                if (verbose)
+                    fprintf(stderr, "[%s] dropping connection after %lu packets\n", program_name, nreceived);
+                return -1;
+            }
+
+            if (strchr(flags, 'A') != NULL) {
+                snprintf(header, sizeof(header), "OK %lld 0", ++pktid);
+                if (send_packet(fd, header, NULL, 0) < 0)
+                    return -1;
+            }
+            else {
+                pktid++;
+            }
+        }
+        else if (send_error(fd, "unsupported command") < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    struct sockaddr_in addr;
+    struct sigaction sa;
+    int sock, fd;
+    int on = 1;
+    int rc;
+    int option_index = 0;
+    struct option long_options[] = {
+        {"help", 0, 0, 'h'},
+        {"verbose", 0, 0, 'v'},
+        {"port", 1, 0, 'p'},
+        {"fail", 1, 0, 'f'},
+        {"log", 1, 0, 'l'},
+        {0, 0, 0, 0}
+    };
+
+    sa.sa_handler = term_handler;
+    sa.sa_flags = 0;
+    sigemptyset (&sa.sa_mask);
+    sigaction (SIGINT, &sa, NULL);
+    sigaction (SIGTERM, &sa, NULL);
+
+    sa.sa_handler = SIG_IGN;
+    sigaction (SIGPIPE, &sa, NULL);
+
+    while ((rc = getopt_long(argc, argv, "hvp:f:l:", long_options, &option_index)) != EOF) {
+        switch(rc) {
+        case '?':
+            (void) fprintf(stderr, "usage: %s\n", program_usage);
+            exit(-1); /*NOTREACHED*/
+        case 'h':
+            (void) fprintf(stderr, "\n[%s] stub datalink server\n\n", program_name);
+            (void) fprintf(stderr, "usage:\n\t%s\n", program_usage);
+            (void) fprintf(stderr, "version:\n\t%s\n", program_version);
+            (void) fprintf(stderr, "options:\n");
+            (void) fprintf(stderr, "\t-h --help\tcommand line help (this)\n");
+            (void) fprintf(stderr, "\t-v --verbose\trun program in verbose mode\n");
+            (void) fprintf(stderr, "\t-p --port\tlocal port to listen on [%d]\n", port);
+            (void) fprintf(stderr, "\t-f --fail\tdrop the connection after this many packets, zero never [%d]\n", failafter);
+            (void) fprintf(stderr, "\t-l --log\tlog the arrival time, stream, start time and size of each packet [%s]\n", (recvlog) ? recvlog : "<null>");
+            exit(0); /*NOTREACHED*/
+        case 'v':
+            verbose++;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'f':
+            failafter = atoi(optarg);
+            break;
+        case 'l':
+            recvlog = optarg;
+            break;
+        }
+    }
+
+    if ((recvlog) && ((logfp = fopen(recvlog, "w")) == NULL)) {
+        fprintf(stderr, "error: unable to open receive log [%s]\n", recvlog); exit(-1);
+    }
+
+    if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+        fprintf(stderr, "error: unable to create socket - %s\n", strerror(errno)); exit(-1);
+    }
+    (void) setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((unsigned short) port);
+    if ((bind(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) || (listen(sock, 1) < 0)) {
+        fprintf(stderr, "error: unable to listen on port %d - %s\n", port, strerror(errno)); exit(-1);
+    }
+
+    if (verbose)
+        fprintf(stderr, "[%s] listening on port %d\n", program_name, port);
+
+    /* a single client at a time, it is only a stub */
+    while ((!terminate) && ((fd = accept(sock, NULL, NULL)) >= 0)) {
+        (void) serve(fd);
+        close(fd);
+        if (logfp != NULL)
+            fflush(logfp);
+        if (verbose)
+            fprintf(stderr, "[%s] received %lu packets\n", program_name, nreceived);
+    }
+    close(sock);
+
+    if (logfp != NULL)
+        fclose(logfp);
+
+    return(0);
+}
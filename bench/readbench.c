@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/* system includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include <libmseed.h>
+
+#include "reader.h"
+
+#define PROGRAM "readbench" /* program name */
+
+#ifndef PACKAGE_VERSION
+#define PACKAGE_VERSION "xxx"
+#endif
+
+/*
+ * readbench: throughput of the mapped record reader against plain fread and libmseed
+ *
+ * Each file is read from the page cache, so it is passed over once before anything is timed,
+ * and the best of the timed passes is kept. The fread pass only copies the file in large
+ * blocks without looking at it, which is the most a copying reader could hope for.
+ */
+
+/* program variables */
+static char *program_name = PROGRAM;
+static char *program_version = PROGRAM " (" PACKAGE_VERSION ") (c) GNS 2014 (m.chadwick@gns.cri.nz)";
+static char *program_usage = PROGRAM " [-h][-l <loops>] <files> ...";
+
+#define READ_BLOCK (64 * 1024)
+
+static int loops = 5;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1.0e9;
+}
+
+/* copy the file through a buffer */
+static long read_fread(char *file, long *records) {
+    static char buf[READ_BLOCK];
+    long total = 0;
+    size_t n;
+    FILE *fp;
+
+    if ((fp = fopen(file, "r")) == NULL)
+        return -1;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+        total += (long) n;
+    fclose(fp);
+    *records = 0;
+
+    return total;
+}
+
+/* every record through libmseed, headers only */
+static long read_libmseed(char *file, long *records) {
+    MSFileParam *msfp = NULL;
+    MSRecord *msr = NULL;
+    long total = 0;
+
+    *records = 0;
+    while (ms_readmsr_r (&msfp, &msr, file, 0, NULL, NULL, 1, 0, 0) == MS_NOERROR) {
+        total += msr->reclen; (*records)++;
+    }
+    ms_readmsr_r (&msfp, &msr, NULL, 0, NULL, NULL, 0, 0, 0);
+
+    return total;
+}
+
+/* every record through the mapped reader */
+static long read_reader(char *file, long *records) {
+    reader_t reader;
+    char *record;
+    long total = 0;
+    int reclen;
+
+    *records = 0;
+    if (reader_open(&reader, file) < 0)
+        return -1;
+    while (reader_next(&reader, &record, &reclen) == MS_NOERROR) {
+        total += reclen; (*records)++;
+    }
+    reader_close(&reader);
+
+    return total;
+}
+
+/* the best of the timed passes, in MB/s */
+static double best(long (*pass)(char *, long *), char *file, long *bytes, long *records) {
+    double t, fastest = 0.0;
+    int n;
+
+    if ((*bytes = pass(file, records)) <= 0)
+        return 0.0;
+    for (n = 0; n < loops; n++) {
+        t = now();
+        (void) pass(file, records);
+        t = now() - t;
+        if ((n == 0) || (t < fastest))
+            fastest = t;
+    }
+
+    return (fastest > 0.0) ? (double) *bytes / fastest / 1.0e6 : 0.0;
+}
+
+int main(int argc, char **argv) {
+    double fread_rate, libmseed_rate, reader_rate;
+    long bytes, records, nread, nreader;
+    int rv = 0;
+    int n;
+
+    int rc;
+    int option_index = 0;
+    struct option long_options[] = {
+        {"help", 0, 0, 'h'},
+        {"loops", 1, 0, 'l'},
+        {0, 0, 0, 0}
+    };
+
+    while ((rc = getopt_long(argc, argv, "hl:", long_options, &option_index)) != EOF) {
+        switch(rc) {
+        case '?':
+            (void) fprintf(stderr, "usage: %s\n", program_usage);
+            exit(-1); /*NOTREACHED*/
+        case 'h':
+            (void) fprintf(stderr, "\n[%s] miniseed reader benchmark\n\n", program_name);
+            (void) fprintf(stderr, "usage:\n\t%s\n", program_usage);
+            (void) fprintf(stderr, "version:\n\t%s\n", program_version);
+            (void) fprintf(stderr, "options:\n");
+            (void) fprintf(stderr, "\t-h --help\tcommand line help (this)\n");
+            (void) fprintf(stderr, "\t-l --loops\ttimed passes over each file [%d]\n", loops);
+            exit(0); /*NOTREACHED*/
+        case 'l':
+            loops = atoi(optarg);
+            break;
+        }
+    }
+    if (loops < 1)
+        loops = 1;
+    if (optind >= argc) {
+        (void) fprintf(stderr, "usage: %s\n", program_usage);
+        exit(-1);
+    }
+
+    printf("%10s %10s %12s %12s %12s  %s\n", "MB", "records", "fread MB/s", "libmseed", "reader", "file");
+    for (n = optind; n < argc; n++) {
+        fread_rate = best(read_fread, argv[n], &bytes, &records);
+        libmseed_rate = best(read_libmseed, argv[n], &bytes, &nread);
+        reader_rate = best(read_reader, argv[n], &bytes, &nreader);
+        if (nread != nreader) {
+            fprintf(stderr, "error: %s: libmseed read %ld records, the reader %ld\n", argv[n], nread, nreader); rv = -1;
+        }
+        printf("%10.1f %10ld %12.1f %12.1f %12.1f  %s\n", (double) bytes / 1.0e6, nreader, fread_rate, libmseed_rate, reader_rate, argv[n]);
+    }
+
+    return(rv);
+}
@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/* system includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "registry.h"
+
+#define PROGRAM "regbench" /* program name */
+
+#ifndef PACKAGE_VERSION
+#define PACKAGE_VERSION "xxx"
+#endif
+
+/*
+ * regbench: stream lookup cost of the registry as the number of streams grows
+ *
+ * Each size is filled with synthetic srcnames and looked up in a pseudo random order, against
+ * a linear search by name, which is how streams were found before the registry.
+ */
+
+/* program variables */
+static char *program_name = PROGRAM;
+static char *program_version = PROGRAM " (" PACKAGE_VERSION ") (c) GNS 2014 (m.chadwick@gns.cri.nz)";
+static char *program_usage = PROGRAM " [-h][-l <lookups>][<streams> ...]";
+
+static long lookups = 1000000;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1.0e9;
+}
+
+/* the same pseudo random order for both searches */
+static unsigned int next_index(unsigned int *seed, int n) {
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    return *seed % (unsigned int) n;
+}
+
+static int linear_lookup(char (*names)[32], int n, const char *srcname) {
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (strcmp(names[i], srcname) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+static int run(int n) {
+    registry_t *reg;
+    char (*names)[32];
+    unsigned int seed;
+    double t0, hashed, linear;
+    long count, found = 0;
+    long i;
+
+    if ((names = (char (*)[32]) malloc((size_t) n * sizeof(*names))) == NULL) {
+        fprintf(stderr, "error: memory error!\n"); return -1;
+    }
+    if ((reg = registry_new(0)) == NULL) {
+        fprintf(stderr, "error: memory error!\n"); free(names); return -1;
+    }
+    for (i = 0; i < n; i++) {
+        snprintf(names[i], sizeof(names[i]), "NZ_S%04ld_%02ld_HHZ", i / 10, i % 10);
+        if (registry_insert(reg, names[i]) < 0) {
+            fprintf(stderr, "error: memory error!\n"); registry_free(reg); free(names); return -1;
+        }
+    }
+
+    seed = 2463534242U;
+    t0 = now();
+    for (i = 0; i < lookups; i++)
+        found += (registry_lookup(reg, names[next_index(&seed, n)]) >= 0);
+    hashed = (now() - t0) / (double) lookups;
+
+    /* the linear search is cut short for large sizes, it is only there for comparison */
+    count = (lookups * 10 / n < lookups) ? lookups * 10 / n : lookups;
+    if (count < 1000)
+        count = 1000;
+    seed = 2463534242U;
+    t0 = now();
+    for (i = 0; i < count; i++)
+        found += (linear_lookup(names, n, names[next_index(&seed, n)]) >= 0);
+    linear = (now() - t0) / (double) count;
+
+    printf("%8d %12.1f %12.1f %12lu\n", n, 1.0e9 * hashed, 1.0e9 * linear, (unsigned long) registry_bytes(reg) / (unsigned long) n);
+    if (found != lookups + count)
+        fprintf(stderr, "error: %ld lookups failed\n", lookups + count - found);
+
+    registry_free(reg);
+    free(names);
+
+    return (found == lookups + count) ? 0 : -1;
+}
+
+int main(int argc, char **argv) {
+    int sizes[] = { 10, 100, 1000, 10000 };
+    int rv = 0;
+    int n;
+
+    int rc;
+    int option_index = 0;
+    struct option long_options[] = {
+        {"help", 0, 0, 'h'},
+        {"lookups", 1, 0, 'l'},
+        {0, 0, 0, 0}
+    };
+
+    while ((rc = getopt_long(argc, argv, "hl:", long_options, &option_index)) != EOF) {
+        switch(rc) {
+        case '?':
+            (void) fprintf(stderr, "usage: %s\n", program_usage);
+            exit(-1); /*NOTREACHED*/
+        case 'h':
+            (void) fprintf(stderr, "\n[%s] registry lookup benchmark\n\n", program_name);
+            (void) fprintf(stderr, "usage:\n\t%s\n", program_usage);
+            (void) fprintf(stderr, "version:\n\t%s\n", program_version);
+            (void) fprintf(stderr, "options:\n");
+            (void) fprintf(stderr, "\t-h --help\tcommand line help (this)\n");
+            (void) fprintf(stderr, "\t-l --lookups\tlookups timed at each size [%ld]\n", lookups);
+            (void) fprintf(stderr, "arguments:\n");
+            (void) fprintf(stderr, "\t<streams>\tnumber of streams to try [10 100 1000 10000]\n");
+            exit(0); /*NOTREACHED*/
+        case 'l':
+            lookups = atol(optarg);
+            break;
+        }
+    }
+    if (lookups < 1)
+        lookups = 1;
+
+    printf("%8s %12s %12s %12s\n", "streams", "hash ns", "linear ns", "bytes/stream");
+    if (optind < argc) {
+        for (n = optind; n < argc; n++) {
+            if ((atoi(argv[n]) > 0) && (run(atoi(argv[n])) < 0))
+                rv = -1;
+        }
+    }
+    else {
+        for (n = 0; n < (int) (sizeof(sizes) / sizeof(sizes[0])); n++) {
+            if (run(sizes[n]) < 0)
+                rv = -1;
+        }
+    }
+
+    return(rv);
+}
@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/* system includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+
+#include "registry.h"
+
+#define PROGRAM "rssbench" /* program name */
+
+#ifndef PACKAGE_VERSION
+#define PACKAGE_VERSION "xxx"
+#endif
+
+/*
+ * rssbench: resident memory of the per stream state as streams are added and set up
+ *
+ * Streams are added to a registry, then set up the way slgts does on their first record, which
+ * fills the CREX data arrays and copies in the configured fir filters before the state is saved,
+ * packed to the filters in use. The resident set is read from /proc after each step and reported
+ * per stream against the bytes allocated.
+ */
+
+/* program variables */
+static char *program_name = PROGRAM;
+static char *program_version = PROGRAM " (" PACKAGE_VERSION ") (c) GNS 2014 (m.chadwick@gns.cri.nz)";
+static char *program_usage = PROGRAM " [-h][-f <filters>][<streams> ...]";
+
+static int nfirs = 2;
+
+/* resident bytes of this process */
+static long resident(void) {
+    FILE *fp;
+    long size, pages = -1;
+
+    if ((fp = fopen("/proc/self/statm", "r")) == NULL)
+        return -1;
+    if (fscanf(fp, "%ld %ld", &size, &pages) != 2)
+        pages = -1;
+    fclose(fp);
+
+    return (pages < 0) ? -1 : pages * sysconf(_SC_PAGESIZE);
+}
+
+/* what setup_stream in slgts writes, with zeroed filters in place of the configured ones */
+static void setup(crex_stream_t *stream) {
+    int n;
+
+    strncpy(stream->ctd.id, "BENCH", 24);
+    stream->ctd.temp = -1;
+    stream->ctd.autoQC = 11;
+    stream->ctd.manualQC = 7;
+    stream->ctd.increment = 1;
+    for (n = 0; n < CREX_BUF_SIZE; n++) {
+        stream->ctd.mes[n] = CREX_NO_DATA;
+        stream->ctd.res[n] = CREX_NO_DATA;
+    }
+
+    stream->nfirs = nfirs;
+    for (n = 0; n < stream->nfirs; n++)
+        memset(&stream->firs[n], 0, sizeof(firfilter_t));
+}
+
+static int run(int n) {
+    crex_stream_t *stream;
+    registry_t *reg;
+    char srcname[32];
+    long base, added, ready;
+    int i;
+
+    if ((stream = (crex_stream_t *) malloc(sizeof(crex_stream_t))) == NULL) {
+        fprintf(stderr, "error: memory error!\n"); return -1;
+    }
+    base = resident();
+    if ((reg = registry_new(0)) == NULL) {
+        fprintf(stderr, "error: memory error!\n"); free(stream); return -1;
+    }
+    for (i = 0; i < n; i++) {
+        snprintf(srcname, sizeof(srcname), "NZ_S%04d_%02d_HHZ", i / 10, i % 10);
+        if (registry_insert(reg, srcname) < 0) {
+            fprintf(stderr, "error: memory error!\n"); registry_free(reg); free(stream); return -1;
+        }
+    }
+    added = resident();
+
+    for (i = 0; i < n; i++) {
+        (void) registry_load(reg, i, stream);
+        setup(stream);
+        if (registry_save(reg, i, stream) < 0) {
+            fprintf(stderr, "error: memory error!\n"); registry_free(reg); free(stream); return -1;
+        }
+    }
+    ready = resident();
+    free(stream);
+
+    if ((base < 0) || (added < 0) || (ready < 0)) {
+        fprintf(stderr, "error: unable to read resident set size\n"); registry_free(reg); return -1;
+    }
+    printf("%8d %14lu %14ld %14ld\n", n, (unsigned long) registry_bytes(reg) / (unsigned long) n, (added - base) / n, (ready - base) / n);
+
+    registry_free(reg);
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int sizes[] = { 100, 1000, 10000 };
+    int rv = 0;
+    int n;
+
+    int rc;
+    int option_index = 0;
+    struct option long_options[] = {
+        {"help", 0, 0, 'h'},
+        {"filters", 1, 0, 'f'},
+        {0, 0, 0, 0}
+    };
+
+    while ((rc = getopt_long(argc, argv, "hf:", long_options, &option_index)) != EOF) {
+        switch(rc) {
+        case '?':
+            (void) fprintf(stderr, "usage: %s\n", program_usage);
+            exit(-1); /*NOTREACHED*/
+        case 'h':
+            (void) fprintf(stderr, "\n[%s] per stream resident memory benchmark\n\n", program_name);
+            (void) fprintf(stderr, "usage:\n\t%s\n", program_usage);
+            (void) fprintf(stderr, "version:\n\t%s\n", program_version);
+            (void) fprintf(stderr, "options:\n");
+            (void) fprintf(stderr, "\t-h --help\tcommand line help (this)\n");
+            (void) fprintf(stderr, "\t-f --filters\tfir filters set up for each stream [%d]\n", nfirs);
+            (void) fprintf(stderr, "arguments:\n");
+            (void) fprintf(stderr, "\t<streams>\tnumber of streams to try [100 1000 10000]\n");
+            exit(0); /*NOTREACHED*/
+        case 'f':
+            nfirs = atoi(optarg);
+            break;
+        }
+    }
+    if (nfirs < 0)
+        nfirs = 0;
+    if (nfirs > FIR_MAX_FILTERS)
+        nfirs = FIR_MAX_FILTERS;
+
+    printf("%8s %14s %14s %14s\n", "streams", "alloc/stream", "added/stream", "setup/stream");
+    if (optind < argc) {
+        for (n = optind; n < argc; n++) {
+            if ((atoi(argv[n]) > 0) && (run(atoi(argv[n])) < 0))
+                rv = -1;
+        }
+    }
+    else {
+        for (n = 0; n < (int) (sizeof(sizes) / sizeof(sizes[0])); n++) {
+            if (run(sizes[n]) < 0)
+                rv = -1;
+        }
+    }
+
+    return(rv);
+}
@@ -0,0 +1,421 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/* system includes */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <ftw.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define PROGRAM "slbench" /* program name */
+
+#ifndef PACKAGE_VERSION
+#define PACKAGE_VERSION "xxx"
+#endif
+
+/*
+ * slbench: run slgts against the stand-in seedlink server and report throughput, cpu, publishing delay and memory
+ *
+ * Throughput is what slgts itself reports as processed, from its metrics file, which is updated
+ * every second while it runs and once more as it stops, rather than what the server sent.
+ */
+
+/* program variables */
+static char *program_name = PROGRAM;
+static char *program_version = PROGRAM " (" PACKAGE_VERSION ") (c) GNS 2014 (m.chadwick@gns.cri.nz)";
+static char *program_usage = PROGRAM " [-hvk][-s <slgts>][-S <slserver>][-p <port>][-n <streams>][-r <samprate>][-x <speed>][-t <seconds>][-f <file> ...][-- <slgts options>]";
+
+static int verbose = 0; /* program verbosity */
+static int keep = 0; /* keep the working directory */
+
+static char *slgts = "./slgts";
+static char *slserver = "bench/slserver";
+static char *port = "18555";
+static char *nstreams = "100";
+static char *samprate = "1";
+static char *speed = "60";
+static double runtime = 30.0;
+
+#define MAX_FILES 64
+static int nfiles = 0;
+static char *files[MAX_FILES];
+
+typedef struct event_s {
+    char key[64]; /* network and station */
+    double time;
+} event_t;
+
+static double now(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + (double) tv.tv_usec / 1.0e6;
+}
+
+/* network and station part of a srcname or minute file name */
+static void event_key(char *key, const char *name) {
+    int n, u = 0;
+
+    for (n = 0; (n < 63) && (name[n] != '\0') && (name[n] != '.') && (name[n] != ' '); n++) {
+        if ((name[n] == '_') && (++u == 2))
+            break;
+        key[n] = name[n];
+    }
+    key[n] = '\0';
+}
+
+static int cmp_event(const void *a, const void *b) {
+    const event_t *ea = (const event_t *) a;
+    const event_t *eb = (const event_t *) b;
+    int c;
+
+    if ((c = strcmp(ea->key, eb->key)) != 0)
+        return c;
+    return (ea->time < eb->time) ? -1 : (ea->time > eb->time);
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double da = *(const double *) a, db = *(const double *) b;
+    return (da < db) ? -1 : (da > db);
+}
+
+static int add_event(event_t **events, int *nevents, int *size, const char *name, double t) {
+    if (*nevents == *size) {
+        *size = (*size > 0) ? 2 * *size : 1024;
+        if ((*events = (event_t *) realloc(*events, *size * sizeof(event_t))) == NULL)
+            return -1;
+    }
+    event_key((*events)[*nevents].key, name);
+    (*events)[*nevents].time = t;
+    (*nevents)++;
+
+    return 0;
+}
+
+/* the value of a counter in a prometheus text file, or -1 if it is not there yet */
+static double read_metric(char *file, char *name) {
+    char line[256];
+    size_t len = strlen(name);
+    double value = -1.0;
+    FILE *fp;
+
+    if ((fp = fopen(file, "r")) == NULL)
+        return -1.0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if ((strncmp(line, name, len) == 0) && (line[len] == ' ')) {
+            value = atof(line + len + 1); break;
+        }
+    }
+    fclose(fp);
+
+    return value;
+}
+
+static int remove_entry(const char *path, const struct stat *sb, int flag, struct FTW *ftwbuf) {
+    return remove(path);
+}
+
+static pid_t spawn(char **args) {
+    pid_t pid;
+
+    if ((pid = fork()) == 0) {
+        execv(args[0], args);
+        fprintf(stderr, "error: unable to run %s - %s\n", args[0], strerror(errno));
+        _exit(127);
+    }
+
+    return pid;
+}
+
+static double percentile(double *values, int n, double p) {
+    int i;
+
+    if (n == 0)
+        return 0.0;
+    i = (int) (p * (double) (n - 1) + 0.5);
+    return values[i];
+}
+
+int main(int argc, char **argv) {
+    char workdir[] = "/tmp/slbench.XXXXXX";
+    char gtsdir[1024];
+    char sendlog[1024];
+    char metrics[1024];
+    char address[64];
+    char line[256];
+    char name[64];
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    char *args[128];
+    struct inotify_event *ev;
+    struct pollfd pfd;
+    struct rusage ru;
+    event_t *sends = NULL, *renames = NULL;
+    int nsends = 0, nrenames = 0, ssize = 0, rsize = 0;
+    double *delays = NULL;
+    int ndelays = 0;
+    event_t *lo, *hi, *mid;
+    double start, elapsed, cpu, t;
+    double first = 0.0, stopped = 0.0, sampled = 0.0;
+    double initial = 0.0, processed = 0.0, value;
+    pid_t server, client;
+    FILE *fp;
+    ssize_t len;
+    char *p;
+    int status;
+    int fd;
+    int n, i;
+
+    int rc;
+    int option_index = 0;
+    struct option long_options[] = {
+        {"help", 0, 0, 'h'},
+        {"verbose", 0, 0, 'v'},
+        {"keep", 0, 0, 'k'},
+        {"slgts", 1, 0, 's'},
+        {"slserver", 1, 0, 'S'},
+        {"port", 1, 0, 'p'},
+        {"streams", 1, 0, 'n'},
+        {"samprate", 1, 0, 'r'},
+        {"speed", 1, 0, 'x'},
+        {"time", 1, 0, 't'},
+        {"file", 1, 0, 'f'},
+        {0, 0, 0, 0}
+    };
+
+    while ((rc = getopt_long(argc, argv, "hvks:S:p:n:r:x:t:f:", long_options, &option_index)) != EOF) {
+        switch(rc) {
+        case '?':
+            (void) fprintf(stderr, "usage: %s\n", program_usage);
+            exit(-1); /*NOTREACHED*/
+        case 'h':
+            (void) fprintf(stderr, "\n[%s] slgts end to end benchmark\n\n", program_name);
+            (void) fprintf(stderr, "usage:\n\t%s\n", program_usage);
+            (void) fprintf(stderr, "version:\n\t%s\n", program_version);
+            (void) fprintf(stderr, "options:\n");
+            (void) fprintf(stderr, "\t-h --help\tcommand line help (this)\n");
+            (void) fprintf(stderr, "\t-v --verbose\trun program in verbose mode\n");
+            (void) fprintf(stderr, "\t-k --keep\tkeep the working directory\n");
+            (void) fprintf(stderr, "\t-s --slgts\tslgts program to benchmark [%s]\n", slgts);
+            (void) fprintf(stderr, "\t-S --slserver\tstand-in seedlink server program [%s]\n", slserver);
+            (void) fprintf(stderr, "\t-p --port\tlocal port for the seedlink server [%s]\n", port);
+            (void) fprintf(stderr, "\t-n --streams\tnumber of synthetic streams [%s]\n", nstreams);
+            (void) fprintf(stderr, "\t-r --samprate\tsynthetic sample rate [%s]\n", samprate);
+            (void) fprintf(stderr, "\t-x --speed\treplay speed relative to real time, zero for no pacing [%s]\n", speed);
+            (void) fprintf(stderr, "\t-t --time\tseconds to run the benchmark [%g]\n", runtime);
+            (void) fprintf(stderr, "\t-f --file\treplay a miniseed file rather than synthetic data\n");
+            exit(0); /*NOTREACHED*/
+        case 'v':
+            verbose++;
+            break;
+        case 'k':
+            keep++;
+            break;
+        case 's':
+            slgts = optarg;
+            break;
+        case 'S':
+            slserver = optarg;
+            break;
+        case 'p':
+            port = optarg;
+            break;
+        case 'n':
+            nstreams = optarg;
+            break;
+        case 'r':
+            samprate = optarg;
+            break;
+        case 'x':
+            speed = optarg;
+            break;
+        case 't':
+            runtime = atof(optarg);
+            break;
+        case 'f':
+            if (nfiles < MAX_FILES)
+                files[nfiles++] = optarg;
+            break;
+        }
+    }
+
+    if (mkdtemp(workdir) == NULL) {
+        fprintf(stderr, "error: unable to make working directory - %s\n", strerror(errno)); exit(-1);
+    }
+    snprintf(gtsdir, sizeof(gtsdir), "%s/gts", workdir);
+    snprintf(sendlog, sizeof(sendlog), "%s/send.log", workdir);
+    snprintf(metrics, sizeof(metrics), "%s/metrics", workdir);
+    if (mkdir(gtsdir, 0755) < 0) {
+        fprintf(stderr, "error: unable to make gts directory - %s\n", strerror(errno)); exit(-1);
+    }
+
+    /* the stand-in server */
+    n = 0;
+    args[n++] = slserver;
+    args[n++] = "-p"; args[n++] = port;
+    args[n++] = "-n"; args[n++] = nstreams;
+    args[n++] = "-r"; args[n++] = samprate;
+    args[n++] = "-x"; args[n++] = speed;
+    args[n++] = "-l"; args[n++] = sendlog;
+    for (i = 0; i < nfiles; i++)
+        args[n++] = files[i];
+    args[n] = NULL;
+    if ((server = spawn(args)) < 0) {
+        fprintf(stderr, "error: unable to start %s - %s\n", slserver, strerror(errno)); exit(-1);
+    }
+    (void) usleep(500000);
+
+    if ((fd = inotify_init()) < 0) {
+        fprintf(stderr, "error: unable to watch %s - %s\n", gtsdir, strerror(errno)); exit(-1);
+    }
+    if (inotify_add_watch(fd, gtsdir, IN_MOVED_TO) < 0) {
+        fprintf(stderr, "error: unable to watch %s - %s\n", gtsdir, strerror(errno)); exit(-1);
+    }
+
+    /* and the client, with any extra options */
+    n = 0;
+    args[n++] = slgts;
+    for (i = optind; (i < argc) && (n < 120); i++)
+        args[n++] = argv[i];
+    args[n++] = "-M"; args[n++] = metrics;
+    args[n++] = "-m"; args[n++] = "1";
+    snprintf(address, sizeof(address), "127.0.0.1:%s", port);
+    args[n++] = address;
+    args[n++] = gtsdir;
+    args[n] = NULL;
+
+    start = now();
+    if ((client = spawn(args)) < 0) {
+        fprintf(stderr, "error: unable to start %s - %s\n", slgts, strerror(errno)); exit(-1);
+    }
+
+    /* note when each minute file is published, until the client has stopped */
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    for (status = -1; ; ) {
+        if ((status < 0) && (now() - start >= runtime)) {
+            elapsed = now() - start;
+            kill(client, SIGTERM);
+            status = 0;
+        }
+        if ((status >= 0) && (wait4(client, &status, WNOHANG, &ru) == client)) {
+            stopped = now();
+            break;
+        }
+        /* the rate is taken from the first records processed, so connecting is left out */
+        if ((first == 0.0) && (now() - sampled >= 0.2)) {
+            sampled = now();
+            if ((value = read_metric(metrics, "slgts_records_total")) > 0.0) {
+                first = sampled; initial = value;
+            }
+        }
+        if (poll(&pfd, 1, 100) <= 0)
+            continue;
+        if ((len = read(fd, buf, sizeof(buf))) <= 0)
+            continue;
+        t = now();
+        for (p = buf; p < buf + len; p += sizeof(struct inotify_event) + ev->len) {
+            ev = (struct inotify_event *) p;
+            if ((ev->len > 0) && (ev->name[0] != '.'))
+                (void) add_event(&renames, &nrenames, &rsize, ev->name, t);
+        }
+    }
+    close(fd);
+
+    /* the metrics are written one last time once everything queued has been processed */
+    if ((processed = read_metric(metrics, "slgts_records_total")) < 0.0) {
+        fprintf(stderr, "error: no metrics from %s in %s\n", slgts, metrics); processed = 0.0;
+    }
+    if (first == 0.0)
+        first = start;
+
+    kill(server, SIGTERM);
+    (void) waitpid(server, NULL, 0);
+
+    /* when each record was sent */
+    if ((fp = fopen(sendlog, "r")) == NULL) {
+        fprintf(stderr, "error: unable to read %s - %s\n", sendlog, strerror(errno)); exit(-1);
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if ((sscanf(line, "%lf %63s", &t, name) == 2) && (t - start <= elapsed))
+            (void) add_event(&sends, &nsends, &ssize, name, t);
+    }
+    fclose(fp);
+    qsort(sends, nsends, sizeof(event_t), cmp_event);
+
+    /* publishing delay, from the latest record of the station to the rename of its minute file */
+    if ((delays = (double *) malloc((nrenames + 1) * sizeof(double))) == NULL) {
+        fprintf(stderr, "error: memory error!\n"); exit(-1);
+    }
+    for (n = 0; n < nrenames; n++) {
+        for (lo = sends, hi = sends + nsends, mid = NULL; lo < hi; ) {
+            mid = lo + (hi - lo) / 2;
+            if (cmp_event(mid, &renames[n]) <= 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if ((lo > sends) && (strcmp((lo - 1)->key, renames[n].key) == 0))
+            delays[ndelays++] = renames[n].time - (lo - 1)->time;
+    }
+    qsort(delays, ndelays, sizeof(double), cmp_double);
+
+    cpu = (double) ru.ru_utime.tv_sec + (double) ru.ru_utime.tv_usec / 1.0e6 + (double) ru.ru_stime.tv_sec + (double) ru.ru_stime.tv_usec / 1.0e6;
+
+    printf("elapsed: %.1f s\n", elapsed);
+    printf("records sent: %d\n", nsends);
+    printf("records processed: %.0f\n", processed);
+    printf("records/s: %.1f\n", (stopped > first) ? (processed - initial) / (stopped - first) : 0.0);
+    printf("records not processed: %.0f\n", ((double) nsends > processed) ? (double) nsends - processed : 0.0);
+    printf("cpu: %.3f s (%.1f us/record)\n", cpu, (processed > 0.0) ? 1.0e6 * cpu / processed : 0.0);
+    printf("files published: %d\n", nrenames);
+    printf("publish delay p50: %.1f ms\n", 1.0e3 * percentile(delays, ndelays, 0.50));
+    printf("publish delay p99: %.1f ms\n", 1.0e3 * percentile(delays, ndelays, 0.99));
+    printf("peak rss: %ld kB\n", ru.ru_maxrss);
+
+    if (keep)
+        printf("working directory: %s\n", workdir);
+    else
+        (void) nftw(workdir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+
+    free(delays);
+    free(sends);
+    free(renames);
+
+    return(0);
+}
@@ -0,0 +1,407 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/* system includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+/* libmseed library includes */
+#include <libmseed.h>
+
+#define PROGRAM "slserver" /* program name */
+
+#ifndef PACKAGE_VERSION
+#define PACKAGE_VERSION "xxx"
+#endif
+
+/*
+ * slserver: stand-in seedlink server replaying miniseed files, or synthetic tide gauge streams, for benchmarking
+ *
+ */
+
+#define RECSIZE 512
+#define NSAMPLES 112 /* int32 samples in a 512 byte record */
+
+/* program variables */
+static char *program_name = PROGRAM;
+static char *program_version = PROGRAM " (" PACKAGE_VERSION ") (c) GNS 2014 (m.chadwick@gns.cri.nz)";
+static char *program_usage = PROGRAM " [-hv][-p <port>][-n <streams>][-r <samprate>][-x <speed>][-d <seconds>][-l <sendlog>][<files> ...]";
+static char *program_prefix = "[" PROGRAM "] ";
+
+static int verbose = 0; /* program verbosity */
+
+static int port = 18000;
+static int nstreams = 10;
+static double samprate = 1.0;
+static double speed = 1.0; /* replay speed, zero for as fast as possible */
+static double duration = 0.0; /* seconds of data, zero for no limit */
+static char *sendlog = NULL;
+
+static volatile sig_atomic_t terminate = 0;
+
+static FILE *logfp = NULL;
+static unsigned int sequence = 0;
+static unsigned long nsent = 0;
+
+static void term_handler(int sig) {
+    terminate = 1;
+}
+
+static void log_print(char *message) {
+    if (verbose)
+        fprintf(stderr, "%s", message);
+}
+
+static void err_print(char *message) {
+    fprintf(stderr, "error: %s", message);
+}
+
+static double now(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + (double) tv.tv_usec / 1.0e6;
+}
+
+static int writen(int fd, char *buf, size_t len) {
+    ssize_t n;
+
+    while (len > 0) {
+        if ((n = write(fd, buf, len)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += n; len -= (size_t) n;
+    }
+
+    return 0;
+}
+
+/* read one command line from the client */
+static int readcmd(int fd, char *buf, int len) {
+    int n = 0;
+    char c;
+
+    while (n < len - 1) {
+        if (read(fd, &c, 1) != 1)
+            return -1;
+        if ((c == '\r') || (c == '\n')) {
+            if (n == 0)
+                continue;
+            break;
+        }
+        buf[n++] = c;
+    }
+    buf[n] = '\0';
+
+    return n;
+}
+
+/* answer commands until the client asks for data */
+static int handshake(int fd) {
+    char cmd[256];
+    int multistation = 0;
+
+    while (readcmd(fd, cmd, sizeof(cmd)) >= 0) {
+        if (verbose)
+            ms_log(0, "command: %s\n", cmd);
+        if (strncasecmp(cmd, "HELLO", 5) == 0) {
+            if (writen(fd, "SeedLink v3.1 (" PROGRAM ") :: SLPROTO:3.1\r\nbenchmark\r\n", strlen("SeedLink v3.1 (" PROGRAM ") :: SLPROTO:3.1\r\nbenchmark\r\n")) < 0)
+                return -1;
+            continue;
+        }
+        if (strncasecmp(cmd, "END", 3) == 0)
+            return 0;
+        if ((strncasecmp(cmd, "INFO", 4) == 0) || (strncasecmp(cmd, "BYE", 3) == 0))
+            continue;
+        if (strncasecmp(cmd, "STATION", 7) == 0)
+            multistation = 1;
+        if (writen(fd, "OK\r\n", 4) < 0)
+            return -1;
+        if ((!multistation) && ((strncasecmp(cmd, "DATA", 4) == 0) || (strncasecmp(cmd, "FETCH", 5) == 0) || (strncasecmp(cmd, "TIME", 4) == 0)))
+            return 0;
+    }
+
+    return -1;
+}
+
+/* send a record as a seedlink packet, noting when it went */
+static int send_record(int fd, char *record) {
+    char head[9];
+    char srcname[100];
+    MSRecord *msr = NULL;
+
+    snprintf(head, sizeof(head), "SL%06X", sequence);
+    sequence = (sequence + 1) & 0xFFFFFF;
+
+    if ((writen(fd, head, 8) < 0) || (writen(fd, record, RECSIZE) < 0))
+        return -1;
+    nsent++;
+
+    if ((logfp != NULL) && (msr_unpack(record, RECSIZE, &msr, 0, 0) == MS_NOERROR)) {
+        fprintf(logfp, "%.6f %s\n", now(), msr_srcname(msr, srcname, 0));
+        msr_free(&msr);
+    }
+
+    return 0;
+}
+
+/* pace replay, given the data time of the first record and of the next */
+static void pace(double wall0, hptime_t first, hptime_t next) {
+    struct timespec ts;
+    double wait;
+
+    if (speed <= 0.0)
+        return;
+    wait = wall0 + (double) MS_HPTIME2EPOCH((double) (next - first)) / speed - now();
+    if (wait > 0.0) {
+        ts.tv_sec = (time_t) wait;
+        ts.tv_nsec = (long) ((wait - (double) ts.tv_sec) * 1.0e9);
+        (void) nanosleep(&ts, NULL);
+    }
+}
+
+static void pack_handler(char *record, int reclen, void *extra) {
+    memcpy((char *) extra, record, (reclen < RECSIZE) ? reclen : RECSIZE);
+}
+
+/* synthetic semi-diurnal tide, with a different phase and mean for each gauge */
+static int replay_synthetic(int fd) {
+    MSRecord *msr = NULL;
+    char record[RECSIZE];
+    int32_t samples[NSAMPLES];
+    int64_t packed;
+    hptime_t start, t;
+    double wall0, secs;
+    int s, n;
+    int rc;
+
+    start = MS_EPOCH2HPTIME((hptime_t) time(NULL));
+    wall0 = now();
+
+    for (t = start; !terminate; t += (hptime_t) ((double) NSAMPLES / samprate * HPTMODULUS)) {
+        if ((duration > 0.0) && ((double) MS_HPTIME2EPOCH((double) (t - start)) >= duration))
+            break;
+        pace(wall0, start, t + (hptime_t) ((double) NSAMPLES / samprate * HPTMODULUS));
+
+        for (s = 0; s < nstreams && !terminate; s++) {
+            msr = msr_init(msr);
+            strcpy(msr->network, "NZ");
+            snprintf(msr->station, sizeof(msr->station), "T%04d", s);
+            strcpy(msr->location, "40");
+            strcpy(msr->channel, "LTZ");
+            msr->starttime = t;
+            msr->samprate = samprate;
+            msr->reclen = RECSIZE;
+            msr->encoding = DE_INT32;
+            msr->byteorder = 1;
+
+            for (n = 0; n < NSAMPLES; n++) {
+                secs = (double) MS_HPTIME2EPOCH((double) t) + (double) n / samprate;
+                samples[n] = (int32_t) (20000.0 + 100.0 * s + 8000.0 * sin(2.0 * M_PI * secs / 44714.0 + 0.1 * s) + (rand() % 21) - 10);
+            }
+            msr->datasamples = samples;
+            msr->numsamples = NSAMPLES;
+            msr->sampletype = 'i';
+
+            rc = msr_pack(msr, pack_handler, record, &packed, 1, 0);
+            msr->datasamples = NULL;
+            if (rc < 0) {
+                ms_log(2, "unable to pack record\n"); msr_free(&msr); return -1;
+            }
+            if (send_record(fd, record) < 0) {
+                msr_free(&msr); return -1;
+            }
+        }
+    }
+    msr_free(&msr);
+
+    return 0;
+}
+
+/* replay 512 byte records from files, paced by their start times */
+static int replay_files(int fd, int nfiles, char **files) {
+    MSRecord *msr = NULL;
+    FILE *fp;
+    char record[RECSIZE];
+    hptime_t first = 0;
+    double wall0 = now();
+    int n;
+
+    for (n = 0; (n < nfiles) && (!terminate); n++) {
+        if ((fp = fopen(files[n], "rb")) == NULL) {
+            ms_log(2, "unable to open %s - %s\n", files[n], strerror(errno)); continue;
+        }
+        while ((!terminate) && (fread(record, RECSIZE, 1, fp) == 1)) {
+            if (msr_unpack(record, RECSIZE, &msr, 0, 0) != MS_NOERROR)
+                continue;
+            if (first == 0)
+                first = msr->starttime;
+            if ((duration > 0.0) && ((double) MS_HPTIME2EPOCH((double) (msr->starttime - first)) >= duration))
+                break;
+            pace(wall0, first, msr->starttime);
+            if (send_record(fd, record) < 0) {
+                fclose(fp); msr_free(&msr); return -1;
+            }
+        }
+        fclose(fp);
+    }
+    msr_free(&msr);
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    struct sockaddr_in addr;
+    struct sigaction sa;
+    int sock, fd;
+    int on = 1;
+    char c;
+    int rc;
+    int option_index = 0;
+    struct option long_options[] = {
+        {"help", 0, 0, 'h'},
+        {"verbose", 0, 0, 'v'},
+        {"port", 1, 0, 'p'},
+        {"streams", 1, 0, 'n'},
+        {"samprate", 1, 0, 'r'},
+        {"speed", 1, 0, 'x'},
+        {"duration", 1, 0, 'd'},
+        {"log", 1, 0, 'l'},
+        {0, 0, 0, 0}
+    };
+
+    sa.sa_handler = term_handler;
+    sa.sa_flags = 0;
+    sigemptyset (&sa.sa_mask);
+    sigaction (SIGINT, &sa, NULL);
+    sigaction (SIGTERM, &sa, NULL);
+
+    sa.sa_handler = SIG_IGN;
+    sigaction (SIGPIPE, &sa, NULL);
+
+    ms_loginit (log_print, program_prefix, err_print, program_prefix);
+
+    while ((rc = getopt_long(argc, argv, "hvp:n:r:x:d:l:", long_options, &option_index)) != EOF) {
+        switch(rc) {
+        case '?':
+            (void) fprintf(stderr, "usage: %s\n", program_usage);
+            exit(-1); /*NOTREACHED*/
+        case 'h':
+            (void) fprintf(stderr, "\n[%s] stand-in seedlink server\n\n", program_name);
+            (void) fprintf(stderr, "usage:\n\t%s\n", program_usage);
+            (void) fprintf(stderr, "version:\n\t%s\n", program_version);
+            (void) fprintf(stderr, "options:\n");
+            (void) fprintf(stderr, "\t-h --help\tcommand line help (this)\n");
+            (void) fprintf(stderr, "\t-v --verbose\trun program in verbose mode\n");
+            (void) fprintf(stderr, "\t-p --port\tlocal port to listen on [%d]\n", port);
+            (void) fprintf(stderr, "\t-n --streams\tnumber of synthetic tide gauge streams [%d]\n", nstreams);
+            (void) fprintf(stderr, "\t-r --samprate\tsynthetic sample rate [%g]\n", samprate);
+            (void) fprintf(stderr, "\t-x --speed\treplay speed relative to real time, zero for no pacing [%g]\n", speed);
+            (void) fprintf(stderr, "\t-d --duration\tseconds of data to send, zero for no limit [%g]\n", duration);
+            (void) fprintf(stderr, "\t-l --log\tlog the send time of each record [%s]\n", (sendlog) ? sendlog : "<null>");
+            exit(0); /*NOTREACHED*/
+        case 'v':
+            verbose++;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'n':
+            nstreams = atoi(optarg);
+            break;
+        case 'r':
+            samprate = atof(optarg);
+            break;
+        case 'x':
+            speed = atof(optarg);
+            break;
+        case 'd':
+            duration = atof(optarg);
+            break;
+        case 'l':
+            sendlog = optarg;
+            break;
+        }
+    }
+
+    if ((sendlog) && ((logfp = fopen(sendlog, "w")) == NULL)) {
+        ms_log(1, "unable to open send log [%s]\n", sendlog); exit(-1);
+    }
+
+    if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+        ms_log(1, "unable to create socket - %s\n", strerror(errno)); exit(-1);
+    }
+    (void) setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((unsigned short) port);
+    if ((bind(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) || (listen(sock, 1) < 0)) {
+        ms_log(1, "unable to listen on port %d - %s\n", port, strerror(errno)); exit(-1);
+    }
+
+    if (verbose)
+        ms_log(0, "listening on port %d\n", port);
+
+    /* a single client at a time, it is only a benchmark */
+    while ((!terminate) && ((fd = accept(sock, NULL, NULL)) >= 0)) {
+        (void) setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        if (handshake(fd) == 0) {
+            if (optind < argc)
+                rc = replay_files(fd, argc - optind, &argv[optind]);
+            else
+                rc = replay_synthetic(fd);
+
+            /* hold the link open once everything is sent, so the client does not reconnect */
+            while ((rc == 0) && (!terminate) && (read(fd, &c, 1) > 0));
+        }
+        close(fd);
+        if (logfp != NULL)
+            fflush(logfp);
+        if (verbose)
+            ms_log(0, "sent %lu records\n", nsent);
+    }
+    close(sock);
+
+    if (logfp != NULL)
+        fclose(logfp);
+
+    return(0);
+}
@@ -0,0 +1,374 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/* system includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+#include <libmseed.h>
+
+#include "steim.h"
+
+#define PROGRAM "steimbench" /* program name */
+
+#ifndef PACKAGE_VERSION
+#define PACKAGE_VERSION "xxx"
+#endif
+
+/*
+ * steimbench: check the built in Steim1 and Steim2 decoding against libmseed, and time both
+ *
+ * The corpus is any Steim records found in the given files, or otherwise records packed here by
+ * libmseed from synthetic signals chosen to use every difference width, in both byte orders.
+ * Every record must decode to exactly the samples libmseed gives, and synthetic records must
+ * not need the libmseed fallback, so it exits with an error on any difference. Copies of every
+ * record decoded here are then broken by changing their reverse integration constant, each of
+ * which must be handed back to libmseed and still come out as libmseed decodes it.
+ */
+
+/* program variables */
+static char *program_name = PROGRAM;
+static char *program_version = PROGRAM " (" PACKAGE_VERSION ") (c) GNS 2014 (m.chadwick@gns.cri.nz)";
+static char *program_usage = PROGRAM " [-hv][-l <loops>][-n <records>][-r <reclen>][<files> ...]";
+
+static int verbose = 0;
+static int loops = 5;
+static int nsynthetic = 500; /* records of each synthetic kind, at one sample a word */
+static int reclen = 512;
+
+typedef struct corpus_s {
+    int nrecords;
+    int maxrecords;
+    char **records;
+    int *lengths;
+    long samples;
+} corpus_t;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1.0e9;
+}
+
+static int corpus_add(corpus_t *corpus, char *record, int len) {
+    if (corpus->nrecords == corpus->maxrecords) {
+        corpus->maxrecords = (corpus->maxrecords > 0) ? 2 * corpus->maxrecords : 1024;
+        if (((corpus->records = (char **) realloc(corpus->records, corpus->maxrecords * sizeof(char *))) == NULL) ||
+            ((corpus->lengths = (int *) realloc(corpus->lengths, corpus->maxrecords * sizeof(int))) == NULL))
+            return -1;
+    }
+    if ((corpus->records[corpus->nrecords] = (char *) malloc(len)) == NULL)
+        return -1;
+    memcpy(corpus->records[corpus->nrecords], record, len);
+    corpus->lengths[corpus->nrecords++] = len;
+
+    return 0;
+}
+
+static void pack_handler(char *record, int len, void *extra) {
+    if (corpus_add((corpus_t *) extra, record, len) < 0)
+        fprintf(stderr, "error: memory error!\n");
+}
+
+/* pack a random walk whose steps stay within the given number of bits, turned back before it can overflow */
+static int synthetic(corpus_t *corpus, int encoding, int byteorder, int bits, unsigned int *seed) {
+    MSRecord *msr;
+    int32_t *samples;
+    int64_t packed = 0;
+    int64_t value = 0, step;
+    int nsamples = nsynthetic * (reclen / 4);
+    int n;
+
+    if ((samples = (int32_t *) malloc(nsamples * sizeof(int32_t))) == NULL)
+        return -1;
+    for (n = 0; n < nsamples; n++) {
+        *seed = *seed * 1103515245U + 12345U;
+        step = (int64_t) ((*seed >> 1) & ((1U << bits) - 1)) - (int64_t) (1U << (bits - 1));
+        value += ((value + step > (1 << 30)) || (value + step < -(1 << 30))) ? -step : step;
+        samples[n] = (int32_t) value;
+    }
+
+    if ((msr = msr_init(NULL)) == NULL) {
+        free(samples); return -1;
+    }
+    strcpy(msr->network, "XX");
+    snprintf(msr->station, sizeof(msr->station), "S%d", bits);
+    strcpy(msr->location, (byteorder) ? "BE" : "LE");
+    strcpy(msr->channel, (encoding == DE_STEIM2) ? "HH2" : "HH1");
+    msr->dataquality = 'D';
+    msr->starttime = ms_time2hptime(2014, 1, 0, 0, 0, 0);
+    msr->samprate = 100.0;
+    msr->reclen = reclen;
+    msr->encoding = encoding;
+    msr->byteorder = byteorder;
+    msr->datasamples = samples;
+    msr->numsamples = nsamples;
+    msr->sampletype = 'i';
+
+    n = msr_pack(msr, pack_handler, corpus, &packed, 1, 0);
+
+    msr->datasamples = NULL;
+    msr_free(&msr);
+    free(samples);
+
+    return (n < 0) ? -1 : 0;
+}
+
+/* the steim records of a file */
+static int load(corpus_t *corpus, char *file) {
+    MSFileParam *msfp = NULL;
+    MSRecord *msr = NULL;
+    int rc;
+
+    while ((rc = ms_readmsr_r (&msfp, &msr, file, 0, NULL, NULL, 1, 0, 0)) == MS_NOERROR) {
+        if (((msr->encoding == DE_STEIM1) || (msr->encoding == DE_STEIM2)) && (corpus_add(corpus, msr->record, msr->reclen) < 0)) {
+            rc = MS_GENERROR; break;
+        }
+    }
+    ms_readmsr_r (&msfp, &msr, NULL, 0, NULL, NULL, 0, 0, 0);
+
+    if (rc != MS_ENDOFFILE) {
+        fprintf(stderr, "error: unable to read %s - %s\n", file, ms_errorstr(rc)); return -1;
+    }
+
+    return 0;
+}
+
+/* decode every record both ways, returning the number that differ */
+static long compare(corpus_t *corpus, steim_t *steim) {
+    MSRecord *ours = NULL, *theirs = NULL;
+    char srcname[100];
+    long differ = 0;
+    int n;
+
+    corpus->samples = 0;
+    for (n = 0; n < corpus->nrecords; n++) {
+        if ((steim_unpack(steim, corpus->records[n], corpus->lengths[n], &ours, 0) != MS_NOERROR) ||
+            (msr_unpack(corpus->records[n], corpus->lengths[n], &theirs, 1, 0) != MS_NOERROR)) {
+            fprintf(stderr, "error: unable to unpack record %d\n", n); differ++; continue;
+        }
+        corpus->samples += theirs->numsamples;
+        if ((ours->numsamples != theirs->numsamples) || (ours->sampletype != theirs->sampletype) ||
+            (memcmp(ours->datasamples, theirs->datasamples, theirs->numsamples * sizeof(int32_t)) != 0)) {
+            if ((verbose) || (differ == 0))
+                fprintf(stderr, "error: %s record %d decodes differently\n", msr_srcname(theirs, srcname, 0), n);
+            differ++;
+        }
+    }
+    steim_release(steim, ours);
+    msr_free(&ours);
+    msr_free(&theirs);
+
+    return differ;
+}
+
+/* libmseed warns about every broken record */
+static void quiet(char *message) {
+    (void) message;
+}
+
+/* copies of the records decoded here with a reverse integration constant that no longer matches their last sample */
+static int corrupt(corpus_t *corpus, corpus_t *broken, steim_t *steim) {
+    MSRecord *msr = NULL;
+    unsigned long decoded;
+    int n;
+    int rv = 0;
+
+    for (n = 0; n < corpus->nrecords; n++) {
+        decoded = steim->decoded;
+        if ((steim_unpack(steim, corpus->records[n], corpus->lengths[n], &msr, 0) != MS_NOERROR) || (steim->decoded == decoded))
+            continue;
+        if (corpus_add(broken, corpus->records[n], corpus->lengths[n]) < 0) {
+            rv = -1; break;
+        }
+        /* the first frame holds its nibbles, then the forward and reverse constants, so this changes a byte of the latter in either order */
+        broken->records[broken->nrecords - 1][msr->fsdh->data_offset + 11] ^= 0x01;
+    }
+    steim_release(steim, msr);
+    msr_free(&msr);
+
+    return rv;
+}
+
+/* the best of the timed passes over the corpus, in samples per second */
+static double timed(corpus_t *corpus, steim_t *steim, int builtin) {
+    MSRecord *msr = NULL;
+    double t, fastest = 0.0;
+    int loop, n;
+
+    for (loop = 0; loop < loops; loop++) {
+        t = now();
+        for (n = 0; n < corpus->nrecords; n++) {
+            if (builtin)
+                (void) steim_unpack(steim, corpus->records[n], corpus->lengths[n], &msr, 0);
+            else
+                (void) msr_unpack(corpus->records[n], corpus->lengths[n], &msr, 1, 0);
+        }
+        t = now() - t;
+        if ((loop == 0) || (t < fastest))
+            fastest = t;
+    }
+    steim_release(steim, msr);
+    msr_free(&msr);
+
+    return (fastest > 0.0) ? (double) corpus->samples / fastest : 0.0;
+}
+
+int main(int argc, char **argv) {
+    static const int widths[] = { 4, 8, 16, 24, 30 };
+    corpus_t corpus, broken;
+    steim_t steim;
+    unsigned int seed = 1;
+    double builtin, libmseed;
+    unsigned long fallback;
+    long differ;
+    int encoding, byteorder;
+    int n;
+
+    int rc;
+    int option_index = 0;
+    struct option long_options[] = {
+        {"help", 0, 0, 'h'},
+        {"verbose", 0, 0, 'v'},
+        {"loops", 1, 0, 'l'},
+        {"records", 1, 0, 'n'},
+        {"reclen", 1, 0, 'r'},
+        {0, 0, 0, 0}
+    };
+
+    while ((rc = getopt_long(argc, argv, "hvl:n:r:", long_options, &option_index)) != EOF) {
+        switch(rc) {
+        case '?':
+            (void) fprintf(stderr, "usage: %s\n", program_usage);
+            exit(-1); /*NOTREACHED*/
+        case 'h':
+            (void) fprintf(stderr, "\n[%s] steim decoding check and benchmark\n\n", program_name);
+            (void) fprintf(stderr, "usage:\n\t%s\n", program_usage);
+            (void) fprintf(stderr, "version:\n\t%s\n", program_version);
+            (void) fprintf(stderr, "options:\n");
+            (void) fprintf(stderr, "\t-h --help\tcommand line help (this)\n");
+            (void) fprintf(stderr, "\t-v --verbose\treport every record that differs\n");
+            (void) fprintf(stderr, "\t-l --loops\ttimed passes over the corpus [%d]\n", loops);
+            (void) fprintf(stderr, "\t-n --records\tsynthetic records of each kind, at one sample a word, without files [%d]\n", nsynthetic);
+            (void) fprintf(stderr, "\t-r --reclen\tsynthetic record length [%d]\n", reclen);
+            (void) fprintf(stderr, "arguments:\n");
+            (void) fprintf(stderr, "\t<files>\tminiseed files whose steim records make up the corpus\n");
+            exit(0); /*NOTREACHED*/
+        case 'v':
+            verbose++;
+            break;
+        case 'l':
+            loops = atoi(optarg);
+            break;
+        case 'n':
+            nsynthetic = atoi(optarg);
+            break;
+        case 'r':
+            reclen = atoi(optarg);
+            break;
+        }
+    }
+    if (loops < 1)
+        loops = 1;
+    if ((nsynthetic < 1) || (reclen < MINRECLEN)) {
+        (void) fprintf(stderr, "usage: %s\n", program_usage);
+        exit(-1);
+    }
+
+    memset(&corpus, 0, sizeof(corpus));
+    memset(&broken, 0, sizeof(broken));
+    memset(&steim, 0, sizeof(steim));
+
+    if (optind < argc) {
+        for (n = optind; n < argc; n++) {
+            if (load(&corpus, argv[n]) < 0)
+                exit(-1);
+        }
+    }
+    else {
+        for (encoding = DE_STEIM1; encoding <= DE_STEIM2; encoding++) {
+            for (byteorder = 0; byteorder < 2; byteorder++) {
+                for (n = 0; n < (int) (sizeof(widths) / sizeof(widths[0])); n++) {
+                    if (synthetic(&corpus, encoding, byteorder, widths[n], &seed) < 0) {
+                        fprintf(stderr, "error: unable to pack synthetic records\n"); exit(-1);
+                    }
+                }
+            }
+        }
+    }
+    if (corpus.nrecords == 0) {
+        fprintf(stderr, "error: no steim records found\n"); exit(-1);
+    }
+
+    differ = compare(&corpus, &steim);
+    printf("records: %d\n", corpus.nrecords);
+    printf("samples: %ld\n", corpus.samples);
+    printf("decoded: %lu\n", steim.decoded);
+    printf("fallback: %lu\n", steim.fallback);
+    printf("differ: %ld\n", differ);
+
+    /* libmseed packs nothing the built in decoder should turn down */
+    if ((optind >= argc) && (steim.fallback > 0)) {
+        fprintf(stderr, "error: %lu synthetic records fell back to libmseed\n", steim.fallback); differ++;
+    }
+
+    /* a failed integrity check must leave the record to libmseed, whatever it then makes of it */
+    if (corrupt(&corpus, &broken, &steim) < 0) {
+        fprintf(stderr, "error: memory error!\n"); exit(-1);
+    }
+    if (!verbose)
+        ms_loginit(NULL, NULL, quiet, NULL);
+    fallback = steim.fallback;
+    differ += compare(&broken, &steim);
+    printf("broken: %d\n", broken.nrecords);
+    if (steim.fallback - fallback != (unsigned long) broken.nrecords) {
+        fprintf(stderr, "error: %lu of %d broken records were decoded without libmseed\n",
+            (unsigned long) broken.nrecords - (steim.fallback - fallback), broken.nrecords);
+        differ++;
+    }
+
+    builtin = timed(&corpus, &steim, 1);
+    libmseed = timed(&corpus, &steim, 0);
+    printf("built in: %.1f Msamples/s\n", builtin / 1.0e6);
+    printf("libmseed: %.1f Msamples/s\n", libmseed / 1.0e6);
+
+    for (n = 0; n < corpus.nrecords; n++)
+        free(corpus.records[n]);
+    free(corpus.records);
+    free(corpus.lengths);
+    for (n = 0; n < broken.nrecords; n++)
+        free(broken.records[n]);
+    free(broken.records);
+    free(broken.lengths);
+    steim_free(&steim);
+
+    return((differ > 0) ? 1 : 0);
+}
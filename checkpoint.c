@@ -0,0 +1,339 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/* system includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+#include "registry.h"
+
+/* where the fir filter slots start, the streams are held packed as the registry keeps them */
+#define CHECKPOINT_FIRS offsetof(crex_stream_t, firs)
+
+/*
+ * the stream state is restored as raw bytes, so every field of it is listed here with its type, and the only pointer,
+ * the stream list link, is cleared on restore; a field changing type, or a new one of pointer size or more between
+ * those listed, fails to build and has to be looked at before snapshots can carry it
+ */
+#define CHECKPOINT_TYPE(s, f, t) _Generic(&((s *) 0)->f, t *: 1, default: 0)
+#define CHECKPOINT_NEXT(s, f, g) (offsetof(s, g) - (offsetof(s, f) + sizeof(((s *) 0)->f)) < sizeof(void *))
+#define CHECKPOINT_LAST(s, f) (sizeof(s) - (offsetof(s, f) + sizeof(((s *) 0)->f)) < sizeof(void *))
+
+typedef char checkpoint_name_t[64];
+typedef char checkpoint_id_t[25];
+typedef int checkpoint_buf_t[CREX_BUF_SIZE];
+typedef double checkpoint_coeffs_t[FIR_MAX_COEFFS];
+typedef firfilter_t checkpoint_firs_t[FIR_MAX_FILTERS];
+
+_Static_assert(CHECKPOINT_TYPE(firfilter_t, name, checkpoint_name_t) && CHECKPOINT_TYPE(firfilter_t, decimate, int) &&
+    CHECKPOINT_TYPE(firfilter_t, minimum, int) && CHECKPOINT_TYPE(firfilter_t, length, int) &&
+    CHECKPOINT_TYPE(firfilter_t, coeffs, checkpoint_coeffs_t) && CHECKPOINT_TYPE(firfilter_t, buffer, checkpoint_coeffs_t) &&
+    CHECKPOINT_TYPE(firfilter_t, nbuffer, int), "firfilter_t fields have changed");
+_Static_assert(CHECKPOINT_NEXT(firfilter_t, name, decimate) && CHECKPOINT_NEXT(firfilter_t, decimate, minimum) &&
+    CHECKPOINT_NEXT(firfilter_t, minimum, length) && CHECKPOINT_NEXT(firfilter_t, length, coeffs) &&
+    CHECKPOINT_NEXT(firfilter_t, coeffs, buffer) && CHECKPOINT_NEXT(firfilter_t, buffer, nbuffer) &&
+    CHECKPOINT_LAST(firfilter_t, nbuffer), "firfilter_t has fields not checked");
+
+_Static_assert(CHECKPOINT_TYPE(crex_ctd_t, id, checkpoint_id_t) && CHECKPOINT_TYPE(crex_ctd_t, time, hptime_t) &&
+    CHECKPOINT_TYPE(crex_ctd_t, temp, int) && CHECKPOINT_TYPE(crex_ctd_t, autoQC, int) && CHECKPOINT_TYPE(crex_ctd_t, manualQC, int) &&
+    CHECKPOINT_TYPE(crex_ctd_t, offset, int) && CHECKPOINT_TYPE(crex_ctd_t, increment, int) &&
+    CHECKPOINT_TYPE(crex_ctd_t, mes, checkpoint_buf_t) && CHECKPOINT_TYPE(crex_ctd_t, res, checkpoint_buf_t), "crex_ctd_t fields have changed");
+_Static_assert(CHECKPOINT_NEXT(crex_ctd_t, id, time) && CHECKPOINT_NEXT(crex_ctd_t, time, temp) && CHECKPOINT_NEXT(crex_ctd_t, temp, autoQC) &&
+    CHECKPOINT_NEXT(crex_ctd_t, autoQC, manualQC) && CHECKPOINT_NEXT(crex_ctd_t, manualQC, offset) &&
+    CHECKPOINT_NEXT(crex_ctd_t, offset, increment) && CHECKPOINT_NEXT(crex_ctd_t, increment, mes) &&
+    CHECKPOINT_NEXT(crex_ctd_t, mes, res) && CHECKPOINT_LAST(crex_ctd_t, res), "crex_ctd_t has fields not checked");
+
+_Static_assert(CHECKPOINT_TYPE(crex_stream_t, srcname, checkpoint_name_t) && CHECKPOINT_TYPE(crex_stream_t, alpha, double) &&
+    CHECKPOINT_TYPE(crex_stream_t, beta, double) && CHECKPOINT_TYPE(crex_stream_t, ctd, crex_ctd_t) &&
+    CHECKPOINT_TYPE(crex_stream_t, nfirs, int) && CHECKPOINT_TYPE(crex_stream_t, firs, checkpoint_firs_t) &&
+    CHECKPOINT_TYPE(crex_stream_t, delay, hptime_t) && CHECKPOINT_TYPE(crex_stream_t, samprate, double) &&
+    CHECKPOINT_TYPE(crex_stream_t, last, hptime_t) && CHECKPOINT_TYPE(crex_stream_t, next, crex_stream_t *), "crex_stream_t fields have changed");
+_Static_assert(CHECKPOINT_NEXT(crex_stream_t, srcname, alpha) && CHECKPOINT_NEXT(crex_stream_t, alpha, beta) &&
+    CHECKPOINT_NEXT(crex_stream_t, beta, ctd) && CHECKPOINT_NEXT(crex_stream_t, ctd, nfirs) &&
+    CHECKPOINT_NEXT(crex_stream_t, nfirs, firs) && CHECKPOINT_NEXT(crex_stream_t, firs, delay) &&
+    CHECKPOINT_NEXT(crex_stream_t, delay, samprate) && CHECKPOINT_NEXT(crex_stream_t, samprate, last) &&
+    CHECKPOINT_NEXT(crex_stream_t, last, next) && CHECKPOINT_LAST(crex_stream_t, next), "crex_stream_t has fields not checked");
+
+typedef struct checkpoint_header_s {
+    char magic[8];
+    uint32_t version;
+    uint32_t streamsize; /* sizeof(crex_stream_t) when written */
+    uint32_t firsize; /* sizeof(firfilter_t) */
+    uint32_t firoffset; /* where the fir filters start in the stream state */
+    uint32_t nstations;
+    uint32_t nstreams;
+    uint32_t npending;
+} checkpoint_header_t;
+
+/* make room for more packed streams */
+static int checkpoint_reserve(checkpoint_t *checkpoint, size_t len) {
+    char *p;
+    size_t max;
+
+    if (checkpoint->nbytes + len <= checkpoint->maxbytes)
+        return 0;
+    for (max = (checkpoint->maxbytes > 0) ? checkpoint->maxbytes : 65536; max < checkpoint->nbytes + len; max *= 2);
+    if ((p = (char *) realloc(checkpoint->streams, max)) == NULL)
+        return -1;
+    checkpoint->streams = p;
+    checkpoint->maxbytes = max;
+
+    return 0;
+}
+
+/* make a rename into a directory durable */
+static int checkpoint_syncdir(char *file) {
+    char dir[1024];
+    char *p;
+    int errsv = 0;
+    int fd;
+
+    strncpy(dir, file, sizeof(dir) - 1);
+    dir[sizeof(dir) - 1] = '\0';
+    if ((p = strrchr(dir, '/')) == NULL)
+        strcpy(dir, ".");
+    else if (p == dir)
+        dir[1] = '\0';
+    else
+        *p = '\0';
+
+    if ((fd = open(dir, O_RDONLY)) < 0) {
+        errsv = errno; ms_log(2, "failed to open checkpoint directory: %s - %s\n", dir, strerror(errsv)); return -1;
+    }
+    if (fsync(fd) < 0) {
+        errsv = errno; ms_log(2, "failed to sync checkpoint directory: %s - %s\n", dir, strerror(errsv)); (void) close(fd); return -1;
+    }
+    (void) close(fd);
+
+    return 0;
+}
+
+/* make room for one more entry in a growing array */
+static int checkpoint_grow(void **list, int count, int *max, size_t size) {
+    void *p;
+
+    if (count < *max)
+        return 0;
+    if ((p = realloc(*list, 2 * (count + 16) * size)) == NULL)
+        return -1;
+    *list = p;
+    *max = 2 * (count + 16);
+
+    return 0;
+}
+
+int checkpoint_station(checkpoint_t *checkpoint, char *server, char *net, char *sta, int seqnum, char *timestamp) {
+    checkpoint_station_t *station;
+
+    if (checkpoint_grow((void **) &checkpoint->stations, checkpoint->nstations, &checkpoint->maxstations, sizeof(checkpoint_station_t)) < 0)
+        return -1;
+    station = &checkpoint->stations[checkpoint->nstations++];
+    memset(station, 0, sizeof(checkpoint_station_t));
+
+    strncpy(station->server, server, sizeof(station->server) - 1);
+    strncpy(station->net, net, sizeof(station->net) - 1);
+    strncpy(station->sta, sta, sizeof(station->sta) - 1);
+    station->seqnum = seqnum;
+    strncpy(station->timestamp, timestamp, sizeof(station->timestamp) - 1);
+
+    return 0;
+}
+
+/* add the packed state of a stream, as held by the registry */
+int checkpoint_stream(checkpoint_t *checkpoint, char *state, size_t len) {
+    if (checkpoint_reserve(checkpoint, len) < 0)
+        return -1;
+    memcpy(checkpoint->streams + checkpoint->nbytes, state, len);
+    checkpoint->nbytes += len;
+    checkpoint->nstreams++;
+
+    return 0;
+}
+
+/* unpack the stream at the offset, moving it on to the next, returns -1 once there are no more */
+int checkpoint_nextstream(checkpoint_t *checkpoint, size_t *offset, crex_stream_t *stream) {
+    if ((*offset >= checkpoint->nbytes) || (registry_unpack(checkpoint->streams + *offset, checkpoint->nbytes - *offset, stream) < 0))
+        return -1;
+    *offset += registry_packsize(stream->nfirs);
+
+    return 0;
+}
+
+int checkpoint_pending(checkpoint_t *checkpoint, char *streamid, hptime_t minute, off_t length) {
+    checkpoint_pending_t *pending;
+
+    if (checkpoint_grow((void **) &checkpoint->pending, checkpoint->npending, &checkpoint->maxpending, sizeof(checkpoint_pending_t)) < 0)
+        return -1;
+    pending = &checkpoint->pending[checkpoint->npending++];
+    memset(pending, 0, sizeof(checkpoint_pending_t));
+
+    strncpy(pending->streamid, streamid, sizeof(pending->streamid) - 1);
+    pending->minute = minute;
+    pending->length = length;
+
+    return 0;
+}
+
+/* add the streams and pending minute files gathered into a part of the snapshot */
+int checkpoint_merge(checkpoint_t *checkpoint, checkpoint_t *part) {
+    int n;
+
+    if (checkpoint_reserve(checkpoint, part->nbytes) < 0)
+        return -1;
+    memcpy(checkpoint->streams + checkpoint->nbytes, part->streams, part->nbytes);
+    checkpoint->nbytes += part->nbytes;
+    checkpoint->nstreams += part->nstreams;
+
+    for (n = 0; n < part->npending; n++) {
+        if (checkpoint_pending(checkpoint, part->pending[n].streamid, part->pending[n].minute, part->pending[n].length) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+/* empty the snapshot, keeping the memory for the next one */
+void checkpoint_clear(checkpoint_t *checkpoint) {
+    checkpoint->nstations = 0;
+    checkpoint->nstreams = 0;
+    checkpoint->nbytes = 0;
+    checkpoint->npending = 0;
+}
+
+void checkpoint_free(checkpoint_t *checkpoint) {
+    free((char *) checkpoint->stations);
+    free((char *) checkpoint->streams);
+    free((char *) checkpoint->pending);
+    memset(checkpoint, 0, sizeof(checkpoint_t));
+}
+
+/* write the snapshot to a temporary file, then rename it into place */
+int checkpoint_write(checkpoint_t *checkpoint, char *file) {
+    checkpoint_header_t header;
+    char tmpfile[1024];
+    FILE *fp;
+    int errsv = 0;
+    int rv = 0;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.streamsize = sizeof(crex_stream_t);
+    header.firsize = sizeof(firfilter_t);
+    header.firoffset = CHECKPOINT_FIRS;
+    header.nstations = (uint32_t) checkpoint->nstations;
+    header.nstreams = (uint32_t) checkpoint->nstreams;
+    header.npending = (uint32_t) checkpoint->npending;
+
+    snprintf(tmpfile, sizeof(tmpfile), "%s.tmp", file);
+    if ((fp = fopen(tmpfile, "w")) == NULL) {
+        errsv = errno; ms_log(2, "failed to open checkpoint file: %s - %s\n", tmpfile, strerror(errsv)); return -1;
+    }
+
+    /* the streams are already packed as written */
+    if ((fwrite(&header, sizeof(header), 1, fp) != 1) ||
+        (fwrite(checkpoint->stations, sizeof(checkpoint_station_t), checkpoint->nstations, fp) != (size_t) checkpoint->nstations) ||
+        ((checkpoint->nbytes > 0) && (fwrite(checkpoint->streams, checkpoint->nbytes, 1, fp) != 1)) ||
+        (fwrite(checkpoint->pending, sizeof(checkpoint_pending_t), checkpoint->npending, fp) != (size_t) checkpoint->npending) ||
+        (fflush(fp) != 0) || (fsync(fileno(fp)) != 0)) {
+        errsv = errno; ms_log(2, "failed to write checkpoint file: %s - %s\n", tmpfile, strerror(errsv)); rv = -1;
+    }
+    if ((fclose(fp) != 0) && (rv == 0)) {
+        errsv = errno; ms_log(2, "failed to close checkpoint file: %s - %s\n", tmpfile, strerror(errsv)); rv = -1;
+    }
+
+    if (rv < 0) {
+        (void) unlink(tmpfile); return -1;
+    }
+    if (rename(tmpfile, file) != 0) {
+        errsv = errno; ms_log(2, "failed to rename checkpoint file: %s - %s\n", file, strerror(errsv)); return -1;
+    }
+
+    return checkpoint_syncdir(file);
+}
+
+/* read back a snapshot, returning -1 if there is none or it does not match this build */
+int checkpoint_read(checkpoint_t *checkpoint, char *file) {
+    checkpoint_header_t header;
+    FILE *fp;
+    int rv = 0;
+    uint32_t nfirs;
+    uint32_t n;
+
+    checkpoint_clear(checkpoint);
+    if ((fp = fopen(file, "r")) == NULL)
+        return -1;
+
+    if ((fread(&header, sizeof(header), 1, fp) != 1) || (memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0) ||
+        (header.version != CHECKPOINT_VERSION) || (header.streamsize != sizeof(crex_stream_t)) ||
+        (header.firsize != sizeof(firfilter_t)) || (header.firoffset != CHECKPOINT_FIRS)) {
+        ms_log(1, "ignoring incompatible checkpoint file: %s\n", file); fclose(fp); return -1;
+    }
+
+    if (((header.nstations > 0) && ((checkpoint->stations = (checkpoint_station_t *) calloc(header.nstations, sizeof(checkpoint_station_t))) == NULL)) ||
+        ((header.npending > 0) && ((checkpoint->pending = (checkpoint_pending_t *) calloc(header.npending, sizeof(checkpoint_pending_t))) == NULL))) {
+        ms_log(1, "memory error!\n"); fclose(fp); checkpoint_free(checkpoint); return -1;
+    }
+    checkpoint->maxstations = (int) header.nstations;
+    checkpoint->maxpending = (int) header.npending;
+
+    if (fread(checkpoint->stations, sizeof(checkpoint_station_t), header.nstations, fp) != header.nstations)
+        rv = -1;
+    /* each stream is read as packed, its length following from its filter count */
+    for (n = 0; (rv == 0) && (n < header.nstreams); n++) {
+        if ((fread(&nfirs, sizeof(nfirs), 1, fp) != 1) || (nfirs > FIR_MAX_FILTERS)) {
+            rv = -1; break;
+        }
+        if (checkpoint_reserve(checkpoint, registry_packsize((int) nfirs)) < 0) {
+            ms_log(1, "memory error!\n"); fclose(fp); checkpoint_free(checkpoint); return -1;
+        }
+        memcpy(checkpoint->streams + checkpoint->nbytes, &nfirs, sizeof(nfirs));
+        if (fread(checkpoint->streams + checkpoint->nbytes + sizeof(nfirs), registry_packsize((int) nfirs) - sizeof(nfirs), 1, fp) != 1)
+            rv = -1;
+        checkpoint->nbytes += registry_packsize((int) nfirs);
+    }
+    if ((rv < 0) || (fread(checkpoint->pending, sizeof(checkpoint_pending_t), header.npending, fp) != header.npending)) {
+        ms_log(1, "truncated checkpoint file: %s\n", file); rv = -1;
+    }
+    fclose(fp);
+
+    if (rv < 0) {
+        checkpoint_free(checkpoint); return -1;
+    }
+    checkpoint->nstations = (int) header.nstations;
+    checkpoint->nstreams = (int) header.nstreams;
+    checkpoint->npending = (int) header.npending;
+
+    return 0;
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef _CHECKPOINT_H
+#define _CHECKPOINT_H
+
+#include <sys/types.h>
+#include <libmseed.h>
+#include <libcrex.h>
+
+/*
+ * checkpoint: binary snapshot of the seedlink position, the crex stream state and pending minute files
+ *
+ * The snapshot is gathered in memory and written with a rename over the previous one, followed by
+ * a sync of the directory, so a restart always finds a complete snapshot. It is a host format,
+ * only meant to be read back by the same build: the header carries a version and the stream state
+ * layout sizes, and the snapshot is ignored if any differ. Streams are held, and written, packed as
+ * the registry keeps them, without their unused fir filter slots, so each worker can copy its own
+ * streams into a part of the snapshot which is only merged in once it is finished.
+ */
+
+#define CHECKPOINT_MAGIC "SLGTSCP2"
+#define CHECKPOINT_VERSION 2
+
+typedef struct checkpoint_station_s {
+    char server[128]; /* seedlink address */
+    char net[12];
+    char sta[12];
+    int seqnum;
+    char timestamp[20];
+} checkpoint_station_t;
+
+typedef struct checkpoint_pending_s {
+    char streamid[64];
+    hptime_t minute;
+    off_t length; /* hidden file length at the snapshot */
+} checkpoint_pending_t;
+
+typedef struct checkpoint_s {
+    int nstations;
+    int maxstations;
+    checkpoint_station_t *stations;
+
+    int nstreams;
+    size_t nbytes;
+    size_t maxbytes;
+    char *streams; /* packed as written */
+
+    int npending;
+    int maxpending;
+    checkpoint_pending_t *pending;
+} checkpoint_t;
+
+extern int checkpoint_station(checkpoint_t *checkpoint, char *server, char *net, char *sta, int seqnum, char *timestamp);
+extern int checkpoint_stream(checkpoint_t *checkpoint, char *state, size_t len);
+extern int checkpoint_pending(checkpoint_t *checkpoint, char *streamid, hptime_t minute, off_t length);
+extern int checkpoint_merge(checkpoint_t *checkpoint, checkpoint_t *part);
+extern int checkpoint_nextstream(checkpoint_t *checkpoint, size_t *offset, crex_stream_t *stream);
+
+extern void checkpoint_clear(checkpoint_t *checkpoint);
+extern void checkpoint_free(checkpoint_t *checkpoint);
+
+extern int checkpoint_write(checkpoint_t *checkpoint, char *file);
+extern int checkpoint_read(checkpoint_t *checkpoint, char *file);
+
+#endif /* _CHECKPOINT_H */
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/* system includes */
+#include <stdio.h>
+#include <string.h>
+
+#include "crexout.h"
+#include "mshdr.h"
+
+/* find the srcname, start time, sequence number and ascii text of a packed record, returns -1 if it holds no text */
+int crexout_text(char *record, int reclen, char *srcname, hptime_t *starttime, int *sequence, char **text, int *len) {
+    mshdr_t hdr;
+    unsigned int numsamples;
+
+    if ((mshdr_read(&hdr, record, reclen) < 0) || (hdr.encoding != DE_ASCII) || (hdr.numsamples == 0))
+        return -1;
+    if ((hdr.dataoffset < MSHDR_SIZE) || (hdr.dataoffset >= (unsigned int) reclen))
+        return -1;
+    numsamples = (hdr.numsamples > (unsigned int) reclen - hdr.dataoffset) ? (unsigned int) reclen - hdr.dataoffset : hdr.numsamples;
+
+    *text = record + hdr.dataoffset;
+    *len = (int) strnlen(*text, numsamples);
+    *starttime = mshdr_starttime(&hdr);
+    *sequence = hdr.sequence;
+    mshdr_srcname(record, srcname);
+
+    return 0;
+}
+
+/* process_crex record handler, with a crexout_t as the handler data */
+void crexout_handler(char *record, int reclen, void *extra) {
+    crexout_t *out = (crexout_t *) extra;
+    char srcname[64];
+    hptime_t starttime;
+    int sequence;
+    char *text;
+    int len;
+
+    if (out->record_handler != NULL) {
+        out->record_handler(record, reclen, out->extra); return;
+    }
+
+    if (crexout_text(record, reclen, srcname, &starttime, &sequence, &text, &len) < 0)
+        return;
+
+    out->text_handler(srcname, starttime, sequence, text, len, out->extra);
+}
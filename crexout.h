@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef _CREXOUT_H
+#define _CREXOUT_H
+
+#include <libmseed.h>
+
+/*
+ * crexout: hand the CREX records built by process_crex straight to an output
+ *
+ * process_crex delivers each CREX message packed as an ascii miniseed record, crexout_handler
+ * reads the srcname, start time, sequence number and text span directly from the packed headers, without
+ * unpacking or copying, and passes them to the text handler. A record handler can be given
+ * instead when the miniseed form itself is wanted.
+ */
+
+typedef void (*crexout_text_t)(char *srcname, hptime_t starttime, int sequence, char *text, int len, void *extra);
+typedef void (*crexout_record_t)(char *record, int reclen, void *extra);
+
+typedef struct crexout_s {
+    crexout_text_t text_handler;
+    crexout_record_t record_handler; /* when set, records are passed on as is */
+    void *extra;
+} crexout_t;
+
+extern int crexout_text(char *record, int reclen, char *srcname, hptime_t *starttime, int *sequence, char **text, int *len);
+extern void crexout_handler(char *record, int reclen, void *extra);
+
+#endif /* _CREXOUT_H */
@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/* system includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libmseed.h>
+#include <libdali.h>
+
+#include "datalink.h"
+#include "crexout.h"
+
+datalink_t *datalink_new(char *address, char *progname, int nproducers, int queuesize, char *spoolfile) {
+    datalink_t *datalink;
+    char spoolname[1024];
+    int n;
+
+    if ((datalink = (datalink_t *) malloc(sizeof(datalink_t))) == NULL)
+        return NULL;
+    memset(datalink, 0, sizeof(datalink_t));
+
+    datalink->address = address;
+    if ((datalink->dlconn = dl_newdlcp(address, progname)) == NULL) {
+        free((char *) datalink); return NULL;
+    }
+
+    datalink->nrings = nproducers;
+    if ((datalink->rings = (ring_t **) calloc(nproducers, sizeof(ring_t *))) == NULL) {
+        datalink_free(datalink); return NULL;
+    }
+    for (n = 0; n < nproducers; n++) {
+        if (spoolfile)
+            snprintf(spoolname, sizeof(spoolname), "%s.datalink.%d", spoolfile, n);
+        if ((datalink->rings[n] = ring_new(queuesize, DATALINK_ENTRY, (spoolfile) ? spoolname : NULL)) == NULL) {
+            datalink_free(datalink); return NULL;
+        }
+        ring_share(datalink->rings[n], datalink->rings[0]);
+    }
+
+    return datalink;
+}
+
+/* queue a record for sending with the end time of the data behind it, spooling or dropping it if the sender has fallen behind */
+int datalink_put(datalink_t *datalink, int producer, char *record, int reclen, hptime_t endtime) {
+    char entry[DATALINK_ENTRY];
+
+    if ((reclen <= 0) || (reclen > DATALINK_RECSIZE)) {
+        ms_log(2, "unable to queue %d byte record for datalink\n", reclen); return -1;
+    }
+    memcpy(entry, &endtime, sizeof(hptime_t));
+    memcpy(entry + sizeof(hptime_t), &reclen, sizeof(int));
+    memcpy(entry + DATALINK_HEADER, record, (size_t) reclen);
+
+    return ring_offer(datalink->rings[producer % datalink->nrings], entry);
+}
+
+/* records which could be neither queued nor spooled */
+unsigned long datalink_dropped(datalink_t *datalink) {
+    unsigned long dropped = 0;
+    int n;
+
+    for (n = 0; n < datalink->nrings; n++)
+        dropped += datalink->rings[n]->dropped;
+
+    return dropped;
+}
+
+/* connect, backing off between failed attempts, until connected or stopped */
+static int datalink_connect(datalink_t *datalink) {
+    struct timespec ts = { 0, 0 };
+    int wait = 1;
+
+    while (datalink->dlconn->link < 0) {
+        if (dl_connect(datalink->dlconn) >= 0) {
+            datalink->connects++;
+            return 0;
+        }
+        if (!atomic_load(&datalink->running))
+            return -1;
+
+        ms_log(1, "unable to connect to datalink server [%s], retrying in %ds\n", datalink->address, wait);
+        ts.tv_sec = wait;
+        (void) nanosleep(&ts, NULL);
+        wait = (2 * wait < DATALINK_RETRY) ? 2 * wait : DATALINK_RETRY;
+    }
+
+    return 0;
+}
+
+/* write a batch, only the last record is acknowledged */
+static int datalink_batch(datalink_t *datalink, char *records, int nrecords) {
+    char streamid[100];
+    char srcname[64];
+    hptime_t starttime;
+    hptime_t endtime;
+    char *record;
+    char *text;
+    int sequence;
+    int reclen;
+    int len;
+    int n, last;
+    int sent = 0;
+    int skipped = 0;
+
+    /* the acknowledgement has to be asked for on a record which is actually written */
+    for (last = nrecords - 1; last >= 0; last--) {
+        record = records + last * DATALINK_ENTRY;
+        memcpy(&reclen, record + sizeof(hptime_t), sizeof(int));
+        if (crexout_text(record + DATALINK_HEADER, reclen, srcname, &starttime, &sequence, &text, &len) == 0)
+            break;
+    }
+
+    for (n = 0; n < nrecords; n++) {
+        record = records + n * DATALINK_ENTRY;
+        memcpy(&endtime, record, sizeof(hptime_t));
+        memcpy(&reclen, record + sizeof(hptime_t), sizeof(int));
+        if (crexout_text(record + DATALINK_HEADER, reclen, srcname, &starttime, &sequence, &text, &len) < 0) {
+            skipped++; continue;
+        }
+        if (endtime < starttime)
+            endtime = starttime;
+        snprintf(streamid, sizeof(streamid), "%s/MSEED", srcname);
+        if (dl_write(datalink->dlconn, record + DATALINK_HEADER, reclen, streamid, (dltime_t) starttime, (dltime_t) endtime, (n == last)) < 0)
+            return -1;
+        sent++;
+    }
+
+    /* only counted once the whole batch has gone, as a failed batch is sent again */
+    datalink->written += (unsigned long) sent;
+    datalink->skipped += (unsigned long) skipped;
+    if (sent > 0)
+        datalink->batches++;
+
+    return 0;
+}
+
+static void *datalink_thread(void *arg) {
+    datalink_t *datalink = (datalink_t *) arg;
+    char *records;
+    int nrecords = 0;
+    int n, empty;
+
+    if ((records = (char *) malloc(DATALINK_BATCH * DATALINK_ENTRY)) == NULL) {
+        ms_log(1, "memory error!\n"); return NULL;
+    }
+
+    for (;;) {
+        /* fill the batch fairly from each producer */
+        for (n = 0, empty = 0; (nrecords < DATALINK_BATCH) && (empty < datalink->nrings); n = (n + 1) % datalink->nrings) {
+            if (ring_get(datalink->rings[n], records + nrecords * DATALINK_ENTRY) == 0) {
+                nrecords++; empty = 0;
+            }
+            else {
+                empty++;
+            }
+        }
+
+        if (nrecords == 0) {
+            if (!atomic_load(&datalink->running))
+                break;
+            ring_waitany(datalink->rings, datalink->nrings, DATALINK_IDLE);
+            continue;
+        }
+
+        if (datalink_connect(datalink) < 0)
+            break;
+        if (datalink_batch(datalink, records, nrecords) < 0) {
+            ms_log(1, "datalink write failed [%s], reconnecting\n", datalink->address);
+            dl_disconnect(datalink->dlconn);
+            continue;
+        }
+        nrecords = 0;
+    }
+
+    if (nrecords > 0)
+        ms_log(1, "unable to send %d records to datalink server [%s]\n", nrecords, datalink->address);
+    if (datalink->dlconn->link >= 0)
+        dl_disconnect(datalink->dlconn);
+    free(records);
+
+    return NULL;
+}
+
+int datalink_start(datalink_t *datalink) {
+    atomic_store(&datalink->running, 1);
+    if (pthread_create(&datalink->thread, NULL, datalink_thread, datalink) != 0) {
+        atomic_store(&datalink->running, 0); return -1;
+    }
+
+    return 0;
+}
+
+/* send anything queued, then stop the sender */
+void datalink_stop(datalink_t *datalink) {
+    if (atomic_load(&datalink->running)) {
+        atomic_store(&datalink->running, 0);
+        ring_wake(datalink->rings[0]);
+        pthread_join(datalink->thread, NULL);
+    }
+}
+
+void datalink_free(datalink_t *datalink) {
+    int n;
+
+    if (datalink == NULL)
+        return;
+
+    datalink_stop(datalink);
+
+    for (n = 0; (datalink->rings) && (n < datalink->nrings); n++)
+        ring_free(datalink->rings[n]);
+    free((char *) datalink->rings);
+    if (datalink->dlconn)
+        dl_freedlcp(datalink->dlconn);
+    free((char *) datalink);
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef _DATALINK_H
+#define _DATALINK_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <libmseed.h>
+#include <libdali.h>
+
+#include "ring.h"
+
+/*
+ * datalink: send CREX records to a DataLink server, such as ringserver
+ *
+ * Each producer thread has its own ring, drained by a single sender thread which writes the
+ * records without waiting, and only asks for an acknowledgement on the last one of each
+ * batch. If the batch fails the connection is dropped, and the whole batch is sent again
+ * once it has been re-established, so records may be repeated. Producers never wait on
+ * the sender, so without a spool file records are dropped, and counted, once a ring is full.
+ * The rings share one wakeup, so an idle sender sleeps until any producer queues a record.
+ * Records are queued with their own length, up to the longest a ring entry holds.
+ */
+
+#define DATALINK_BATCH 64 /* records written for each acknowledgement */
+#define DATALINK_RECSIZE 4096 /* longest record which can be queued */
+#define DATALINK_HEADER 16 /* the end time of the data and the record length, ahead of the record */
+#define DATALINK_ENTRY (DATALINK_HEADER + DATALINK_RECSIZE)
+#define DATALINK_IDLE 1000 /* milliseconds an idle sender waits before checking it is still running */
+#define DATALINK_RETRY 30 /* longest wait between connection attempts */
+
+typedef struct datalink_s {
+    char *address;
+    DLCP *dlconn;
+
+    int nrings;
+    ring_t **rings; /* one for each producer */
+
+    pthread_t thread;
+    atomic_int running;
+
+    unsigned long written;
+    unsigned long skipped; /* queued records without any CREX text */
+    unsigned long batches;
+    unsigned long connects;
+} datalink_t;
+
+extern datalink_t *datalink_new(char *address, char *progname, int nproducers, int queuesize, char *spoolfile);
+extern int datalink_start(datalink_t *datalink);
+extern void datalink_stop(datalink_t *datalink);
+extern void datalink_free(datalink_t *datalink);
+
+extern int datalink_put(datalink_t *datalink, int producer, char *record, int reclen, hptime_t endtime);
+extern unsigned long datalink_dropped(datalink_t *datalink);
+
+#endif /* _DATALINK_H */
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/* system includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fnmatch.h>
+
+#include "filter.h"
+#include "mshdr.h"
+#include "hash.h"
+
+static filter_slot_t *filter_probe(filter_t *filter, char *codes) {
+    unsigned int mask = (unsigned int) filter->nslots - 1;
+    unsigned int n;
+
+    for (n = hash_bytes(codes, 12) & mask; ; n = (n + 1) & mask) {
+        if ((filter->slots[n].state == 0) || (memcmp(filter->slots[n].codes, codes, 12) == 0))
+            return &filter->slots[n];
+    }
+}
+
+static int filter_grow(filter_t *filter) {
+    filter_slot_t *slots = filter->slots;
+    int nslots = filter->nslots;
+    int n;
+
+    if ((filter->slots = (filter_slot_t *) calloc(2 * nslots, sizeof(filter_slot_t))) == NULL) {
+        filter->slots = slots; return -1;
+    }
+    filter->nslots = 2 * nslots;
+    for (n = 0; n < nslots; n++) {
+        if (slots[n].state != 0)
+            *filter_probe(filter, slots[n].codes) = slots[n];
+    }
+    free((char *) slots);
+
+    return 0;
+}
+
+/* match the srcname built from the header codes against the patterns */
+static int filter_match(filter_t *filter, char *record) {
+    char srcname[64];
+    int n;
+
+    mshdr_srcname(record, srcname);
+
+    for (n = 0; n < filter->nexclude; n++) {
+        if (fnmatch(filter->exclude[n], srcname, 0) == 0)
+            return 0;
+    }
+    for (n = 0; n < filter->ninclude; n++) {
+        if (fnmatch(filter->include[n], srcname, 0) == 0)
+            return 1;
+    }
+
+    return (filter->ninclude == 0);
+}
+
+filter_t *filter_new(void) {
+    filter_t *filter;
+
+    if ((filter = (filter_t *) malloc(sizeof(filter_t))) == NULL)
+        return NULL;
+    memset(filter, 0, sizeof(filter_t));
+
+    filter->nslots = 64;
+    if ((filter->slots = (filter_slot_t *) calloc(filter->nslots, sizeof(filter_slot_t))) == NULL) {
+        free((char *) filter); return NULL;
+    }
+
+    return filter;
+}
+
+void filter_free(filter_t *filter) {
+    int n;
+
+    if (filter == NULL)
+        return;
+
+    for (n = 0; n < filter->ninclude; n++)
+        free(filter->include[n]);
+    for (n = 0; n < filter->nexclude; n++)
+        free(filter->exclude[n]);
+    free((char *) filter->slots);
+    free((char *) filter);
+}
+
+/* add comma separated srcname patterns, e.g. NZ_*_40_?TZ */
+int filter_add(filter_t *filter, char *patterns, int exclude) {
+    char *list, *pattern, *last = NULL;
+
+    if ((list = strdup(patterns)) == NULL)
+        return -1;
+
+    for (pattern = strtok_r(list, ",", &last); pattern != NULL; pattern = strtok_r(NULL, ",", &last)) {
+        if (((exclude) ? filter->nexclude : filter->ninclude) >= FILTER_PATTERNS) {
+            free(list); return -1;
+        }
+        if (exclude)
+            filter->exclude[filter->nexclude++] = strdup(pattern);
+        else
+            filter->include[filter->ninclude++] = strdup(pattern);
+    }
+    free(list);
+
+    return 0;
+}
+
+/* whether a raw record holds data samples from a wanted stream */
+int filter_record(filter_t *filter, char *record, int reclen) {
+    mshdr_t hdr;
+    filter_slot_t *slot;
+
+    if (mshdr_read(&hdr, record, reclen) < 0)
+        return 0;
+
+    /* data records only, with samples and a sample rate */
+    if ((record[6] != 'D') && (record[6] != 'R') && (record[6] != 'Q') && (record[6] != 'M'))
+        return 0;
+    if ((hdr.numsamples == 0) || (hdr.factor == 0))
+        return 0;
+
+    /* skip ascii log and text records */
+    if (hdr.encoding == DE_ASCII)
+        return 0;
+
+    if ((filter->ninclude == 0) && (filter->nexclude == 0))
+        return 1;
+
+    slot = filter_probe(filter, record + 8);
+    if (slot->state == 0) {
+        if (2 * (filter->nused + 1) > filter->nslots) {
+            if ((filter_grow(filter) < 0) && (filter->nused + 1 >= filter->nslots))
+                return filter_match(filter, record);
+            slot = filter_probe(filter, record + 8);
+        }
+        memcpy(slot->codes, record + 8, 12);
+        slot->state = 1 + filter_match(filter, record);
+        filter->nused++;
+    }
+
+    return slot->state - 1;
+}
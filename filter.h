@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef _FILTER_H
+#define _FILTER_H
+
+/*
+ * filter: decide from the fixed header alone whether a raw record is worth decoding
+ *
+ * Records must hold data samples, and their srcname must match one of any include patterns
+ * and none of the exclude patterns. Pattern decisions are cached on the raw header codes,
+ * so each stream is only matched once.
+ */
+
+#define FILTER_PATTERNS 64 /* maximum include or exclude patterns */
+
+typedef struct filter_slot_s {
+    char codes[12]; /* station, location, channel and network as found in the header */
+    int state; /* zero when empty, otherwise one plus the decision */
+} filter_slot_t;
+
+typedef struct filter_s {
+    int ninclude;
+    char *include[FILTER_PATTERNS];
+    int nexclude;
+    char *exclude[FILTER_PATTERNS];
+
+    int nused;
+    int nslots; /* always a power of two */
+    filter_slot_t *slots;
+} filter_t;
+
+extern filter_t *filter_new(void);
+extern void filter_free(filter_t *filter);
+
+extern int filter_add(filter_t *filter, char *patterns, int exclude);
+extern int filter_record(filter_t *filter, char *record, int reclen);
+
+#endif /* _FILTER_H */
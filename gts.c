@@ -0,0 +1,599 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/* system includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "gts.h"
+#include "hash.h"
+
+#define MINUTE ((hptime_t) 60 * HPTMODULUS)
+
+/* write all of buf, restarting after signals */
+static int gts_writen(int fd, char *buf, size_t len) {
+    ssize_t n;
+
+    while (len > 0) {
+        if ((n = write(fd, buf, len)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += n; len -= (size_t) n;
+    }
+
+    return 0;
+}
+
+/* read all of a file, restarting after signals, returning how much was read */
+static ssize_t gts_readn(int fd, char *buf, size_t len) {
+    size_t total = 0;
+    ssize_t n;
+
+    while (total < len) {
+        if ((n = read(fd, buf + total, len - total)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (n == 0)
+            break;
+        total += (size_t) n;
+    }
+
+    return (ssize_t) total;
+}
+
+/* move any buffered text into the hidden temporary file */
+static int gts_spill(gts_t *gts, gts_file_t *file) {
+    char tmpfile[1024];
+    int errsv = 0;
+    double t = (gts->stats) ? stats_now() : 0.0;
+
+    if (file->fd < 0) {
+        snprintf(tmpfile, sizeof(tmpfile), "%s/.%s", gts->dir, file->name);
+        /* a patch holds the whole file, so nothing left behind by an earlier run is kept */
+        if ((file->fd = open(tmpfile, O_WRONLY | O_CREAT | O_APPEND | ((file->patch) ? O_TRUNC : 0), 0644)) < 0) {
+            errsv = errno; ms_log(2, "failed to open output file: %s - %s\n", tmpfile, strerror(errsv)); return -1;
+        }
+        if (gts->stats) {
+            stats_add(&gts->stats->stages[STATS_OPEN], stats_now() - t); t = stats_now();
+        }
+    }
+    if (gts_writen(file->fd, file->text, file->ntext) < 0) {
+        errsv = errno; ms_log(2, "failed to write output file: .%s - %s\n", file->name, strerror(errsv)); return -1;
+    }
+    /* a patch is always written whole, and keeps its copy of the file */
+    if (!file->patch) {
+        file->ntext = 0;
+        file->spilled = 1;
+    }
+
+    if (gts->stats)
+        stats_add(&gts->stats->stages[STATS_WRITE], stats_now() - t);
+
+    return 0;
+}
+
+static int gts_publish(gts_t *gts, gts_file_t *file, int keep);
+
+static gts_file_t **gts_bucket(gts_t *gts, unsigned int hash) {
+    return &gts->buckets[hash & (unsigned int) (gts->nbuckets - 1)];
+}
+
+/* take a slot off the recently used list */
+static void gts_detach(gts_t *gts, gts_file_t *file) {
+    if (file->older != NULL)
+        file->older->newer = file->newer;
+    else if (gts->lru == file)
+        gts->lru = file->newer;
+    if (file->newer != NULL)
+        file->newer->older = file->older;
+    else if (gts->mru == file)
+        gts->mru = file->older;
+    file->older = file->newer = NULL;
+}
+
+/* make a slot the most recently used */
+static void gts_attach(gts_t *gts, gts_file_t *file) {
+    file->older = gts->mru;
+    file->newer = NULL;
+    if (gts->mru != NULL)
+        gts->mru->newer = file;
+    else
+        gts->lru = file;
+    gts->mru = file;
+}
+
+/* hand a slot back to the unused list */
+static void gts_release(gts_t *gts, gts_file_t *file) {
+    gts_file_t **pp;
+
+    for (pp = gts_bucket(gts, file->hash); *pp != NULL; pp = &(*pp)->chain) {
+        if (*pp == file) {
+            *pp = file->chain; break;
+        }
+    }
+    gts_detach(gts, file);
+
+    file->fd = -1;
+    file->ntext = 0;
+    file->minute = 0;
+    file->patch = 0;
+    file->hold = 0;
+    file->dirty = 0;
+    file->spilled = 0;
+    file->chain = gts->unused;
+    gts->unused = file;
+}
+
+/* set up an unused slot for the stream and minute, publishing the least recently used if there are none */
+static gts_file_t *gts_claim(gts_t *gts, unsigned int hash, char *streamid, hptime_t minute, int *rv) {
+    gts_file_t *file;
+    gts_file_t **bucket;
+    BTime btime;
+    int mon, mday;
+
+    if (ms_hptime2btime (minute, &btime) < 0) {
+        ms_log (2, "error unpacking hptime"); return NULL;
+    }
+    ms_doy2md(btime.year, btime.day, &mon, &mday);
+
+    /* a slot is always released, even if publishing it fails */
+    if ((gts->unused == NULL) && (gts_publish(gts, gts->lru, 0) < 0))
+        *rv = -1;
+    file = gts->unused;
+    gts->unused = file->chain;
+
+    file->hash = hash;
+    strncpy(file->streamid, streamid, sizeof(file->streamid) - 1);
+    snprintf(file->name, GTS_NAMELEN, "%s.%04d%02d%02d%02d%02d.txt", streamid, btime.year, mon, mday, btime.hour, btime.min);
+    file->minute = minute;
+    file->opened = time(NULL);
+    file->oldest = 0;
+    file->deadline = gts->deadline;
+    file->patch = 0;
+    file->dirty = 0;
+    file->spilled = 0;
+
+    bucket = gts_bucket(gts, hash);
+    file->chain = *bucket;
+    *bucket = file;
+    gts_attach(gts, file);
+
+    return file;
+}
+
+/* the published minutes and written records of a stream, added when asked */
+static gts_published_t *gts_lookup(gts_t *gts, unsigned int hash, char *streamid, int add) {
+    gts_published_t *published;
+    int max, n, i;
+
+    for (n = 0; n < gts->maxpublished; n++) {
+        i = (int) ((hash + (unsigned int) n) & (unsigned int) (gts->maxpublished - 1));
+        if (gts->published[i].streamid[0] == '\0')
+            break;
+        if ((gts->published[i].hash == hash) && (strcmp(gts->published[i].streamid, streamid) == 0))
+            return &gts->published[i];
+    }
+    if (!add)
+        return NULL;
+
+    /* kept at most half full, so probes stay short */
+    if (2 * (gts->npublished + 1) > gts->maxpublished) {
+        max = (gts->maxpublished > 0) ? 2 * gts->maxpublished : 64;
+        if ((published = (gts_published_t *) calloc(max, sizeof(gts_published_t))) == NULL)
+            return NULL;
+        for (n = 0; n < gts->maxpublished; n++) {
+            if (gts->published[n].streamid[0] == '\0')
+                continue;
+            for (i = (int) (gts->published[n].hash & (unsigned int) (max - 1)); published[i].streamid[0] != '\0'; i = (i + 1) & (max - 1));
+            published[i] = gts->published[n];
+        }
+        free((char *) gts->published);
+        gts->published = published;
+        gts->maxpublished = max;
+    }
+    for (i = (int) (hash & (unsigned int) (gts->maxpublished - 1)); gts->published[i].streamid[0] != '\0'; i = (i + 1) & (gts->maxpublished - 1));
+    gts->published[i].hash = hash;
+    strncpy(gts->published[i].streamid, streamid, sizeof(gts->published[i].streamid) - 1);
+    gts->npublished++;
+
+    return &gts->published[i];
+}
+
+/* note the minute of a slot as published */
+static void gts_remember(gts_t *gts, gts_file_t *file) {
+    gts_published_t *entry;
+    hptime_t n;
+
+    if ((entry = gts_lookup(gts, file->hash, file->streamid, 1)) == NULL)
+        return;
+
+    if (file->minute > entry->newest) {
+        n = (entry->newest != 0) ? (file->minute - entry->newest) / MINUTE : GTS_HISTORY + 1;
+        if (n < GTS_HISTORY)
+            entry->mask = (entry->mask << n) | ((uint64_t) 1 << (n - 1));
+        else
+            entry->mask = (n == GTS_HISTORY) ? (uint64_t) 1 << (n - 1) : 0;
+        entry->newest = file->minute;
+    }
+    else if (((n = (entry->newest - file->minute) / MINUTE) > 0) && (n <= GTS_HISTORY)) {
+        entry->mask |= (uint64_t) 1 << (n - 1);
+    }
+}
+
+/* has the minute of a slot been published by this run, 1 or 0 when the index knows, otherwise -1 as only the file can tell */
+static int gts_published(gts_t *gts, gts_file_t *file) {
+    gts_published_t *entry;
+    hptime_t n;
+
+    entry = gts_lookup(gts, file->hash, file->streamid, 0);
+    if ((entry != NULL) && (entry->newest != 0) && (file->minute <= entry->newest)) {
+        if ((n = (entry->newest - file->minute) / MINUTE) == 0)
+            return 1;
+        if (n <= GTS_HISTORY)
+            return (int) ((entry->mask >> (n - 1)) & 1);
+    }
+    /* nothing later than the newest minute has been published by this run, nor by any earlier one once past its start */
+    if ((file->minute >= gts->started) && ((entry == NULL) || (file->minute > entry->newest)))
+        return 0;
+
+    return -1;
+}
+
+/* has the record the text came in already been written for the stream, if not it is remembered */
+static int gts_written(gts_t *gts, unsigned int hash, char *streamid, hptime_t starttime, int sequence) {
+    gts_published_t *entry;
+    int n;
+
+    /* without a sequence number there is no key */
+    if (sequence <= 0)
+        return 0;
+    if ((entry = gts_lookup(gts, hash, streamid, 1)) == NULL)
+        return 0;
+
+    for (n = 0; n < entry->nkeys; n++) {
+        if ((entry->keys[n].starttime == starttime) && (entry->keys[n].sequence == sequence))
+            return 1;
+    }
+    entry->keys[entry->nextkey].starttime = starttime;
+    entry->keys[entry->nextkey].sequence = sequence;
+    entry->nextkey = (entry->nextkey + 1) % GTS_KEYS;
+    if (entry->nkeys < GTS_KEYS)
+        entry->nkeys++;
+
+    return 0;
+}
+
+/* start a slot from the published file for its minute, which the text is then merged into */
+static int gts_reopen(gts_t *gts, gts_file_t *file) {
+    char outfile[1024];
+    struct stat st;
+    ssize_t n;
+    char *buf;
+    int errsv = 0;
+    int fd;
+
+    /* any file taken away since is not brought back, the late text is published on its own */
+    snprintf(outfile, sizeof(outfile), "%s/%s", gts->dir, file->name);
+    if ((fd = open(outfile, O_RDONLY)) < 0)
+        return 0;
+    if (fstat(fd, &st) < 0) {
+        errsv = errno; ms_log(2, "failed to stat published file: %s - %s\n", outfile, strerror(errsv)); (void) close(fd); return -1;
+    }
+    if ((size_t) st.st_size + 256 > file->size) {
+        if ((buf = (char *) realloc(file->text, (size_t) st.st_size + 256)) == NULL) {
+            ms_log(1, "memory error!\n"); (void) close(fd); return -1;
+        }
+        file->text = buf; file->size = (size_t) st.st_size + 256;
+    }
+    if ((n = gts_readn(fd, file->text, (size_t) st.st_size)) < 0) {
+        errsv = errno; ms_log(2, "failed to read published file: %s - %s\n", outfile, strerror(errsv)); (void) close(fd); return -1;
+    }
+    (void) close(fd);
+
+    file->ntext = (size_t) n;
+    file->patch = 1;
+
+    return 0;
+}
+
+/*
+ * write out and rename a pending minute file, releasing its slot, unless asked to keep it and the whole file is
+ * still in the text buffer, so more text can be added without reading the file back
+ */
+static int gts_publish(gts_t *gts, gts_file_t *file, int keep) {
+    char tmpfile[1024];
+    char outfile[1024];
+    int errsv = 0;
+    int patched;
+    double t;
+    int rv = 0;
+
+    if (file->minute == 0)
+        return 0;
+    if (!file->dirty) {
+        if (!keep)
+            gts_release(gts, file);
+        return 0;
+    }
+
+    patched = file->patch;
+    if ((keep) && (!file->spilled))
+        file->patch = 1;
+    else
+        keep = 0;
+
+    if ((rv = gts_spill(gts, file)) == 0) {
+        t = (gts->stats) ? stats_now() : 0.0;
+        if (close(file->fd) < 0) {
+            errsv = errno; ms_log(2, "failed to close output file: .%s - %s\n", file->name, strerror(errsv)); rv = -1;
+        }
+        else {
+            snprintf(tmpfile, sizeof(tmpfile), "%s/.%s", gts->dir, file->name);
+            snprintf(outfile, sizeof(outfile), "%s/%s", gts->dir, file->name);
+            if (rename(tmpfile, outfile) != 0) {
+                errsv = errno; ms_log(2, "failed to rename temporary file: %s - %s\n", outfile, strerror(errsv)); rv = -1;
+            }
+            else
+                gts_remember(gts, file);
+            if (gts->stats)
+                stats_add(&gts->stats->stages[STATS_RENAME], stats_now() - t);
+            if ((gts->stats) && (patched) && (rv == 0))
+                gts->stats->patched++;
+            if ((gts->stats) && (file->oldest > 0))
+                stats_add(&gts->stats->published, stats_wallclock() - (double) MS_HPTIME2EPOCH((double) file->oldest));
+        }
+        file->fd = -1;
+    }
+    else if (file->fd >= 0) {
+        (void) close(file->fd);
+        file->fd = -1;
+    }
+
+    if ((keep) && (rv == 0)) {
+        file->dirty = 0;
+        file->oldest = 0;
+        return 0;
+    }
+    gts_release(gts, file);
+
+    return rv;
+}
+
+gts_t *gts_new(char *dir, int nfiles, int deadline) {
+    gts_t *gts;
+    int n;
+
+    if ((gts = (gts_t *) malloc(sizeof(gts_t))) == NULL)
+        return NULL;
+    memset(gts, 0, sizeof(gts_t));
+
+    gts->dir = dir;
+    gts->deadline = deadline;
+    gts->started = MS_EPOCH2HPTIME(time(NULL));
+    gts->nfiles = (nfiles > 0) ? nfiles : GTS_FILES;
+    if ((gts->files = (gts_file_t *) malloc(gts->nfiles * sizeof(gts_file_t))) == NULL) {
+        free((char *) gts); return NULL;
+    }
+    memset(gts->files, 0, gts->nfiles * sizeof(gts_file_t));
+
+    /* kept at most half full, so chains stay short */
+    for (gts->nbuckets = 64; gts->nbuckets < 2 * gts->nfiles; gts->nbuckets *= 2);
+    if ((gts->buckets = (gts_file_t **) calloc(gts->nbuckets, sizeof(gts_file_t *))) == NULL) {
+        free((char *) gts->files); free((char *) gts); return NULL;
+    }
+    for (n = gts->nfiles - 1; n >= 0; n--) {
+        gts->files[n].fd = -1;
+        gts->files[n].chain = gts->unused;
+        gts->unused = &gts->files[n];
+    }
+
+    return gts;
+}
+
+/* publish anything outstanding and release the output */
+void gts_free(gts_t *gts) {
+    int n;
+
+    if (gts == NULL)
+        return;
+
+    (void) gts_flush(gts);
+    for (n = 0; n < gts->nfiles; n++)
+        free(gts->files[n].text);
+    free((char *) gts->files);
+    free((char *) gts->buckets);
+    free((char *) gts->published);
+    free((char *) gts);
+}
+
+/*
+ * add text to the minute file for the stream, publishing any earlier minutes, the end time is that of the newest sample
+ * behind the text, or zero if unknown, and the start time and sequence number are those of the CREX record it came in
+ */
+int gts_write(gts_t *gts, char *streamid, hptime_t starttime, hptime_t endtime, int sequence, char *text, size_t len) {
+    gts_file_t *file = NULL;
+    gts_file_t *fp, *next;
+    unsigned int hash = hash_string(streamid);
+    hptime_t minute;
+    char *buf;
+    int published;
+    int rv = 0;
+
+    minute = starttime - (starttime % MINUTE);
+    if (starttime % MINUTE < 0)
+        minute -= MINUTE;
+
+    /* only the pending minutes of streams sharing the bucket are looked at */
+    for (fp = *gts_bucket(gts, hash); fp != NULL; fp = next) {
+        next = fp->chain;
+        if ((fp->hash != hash) || (strcmp(fp->streamid, streamid) != 0))
+            continue;
+        if (fp->minute == minute)
+            file = fp;
+        else if ((fp->minute < minute) && (gts_publish(gts, fp, 0) < 0))
+            rv = -1;
+    }
+
+    /* a retransmitted record, or one already merged into the file */
+    if (gts_written(gts, hash, streamid, starttime, sequence))
+        return rv;
+
+    if (file == NULL) {
+        if ((file = gts_claim(gts, hash, streamid, minute, &rv)) == NULL)
+            return -1;
+        if ((published = gts_published(gts, file)) < 0)
+            published = gts->merge;
+        if ((published) && (gts_reopen(gts, file) < 0)) {
+            gts_release(gts, file); return -1;
+        }
+    }
+    else if (file != gts->mru) {
+        gts_detach(gts, file);
+        gts_attach(gts, file);
+    }
+    /* a kept minute starts its deadline again */
+    if (!file->dirty) {
+        file->opened = time(NULL);
+        file->dirty = 1;
+    }
+    file->hold = gts->hold;
+    file->deadline = gts->deadline;
+    if ((endtime > 0) && ((file->oldest == 0) || (starttime < file->oldest)))
+        file->oldest = starttime;
+
+    if ((!file->patch) && (file->ntext + len > GTS_SPILL)) {
+        if (gts_spill(gts, file) < 0)
+            return -1;
+        if (len > GTS_SPILL)
+            return (gts_writen(file->fd, text, len) < 0) ? -1 : rv;
+    }
+    if (file->ntext + len > file->size) {
+        if ((buf = (char *) realloc(file->text, file->ntext + len + 256)) == NULL) {
+            ms_log(1, "memory error!\n"); return -1;
+        }
+        file->text = buf; file->size = file->ntext + len + 256;
+    }
+    memcpy(file->text + file->ntext, text, len);
+    file->ntext += len;
+
+    if ((file->deadline == 0) && (!file->hold) && (gts_publish(gts, file, 1) < 0))
+        return -1;
+
+    return rv;
+}
+
+/* publish any minute files pending for longer than their deadline, whether or not the minute is complete */
+int gts_expire(gts_t *gts, time_t now) {
+    gts_file_t *file;
+    int rv = 0;
+    int n;
+
+    for (n = 0; n < gts->nfiles; n++) {
+        file = &gts->files[n];
+        if ((file->dirty) && (!file->hold) && (file->deadline >= 0) && (now - file->opened >= file->deadline)) {
+            if (gts_publish(gts, file, 1) < 0)
+                rv = -1;
+        }
+    }
+
+    return rv;
+}
+
+/* publish all pending minute files */
+int gts_flush(gts_t *gts) {
+    int rv = 0;
+    int n;
+
+    for (n = 0; n < gts->nfiles; n++) {
+        if (gts_publish(gts, &gts->files[n], 0) < 0)
+            rv = -1;
+    }
+
+    return rv;
+}
+
+/* move all buffered text into the hidden files, without publishing anything, patches are only ever written whole */
+int gts_sync(gts_t *gts) {
+    int rv = 0;
+    int n;
+
+    for (n = 0; n < gts->nfiles; n++) {
+        if ((gts->files[n].minute != 0) && (!gts->files[n].patch) && (gts->files[n].ntext > 0) && (gts_spill(gts, &gts->files[n]) < 0))
+            rv = -1;
+    }
+
+    return rv;
+}
+
+/* the length of the hidden file of a pending minute, once synced */
+off_t gts_length(gts_t *gts, gts_file_t *file) {
+    char tmpfile[1024];
+    struct stat st;
+
+    if (file->minute == 0)
+        return 0;
+    if (file->fd >= 0)
+        return lseek(file->fd, 0, SEEK_END);
+
+    /* resumed, but nothing added yet */
+    snprintf(tmpfile, sizeof(tmpfile), "%s/.%s", gts->dir, file->name);
+
+    return (stat(tmpfile, &st) == 0) ? st.st_size : 0;
+}
+
+/* pick up a minute file left pending by an earlier run, cutting it back to the given length */
+int gts_resume(gts_t *gts, char *streamid, hptime_t minute, off_t length) {
+    gts_file_t *file;
+    char tmpfile[1024];
+    int errsv = 0;
+    int rv = 0;
+
+    if ((file = gts_claim(gts, hash_string(streamid), streamid, minute, &rv)) == NULL)
+        return -1;
+    file->dirty = 1;
+    file->spilled = 1;
+
+    /* a minute published since is left where it is, any more text for it is merged in as late text */
+    snprintf(tmpfile, sizeof(tmpfile), "%s/.%s", gts->dir, file->name);
+    if (access(tmpfile, F_OK) != 0) {
+        gts_release(gts, file); return rv;
+    }
+    if (truncate(tmpfile, length) < 0) {
+        errsv = errno; ms_log(2, "failed to truncate output file: %s - %s\n", tmpfile, strerror(errsv)); gts_release(gts, file); return -1;
+    }
+
+    return rv;
+}
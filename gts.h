@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef _GTS_H
+#define _GTS_H
+
+#include <time.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <libmseed.h>
+
+#include "stats.h"
+
+/*
+ * gts: buffered output of CREX text into GTS minute files
+ *
+ * Text for each stream and minute is gathered in a pending slot and written to the hidden
+ * ".<stream>.<YYYYMMDDHHMM>.txt" file only when the minute is published, which happens once
+ * a later minute arrives for the same stream, the deadline passes, or the slot is evicted as
+ * the least recently used. The final rename means consumers never see a partial file. The
+pending slots of a stream are found through a hash of its id, and kept in least recently used
+order, so neither writing nor eviction looks at every slot.
+ *
+ * A minute published at its deadline keeps its slot with the whole file held in the text buffer,
+ * so more text for it is added and the file replaced at the next deadline without reading it back.
+ * Late text for a minute whose slot has gone starts from a copy of the published file. Recently
+ * published minutes are remembered for each stream, so the file is only looked for when merging
+ * and the index cannot tell, for minutes before the run started or too old to be remembered.
+ * Without merging, as when regenerating files, those are written afresh and replace any file.
+ *
+ * Each piece of text is keyed by the start time and sequence number of the CREX record it came
+ * in, and the recent keys of each stream are remembered, so a retransmitted record, or any one
+ * record of a message split over several, is only written once. Text merged into a file published
+ * before a restart has no keys to check against.
+ */
+
+#define GTS_FILES 1024 /* default number of pending minute files */
+#define GTS_SPILL 65536 /* buffered text before writing through an open descriptor */
+#define GTS_NAMELEN 128
+#define GTS_HISTORY 64 /* published minutes remembered before the newest of each stream */
+#define GTS_KEYS 64 /* record keys remembered for each stream */
+
+typedef struct gts_file_s {
+    unsigned int hash; /* cached stream hash */
+    char streamid[64];
+    char name[GTS_NAMELEN]; /* published file name */
+    hptime_t minute; /* start of the minute, zero when unused */
+    time_t opened; /* wall clock of the first buffered text */
+    hptime_t oldest; /* oldest sample behind the buffered text, zero unless the sample times are known */
+
+    int fd; /* hidden temporary file, once spilled */
+    char *text;
+    size_t ntext;
+    size_t size;
+
+    int patch; /* merging late text into the published file, which is held in the text buffer */
+    int hold; /* only published once a later minute arrives, or the slot is needed */
+    int deadline; /* seconds after the first buffered text before publishing, or -1 */
+    int dirty; /* text added since the slot was claimed or last published */
+    int spilled; /* some of the text is only in the hidden file */
+
+    struct gts_file_s *chain; /* next slot in the same hash bucket, or on the unused list */
+    struct gts_file_s *older; /* least recently used order */
+    struct gts_file_s *newer;
+} gts_file_t;
+
+/* the key of a piece of text, from the CREX record it came in */
+typedef struct gts_key_s {
+    hptime_t starttime;
+    int sequence;
+} gts_key_t;
+
+/* the minutes published and the records written for a stream */
+typedef struct gts_published_s {
+    unsigned int hash;
+    char streamid[64]; /* empty when unused */
+    hptime_t newest; /* newest minute published, zero if none yet */
+    uint64_t mask; /* bit n set when the minute n + 1 before the newest has been published */
+    gts_key_t keys[GTS_KEYS]; /* as a ring */
+    int nkeys;
+    int nextkey;
+} gts_published_t;
+
+typedef struct gts_s {
+    char *dir; /* output directory */
+    int deadline; /* given to the slots written to, seconds before a pending minute is published, or -1 */
+    int hold; /* given to the slots written to, while set they ignore the deadline */
+    int merge; /* text for a minute published before the run, or no longer remembered, is merged into its file rather than replacing it */
+    hptime_t started; /* files for minutes from here on can only have been published by this run */
+
+    int nfiles;
+    gts_file_t *files;
+    int nbuckets; /* a power of two, the pending slots of a stream share a bucket */
+    gts_file_t **buckets;
+    gts_file_t *unused;
+    gts_file_t *lru; /* least recently used pending slot */
+    gts_file_t *mru;
+
+    int npublished;
+    int maxpublished; /* a power of two, for open addressing */
+    gts_published_t *published;
+
+    stats_t *stats; /* optional open, write and rename timing, and sample to file latency */
+} gts_t;
+
+extern gts_t *gts_new(char *dir, int nfiles, int deadline);
+extern void gts_free(gts_t *gts);
+
+extern int gts_write(gts_t *gts, char *streamid, hptime_t starttime, hptime_t endtime, int sequence, char *text, size_t len);
+extern int gts_expire(gts_t *gts, time_t now);
+extern int gts_flush(gts_t *gts);
+
+extern int gts_sync(gts_t *gts);
+extern off_t gts_length(gts_t *gts, gts_file_t *file);
+extern int gts_resume(gts_t *gts, char *streamid, hptime_t minute, off_t length);
+
+#endif /* _GTS_H */
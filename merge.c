@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+/* system includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "merge.h"
+
+/* earlier start times first, then the input order so equal records keep their command line order */
+static int merge_before(merge_input_t *a, merge_input_t *b) {
+    if (a->starttime != b->starttime)
+        return (a->starttime < b->starttime);
+    return (a->order < b->order);
+}
+
+static void merge_up(merge_t *merge, int n) {
+    merge_input_t *input = merge->heap[n];
+    int parent;
+
+    for (; n > 0; n = parent) {
+        parent = (n - 1) / 2;
+        if (!merge_before(input, merge->heap[parent]))
+            break;
+        merge->heap[n] = merge->heap[parent];
+    }
+    merge->heap[n] = input;
+}
+
+static void merge_down(merge_t *merge, int n) {
+    merge_input_t *input = merge->heap[n];
+    int child;
+
+    for (; (child = 2 * n + 1) < merge->nheap; n = child) {
+        if ((child + 1 < merge->nheap) && merge_before(merge->heap[child + 1], merge->heap[child]))
+            child++;
+        if (!merge_before(merge->heap[child], input))
+            break;
+        merge->heap[n] = merge->heap[child];
+    }
+    merge->heap[n] = input;
+}
+
+/* read the next usable record header of an input, returning zero once it is finished */
+static int merge_advance(merge_t *merge, merge_input_t *input) {
+    int rc;
+
+    while ((rc = reader_next(&input->reader, &input->record, &input->reclen)) == MS_NOERROR) {
+        if (msr_unpack (input->record, input->reclen, &merge->msr, 0, 0) != MS_NOERROR)
+            continue;
+        input->starttime = merge->msr->starttime;
+        return 1;
+    }
+    if (rc != MS_ENDOFFILE)
+        ms_log (2, "error reading %s: %s\n", input->reader.file, ms_errorstr(rc));
+    reader_close(&input->reader);
+
+    return 0;
+}
+
+/* open every input, with reader_open unless given another way, and read its first record */
+int merge_open(merge_t *merge, int nfiles, char **files, int (*open)(reader_t *reader, char *file)) {
+    merge_input_t *input;
+    int n;
+
+    memset(merge, 0, sizeof(merge_t));
+    if (((merge->inputs = (merge_input_t *) calloc(nfiles + 1, sizeof(merge_input_t))) == NULL) ||
+        ((merge->heap = (merge_input_t **) calloc(nfiles + 1, sizeof(merge_input_t *))) == NULL)) {
+        free((char *) merge->inputs); merge->inputs = NULL; return -1;
+    }
+    merge->ninputs = nfiles;
+
+    for (n = 0; n < nfiles; n++) {
+        input = &merge->inputs[n];
+        input->order = n;
+        if (((open != NULL) ? open(&input->reader, files[n]) : reader_open(&input->reader, files[n])) < 0)
+            continue;
+        if (merge_advance(merge, input)) {
+            merge->heap[merge->nheap] = input;
+            merge_up(merge, merge->nheap++);
+        }
+    }
+
+    return 0;
+}
+
+/* return the earliest waiting record of any input, or MS_ENDOFFILE once they are all finished */
+int merge_next(merge_t *merge, char **record, int *reclen, char **file) {
+    merge_input_t *input;
+
+    /* the last record has been handled, so its input can move on */
+    if ((input = merge->current) != NULL) {
+        merge->current = NULL;
+        if (merge_advance(merge, input))
+            merge_down(merge, 0);
+        else if (--merge->nheap > 0) {
+            merge->heap[0] = merge->heap[merge->nheap];
+            merge_down(merge, 0);
+        }
+    }
+    if (merge->nheap == 0)
+        return MS_ENDOFFILE;
+
+    input = merge->current = merge->heap[0];
+    *record = input->record;
+    *reclen = input->reclen;
+    if (file != NULL)
+        *file = input->reader.file;
+
+    return MS_NOERROR;
+}
+
+void merge_close(merge_t *merge) {
+    int n;
+
+    for (n = 0; n < merge->nheap; n++)
+        reader_close(&merge->heap[n]->reader);
+    msr_free(&merge->msr);
+    free((char *) merge->inputs);
+    free((char *) merge->heap);
+
+    memset(merge, 0, sizeof(merge_t));
+}
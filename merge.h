@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+#ifndef _MERGE_H
+#define _MERGE_H
+
+#include <libmseed.h>
+
+#include "reader.h"
+
+/*
+ * merge: k-way merge of the records of several inputs by start time
+ *
+ * Every input is open at once, each with only its next record header held in a heap,
+ * so memory depends on the number of inputs rather than their size. Inputs are assumed
+ * to be mostly in time order; anything still out of order after merging is left for the
+ * caller to drop or trim against what each stream has already seen.
+ */
+
+typedef struct merge_input_s {
+    reader_t reader;
+    int order; /* position in the input list, to break ties */
+    char *record; /* the waiting record, valid until the input is advanced */
+    int reclen;
+    hptime_t starttime;
+} merge_input_t;
+
+typedef struct merge_s {
+    int ninputs;
+    merge_input_t *inputs;
+    int nheap;
+    merge_input_t **heap; /* inputs with a waiting record, earliest first */
+    merge_input_t *current; /* input of the last record returned, advanced on the next call */
+    MSRecord *msr; /* header only */
+} merge_t;
+
+extern int merge_open(merge_t *merge, int nfiles, char **files, int (*open)(reader_t *reader, char *file));
+extern int merge_next(merge_t *merge, char **record, int *reclen, char **file);
+extern void merge_close(merge_t *merge);
+
+#endif /* _MERGE_H */
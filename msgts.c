@@ -35,12 +35,27 @@
 #include <errno.h>
 #include <time.h>
 #include <math.h>
+#include <pthread.h>
+#include <fnmatch.h>
+#include <signal.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 /* libmseed library includes */
 #include <libmseed.h>
 #include <libtidal.h>
 #include <libcrex.h>
 
+#include "registry.h"
+#include "gts.h"
+#include "crexout.h"
+#include "reader.h"
+#include "merge.h"
+#include "msindex.h"
+#include "watch.h"
+#include "steim.h"
+
 #define PROGRAM "msdetide" /* program name */
 
 #ifndef FIRFILTERS
@@ -59,7 +74,7 @@
 /* program variables */
 static char *program_name = PROGRAM;
 static char *program_version = PROGRAM " (" PACKAGE_VERSION ") (c) GNS 2012 (m.chadwick@gns.cri.nz)";
-static char *program_usage = PROGRAM " [-hv][-G <dir>][-A <alpha>][-B <beta>][-O <orient>][-L <latitude>][-Z <zone>][-T <label/amp/lag> ...][<files> ... ]";
+static char *program_usage = PROGRAM " [-hv][-G <dir>][-C <files>][-j <workers>][-g][-b <start>][-E <end>][-i <patterns>][-e <patterns>][-X][-w <dir> ...][-R <file>][-D <secs>][-k <records>][-A <alpha>][-B <beta>][-O <orient>][-L <latitude>][-Z <zone>][-T <label/amp/lag> ...][<files> ... ]";
 static char *program_prefix = "[" PROGRAM "] ";
 
 static int verbose = 0; /* program verbosity */
@@ -71,9 +86,87 @@ static double beta = 10.0;
 static double zone = 0.0;
 static double latitude = 0.0;
 static char *gts = ".";
+static int gtsfiles = GTS_FILES; /* pending gts minute files */
 
 static char *firfile = FIRFILTERS;
 
+static crex_tidal_t tidal;
+
+/* parallel processing, streams are owned by a single worker to keep them in time order */
+static int nworkers = 1;
+
+/* merge the files by start time, dropping or trimming whatever each stream has already covered */
+static int mergefiles = 0;
+
+/* contiguous records of a stream processed together, so the filters and tidal model run over whole blocks */
+static int batching = 1;
+
+/* only records overlapping a time window, of streams matching any include and no exclude patterns, optionally found via sidecar indexes */
+#define MATCH_PATTERNS 64
+static hptime_t windowstart = 0;
+static hptime_t windowend = 0;
+static int ninclude = 0;
+static char *include[MATCH_PATTERNS];
+static int nexclude = 0;
+static char *exclude[MATCH_PATTERNS];
+static int indexing = 0;
+
+#define WATCH_SAVE 60 /* seconds between saving resume offsets */
+static int nwatchdirs = 0;
+static char *watchdirs[WATCH_DIRS];
+static char *resumefile = NULL;
+static int deadline = 60; /* seconds before a pending minute file is published, when watching */
+static volatile sig_atomic_t running = 1;
+
+typedef struct worker_s {
+    int id;
+    pthread_t thread;
+    gts_t *output;
+    crex_tidal_t tidal;
+    crexout_t crexout; /* process_crex output, as text */
+    steim_t steim; /* decoded samples */
+    crex_stream_t stream; /* the stream being worked on, unpacked from the registry */
+    MSRecord *batch; /* the header of the first record batched, from its own copy */
+    char *batchrecord;
+    int batchreclen;
+    int32_t *batchsamples; /* the samples of every record batched */
+    int batchsize;
+    int batchindex;
+    int nbatched; /* records batched */
+    unsigned long batches; /* process_crex calls covering more than one record */
+    unsigned long load; /* records owned */
+    unsigned long duplicates; /* merged records dropped as already processed */
+    unsigned long overlaps; /* merged records dropped as covered by those processed */
+    unsigned long trimmed; /* merged records with leading samples already covered */
+} worker_t;
+
+typedef struct stream_span_s {
+    int seen;
+    hptime_t start; /* of the last record processed */
+    hptime_t end; /* of the last sample processed */
+} stream_span_t;
+
+typedef struct stream_load_s {
+    int index;
+    unsigned long records;
+} stream_load_t;
+
+/* the wanted blocks of an input file, from its index */
+typedef struct input_s {
+    int nranges; /* -1 when the whole file is read */
+    reader_range_t *ranges;
+} input_t;
+
+/* fixed before any worker starts */
+static input_t *inputs = NULL; /* indexed as the files */
+static registry_t *streams = NULL;
+static int *owners = NULL;
+static char **files = NULL;
+static int nfiles = 0;
+static int nspans = 0;
+static stream_span_t *spans = NULL; /* indexed as the registry */
+static pthread_mutex_t allocating = PTHREAD_MUTEX_INITIALIZER; /* the registry state pool is shared by the workers */
+
 static void log_print(char *message) {
   if (verbose)
     fprintf(stderr, "%s", message);
@@ -83,41 +176,568 @@ static void err_print(char *message) {
   fprintf(stderr, "error: %s", message);
 }
 
-static void record_handler (char *record, int reclen, void *extra) {
-    static MSRecord *msr = NULL;
-    BTime btime;
-    int mon, mday;
-    hptime_t endtime;
-    char streamid[100];
-    char samples[512];
-    char tmpfile[1024];
-    char outfile[1024];
-    int errsv = 0;
-    FILE *fp = NULL;
-    int rv;
-
-    if ((rv = msr_unpack (record, reclen, &msr, 1, 0)) != MS_NOERROR) {
-        ms_log (2, "error unpacking mseed record: %s", ms_errorstr(rv)); return;
-    }
-    msr_srcname (msr, streamid, 0);
-    if (ms_hptime2btime (msr->starttime, &btime) < 0) {
-        ms_log (2, "error unpacking hptime"); return;
-    }
-    ms_doy2md(btime.year, btime.day, &mon, &mday);
-    if ((msr->sampletype == 'a') && (msr->numsamples > 0)) {
-        sprintf(outfile, "%s/%s.%04d%02d%02d%02d%02d.txt", gts, streamid, btime.year, mon, mday, btime.hour, btime.min);
-        sprintf(tmpfile, "%s/.%s.%04d%02d%02d%02d%02d.txt", gts, streamid, btime.year, mon, mday, btime.hour, btime.min);
-        if ((fp = fopen(tmpfile, "a")) == NULL) {
-            errsv = errno; ms_log(2, "failed to open output file: %s - %s\n", tmpfile, strerror(errsv)); return;
+static void text_handler (char *srcname, hptime_t starttime, int sequence, char *text, int len, void *extra) {
+    worker_t *worker = (worker_t *) extra;
+
+    (void) gts_write(worker->output, srcname, starttime, 0, sequence, text, len);
+}
+
+/* add a stream to the registry, returning its index, its state is only set up by its first record */
+static int new_stream(char *srcname) {
+    int index;
+
+    if ((index = registry_insert(streams, srcname)) < 0) {
+        ms_log(1, "memory error!\n"); exit(-1);
+    }
+
+    if (index >= nspans) {
+        if ((spans = (stream_span_t *) realloc(spans, 2 * (index + 1) * sizeof(stream_span_t))) == NULL) {
+            ms_log(1, "memory error!\n"); exit(-1);
+        }
+        memset(spans + nspans, 0, (2 * (index + 1) - nspans) * sizeof(stream_span_t));
+        nspans = 2 * (index + 1);
+    }
+
+    return index;
+}
+
+/* the configured crex settings of a stream */
+static void setup_stream(crex_stream_t *stream) {
+    int n;
+
+    /* Insert passed ctd values. */
+    strncpy(stream->ctd.id, tag, 24);
+
+    stream->alpha = alpha;
+    stream->beta = beta;
+
+    /* Insert default ctd values. */
+    stream->ctd.time = 0;
+    stream->ctd.temp = -1;
+    stream->ctd.autoQC = 11;
+    stream->ctd.manualQC = 7;
+    stream->ctd.offset = 0;
+    stream->ctd.increment = 1;
+
+    /* reset the CREX data arrays */
+    for (n = 0; n < CREX_BUF_SIZE; n++) {
+        stream->ctd.mes[n] = CREX_NO_DATA;
+        stream->ctd.res[n] = CREX_NO_DATA;
+    }
+}
+
+static int process_record(worker_t *worker, MSRecord *msr, int index) {
+    int psamples = 0;
+    int fresh, rc;
+
+    if ((fresh = registry_load(streams, index, &worker->stream)) < 0) {
+        ms_log(1, "corrupt stream state [%s]\n", registry_name(streams, index)); return -1;
+    }
+    if (fresh)
+        setup_stream(&worker->stream);
+
+    if (process_crex(msr, &worker->tidal, &worker->stream, crexout_handler, &worker->crexout, &psamples, -1.0, verbose) < 0) {
+        ms_log (1, "error processing mseed block\n"); return -1;
+    }
+
+    /* only the first save of a stream allocates */
+    if (fresh)
+        pthread_mutex_lock(&allocating);
+    rc = registry_save(streams, index, &worker->stream);
+    if (fresh)
+        pthread_mutex_unlock(&allocating);
+    if (rc < 0) {
+        ms_log(1, "memory error!\n"); return -1;
+    }
+
+    if (verbose)
+        ms_log(0, "packed: %d samples\n", psamples);
+
+    return 0;
+}
+
+/* process the batched records as one */
+static int flush_batch(worker_t *worker) {
+    int rc;
+
+    if (worker->nbatched == 0)
+        return 0;
+    if (worker->nbatched > 1)
+        worker->batches++;
+    worker->nbatched = 0;
+
+    worker->batch->datasamples = worker->batchsamples;
+    rc = process_record(worker, worker->batch, worker->batchindex);
+    worker->batch->datasamples = NULL;
+
+    return rc;
+}
+
+/* does a record carry on from the batched samples, to within half a sample */
+static int batch_follows(worker_t *worker, MSRecord *msr, int index) {
+    MSRecord *batch = worker->batch;
+    hptime_t expected;
+
+    if ((index != worker->batchindex) || (worker->nbatched >= batching) || (msr->samprate != batch->samprate) || (batch->samprate <= 0.0))
+        return 0;
+    expected = batch->starttime + (hptime_t) floor((double) batch->numsamples * (double) HPTMODULUS / batch->samprate + 0.5);
+
+    return (fabs((double) (msr->starttime - expected)) * batch->samprate <= 0.5 * (double) HPTMODULUS);
+}
+
+/* add a decoded record to the batch of its stream, processing the batch first if the record does not carry on from it */
+static int batch_record(worker_t *worker, char *record, int reclen, MSRecord *msr, int index) {
+    int32_t *samples;
+    char *copy;
+
+    if ((batching < 2) || (msr->sampletype != 'i') || (msr->numsamples <= 0)) {
+        if (flush_batch(worker) < 0)
+            return -1;
+        return process_record(worker, msr, index);
+    }
+    if ((worker->nbatched > 0) && (!batch_follows(worker, msr, index)) && (flush_batch(worker) < 0))
+        return -1;
+
+    /* the batch header comes from its own copy of the first record, as the input buffer moves on */
+    if (worker->nbatched == 0) {
+        if (reclen > worker->batchreclen) {
+            if ((copy = (char *) realloc(worker->batchrecord, reclen)) == NULL) {
+                ms_log(1, "memory error!\n"); return -1;
+            }
+            worker->batchrecord = copy;
+            worker->batchreclen = reclen;
+        }
+        memcpy(worker->batchrecord, record, reclen);
+        if (msr_unpack(worker->batchrecord, reclen, &worker->batch, 0, 0) != MS_NOERROR)
+            return process_record(worker, msr, index);
+        worker->batch->starttime = msr->starttime;
+        worker->batch->numsamples = 0;
+        worker->batch->sampletype = 'i';
+        worker->batchindex = index;
+    }
+
+    if (worker->batch->numsamples + msr->numsamples > worker->batchsize) {
+        if ((samples = (int32_t *) realloc(worker->batchsamples, (worker->batch->numsamples + msr->numsamples) * sizeof(int32_t))) == NULL) {
+            ms_log(1, "memory error!\n"); return -1;
+        }
+        worker->batchsamples = samples;
+        worker->batchsize = (int) (worker->batch->numsamples + msr->numsamples);
+    }
+    memcpy(worker->batchsamples + worker->batch->numsamples, msr->datasamples, msr->numsamples * sizeof(int32_t));
+    worker->batch->numsamples += msr->numsamples;
+    worker->batch->samplecnt = worker->batch->numsamples;
+    worker->nbatched++;
+
+    return 0;
+}
+
+/* is only part of the input wanted */
+static int selecting(void) {
+    return ((windowstart != 0) || (windowend != 0) || (ninclude > 0) || (nexclude > 0));
+}
+
+static int match_patterns(int npatterns, char **patterns, char *srcname) {
+    int n;
+
+    for (n = 0; n < npatterns; n++) {
+        if (fnmatch(patterns[n], srcname, 0) == 0)
+            return 1;
+    }
+
+    return 0;
+}
+
+/* does a record fall within the time window and match any include and no exclude patterns, from its header alone */
+static int select_record(MSRecord *msr) {
+    char srcname[100];
+
+    if (((windowstart != 0) && (msr_endtime(msr) < windowstart)) || ((windowend != 0) && (msr->starttime >= windowend)))
+        return 0;
+    if ((ninclude == 0) && (nexclude == 0))
+        return 1;
+    msr_srcname(msr, srcname, 0);
+    if ((ninclude > 0) && (!match_patterns(ninclude, include, srcname)))
+        return 0;
+
+    return !match_patterns(nexclude, exclude, srcname);
+}
+
+/* index every input file once, before any worker starts, so the scan and each worker share the same selection */
+static void index_files(void) {
+    msindex_t index;
+    int n;
+
+    if ((inputs = (input_t *) calloc(nfiles + 1, sizeof(input_t))) == NULL) {
+        ms_log(1, "memory error!\n"); exit(-1);
+    }
+    for (n = 0; n < nfiles; n++) {
+        inputs[n].nranges = -1;
+        if (msindex_load(&index, files[n], 1) < 0)
+            continue;
+        if ((inputs[n].nranges = msindex_select(&index, windowstart, windowend, ninclude, include, nexclude, exclude, &inputs[n].ranges)) < 0)
+            inputs[n].nranges = -1;
+        else if (verbose > 1)
+            ms_log (0, "%s: reading %d of %d blocks\n", files[n], inputs[n].nranges, index.nblocks);
+        msindex_free(&index);
+    }
+}
+
+/* open a file, reading only the blocks selected from its index when indexing */
+static int open_input(reader_t *reader, char *file) {
+    reader_range_t *ranges;
+    int n;
+
+    if (reader_open(reader, file) < 0)
+        return -1;
+    if ((inputs == NULL) || (reader->map == NULL))
+        return 0;
+
+    /* the reader frees the ranges it is given, and each file may be opened more than once */
+    for (n = 0; (n < nfiles) && (files[n] != file); n++);
+    if ((n == nfiles) || (inputs[n].nranges < 0))
+        return 0;
+    if ((ranges = (reader_range_t *) malloc((inputs[n].nranges + 1) * sizeof(reader_range_t))) == NULL)
+        return 0;
+    memcpy(ranges, inputs[n].ranges, inputs[n].nranges * sizeof(reader_range_t));
+    if (reader_limit(reader, ranges, inputs[n].nranges) < 0)
+        free((char *) ranges);
+
+    return 0;
+}
+
+/* drop a merged record already covered by its stream, or trim the samples it shares with what has been processed */
+static int overlap_record(worker_t *worker, MSRecord *msr, int index) {
+    stream_span_t *span = &spans[index];
+    hptime_t endtime = msr_endtime(msr);
+    int64_t skip;
+    int size;
+
+    if (span->seen) {
+        if ((msr->starttime == span->start) && (endtime == span->end)) {
+            worker->duplicates++; return 1;
         }
-        memset(samples, 0, sizeof(samples));
-        strncpy(samples, msr->datasamples, msr->numsamples);
-        fprintf(fp, "%s", samples);
-        fclose(fp);
-        if (rename(tmpfile, outfile) != 0) {
-            errsv = errno; ms_log(2, "failed to rename temporary file: %s - %s\n", outfile, strerror(errsv)); return;
+        if (endtime <= span->end) {
+            worker->overlaps++; return 1;
+        }
+
+        /* samples within half a sample period of the last one processed are taken as already covered */
+        if ((msr->samprate > 0.0) && (msr->numsamples > 0) && ((size = ms_samplesize(msr->sampletype)) > 0) &&
+            ((double) (span->end - msr->starttime) * msr->samprate > -0.5 * (double) HPTMODULUS)) {
+            skip = (int64_t) floor((double) (span->end - msr->starttime) * msr->samprate / (double) HPTMODULUS + 0.5) + 1;
+            if (skip >= msr->numsamples) {
+                worker->overlaps++; return 1;
+            }
+            memmove(msr->datasamples, (char *) msr->datasamples + skip * size, (size_t) (msr->numsamples - skip) * size);
+            msr->numsamples -= skip;
+            msr->samplecnt = msr->numsamples;
+            msr->starttime += (hptime_t) floor((double) skip * (double) HPTMODULUS / msr->samprate + 0.5);
+            worker->trimmed++;
         }
     }
+
+    span->seen = 1;
+    span->start = msr->starttime;
+    span->end = endtime;
+
+    return 0;
+}
+
+/* decode and process a raw record, creating streams when serial or skipping those of other workers, -1 to stop */
+static int handle_record(worker_t *worker, char *record, int reclen, MSRecord **ppmsr) {
+    char srcname[100];
+    int index;
+    int rc;
+
+    /* anything unwanted is skipped from the header, before decoding */
+    if ((owners != NULL) || (selecting())) {
+        steim_release(&worker->steim, *ppmsr);
+        if ((msr_unpack (record, reclen, ppmsr, 0, 0) != MS_NOERROR) || (!select_record(*ppmsr)))
+            return 0;
+        msr_srcname(*ppmsr, srcname, 0);
+        if ((owners != NULL) && (((index = registry_lookup(streams, srcname)) < 0) || (owners[index] != worker->id)))
+            return 0;
+    }
+    if ((rc = steim_unpack (&worker->steim, record, reclen, ppmsr, (verbose > 1) ? 1 : 0)) != MS_NOERROR) {
+        ms_log (2, "error unpacking mseed record: %s\n", ms_errorstr(rc)); return 0;
+    }
+    if (verbose > 1)
+        msr_print(*ppmsr, (verbose > 2) ? 1 : 0);
+    if (owners == NULL) {
+        msr_srcname(*ppmsr, srcname, 0);
+        if ((index = registry_lookup(streams, srcname)) < 0)
+            index = new_stream(srcname);
+    }
+
+    if ((mergefiles) && (overlap_record(worker, *ppmsr, index)))
+        return 0;
+
+    return batch_record(worker, record, reclen, *ppmsr, index);
+}
+
+static int cmp_load(const void *a, const void *b) {
+    const stream_load_t *la = (const stream_load_t *) a;
+    const stream_load_t *lb = (const stream_load_t *) b;
+
+    if (la->records != lb->records)
+        return (la->records < lb->records) ? 1 : -1;
+    return la->index - lb->index;
+}
+
+/* read the record headers of every file, creating the streams and sharing them between the workers by record count */
+static int scan_files(worker_t *workers) {
+    reader_t reader;
+    MSRecord *msr = NULL;
+    stream_load_t *loads = NULL;
+    char srcname[100];
+    char *record;
+    int reclen;
+    int index;
+    int n, w;
+    int rc;
+
+    for (n = 0; n < nfiles; n++) {
+        if (open_input(&reader, files[n]) < 0)
+            continue;
+        while ((rc = reader_next(&reader, &record, &reclen)) == MS_NOERROR) {
+            if ((msr_unpack (record, reclen, &msr, 0, 0) != MS_NOERROR) || (!select_record(msr)))
+                continue;
+            msr_srcname(msr, srcname, 0);
+            if ((index = registry_lookup(streams, srcname)) < 0) {
+                index = new_stream(srcname);
+                if ((loads = (stream_load_t *) realloc(loads, registry_count(streams) * sizeof(stream_load_t))) == NULL) {
+                    ms_log(1, "memory error!\n"); exit(-1);
+                }
+                loads[index].index = index;
+                loads[index].records = 0;
+            }
+            loads[index].records++;
+        }
+        if (rc != MS_ENDOFFILE)
+            ms_log (2, "error scanning %s: %s\n", files[n], ms_errorstr(rc));
+        reader_close(&reader);
+    }
+    msr_free(&msr);
+
+    if ((owners = (int *) malloc((registry_count(streams) + 1) * sizeof(int))) == NULL) {
+        ms_log(1, "memory error!\n"); exit(-1);
+    }
+
+    /* busiest streams first, each to the least loaded worker */
+    qsort(loads, registry_count(streams), sizeof(stream_load_t), cmp_load);
+    for (n = 0; n < registry_count(streams); n++) {
+        for (index = 0, w = 1; w < nworkers; w++) {
+            if (workers[w].load < workers[index].load)
+                index = w;
+        }
+        owners[loads[n].index] = index;
+        workers[index].load += loads[n].records;
+    }
+    free((char *) loads);
+
+    if (verbose) {
+        for (w = 0; w < nworkers; w++)
+            ms_log (0, "worker %d: %lu records\n", w, workers[w].load);
+    }
+
+    return registry_count(streams);
+}
+
+/* merge every file by start time, processing the records of the worker, or of every stream when serial */
+static void merge_records(worker_t *worker, MSRecord **ppmsr) {
+    merge_t merge;
+    char *record;
+    int reclen;
+
+    if (merge_open(&merge, nfiles, files, open_input) < 0) {
+        ms_log(1, "memory error!\n"); return;
+    }
+    while (merge_next(&merge, &record, &reclen, NULL) == MS_NOERROR) {
+        if (handle_record(worker, record, reclen, ppmsr) < 0)
+            break;
+    }
+    (void) flush_batch(worker);
+    merge_close(&merge);
+}
+
+/* stop watching on any INT/TERM signals */
+static void term_handler(int sig) {
+    running = 0;
+}
+
+/* skip hidden and temporary files, and any sidecar indexes */
+static int watched(const char *name) {
+    size_t len = strlen(name), slen = strlen(MSINDEX_SUFFIX);
+
+    if (name[0] == '.')
+        return 0;
+    if ((len > slen) && (strcmp(name + len - slen, MSINDEX_SUFFIX) == 0))
+        return 0;
+
+    return 1;
+}
+
+static int watched_entry(const struct dirent *entry) {
+    return watched(entry->d_name);
+}
+
+/* process the records appended to a file since it was last read, returning how many */
+static int follow_file(worker_t *worker, watch_t *watch, char *path, MSRecord **ppmsr) {
+    watch_file_t *file;
+    reader_t reader;
+    struct stat st;
+    char *record;
+    int reclen;
+    int count = 0;
+
+    if ((file = watch_file(watch, path)) == NULL) {
+        ms_log(1, "memory error!\n"); return 0;
+    }
+    if ((stat(path, &st) < 0) || (!S_ISREG(st.st_mode)) || ((size_t) st.st_size == file->offset))
+        return 0;
+
+    /* a file that has shrunk has been rewritten, so start again */
+    if ((size_t) st.st_size < file->offset)
+        file->offset = 0;
+
+    if (reader_open(&reader, path) < 0)
+        return 0;
+    if (reader_seek(&reader, file->offset) < 0) {
+        reader_close(&reader); return 0;
+    }
+    reader.follow = 1;
+    while (reader_next(&reader, &record, &reclen) == MS_NOERROR) {
+        count++;
+        if (handle_record(worker, record, reclen, ppmsr) < 0)
+            break;
+    }
+    /* nothing is held back while waiting for the file to grow */
+    (void) flush_batch(worker);
+    file->offset = reader.offset;
+    reader_close(&reader);
+
+    if (verbose > 1)
+        ms_log (0, "%s: %d records to offset %lld\n", path, count, (long long) file->offset);
+
+    return count;
+}
+
+/*
+ * read anything written to the watched directories while not watching them, in name order, returning whether any
+ * records were read; files unknown and unchanged for WATCH_IDLE are taken as already done, having been forgotten
+ */
+static int catch_up(worker_t *worker, watch_t *watch, int skipidle, MSRecord **ppmsr) {
+    struct dirent **entries;
+    char path[PATH_MAX];
+    struct stat st;
+    time_t now = time(NULL);
+    int dirty = 0;
+    int n, i, count;
+
+    for (n = 0; n < nwatchdirs; n++) {
+        if ((count = scandir(watchdirs[n], &entries, watched_entry, alphasort)) < 0) {
+            ms_log(2, "unable to scan directory: %s - %s\n", watchdirs[n], strerror(errno)); continue;
+        }
+        for (i = 0; i < count; i++) {
+            snprintf(path, sizeof(path), "%s/%s", watchdirs[n], entries[i]->d_name);
+            free(entries[i]);
+            if ((skipidle) && (watch_find(watch, path) == NULL) && (stat(path, &st) == 0) && (now - st.st_mtime >= WATCH_IDLE))
+                continue;
+            if ((running) && (follow_file(worker, watch, path, ppmsr) > 0))
+                dirty = 1;
+        }
+        free(entries);
+    }
+
+    return dirty;
+}
+
+/* follow the files of the watched directories until stopped, keeping every stream running between files */
+static int watch_files(worker_t *worker, MSRecord **ppmsr) {
+    char path[PATH_MAX];
+    char *name;
+    time_t now, saved;
+    watch_t watch;
+    int resumed = 0;
+    int dirty = 0;
+    int n;
+    int rc;
+
+    if (watch_open(&watch) < 0)
+        return -1;
+    if ((resumefile != NULL) && (access(resumefile, F_OK) == 0)) {
+        if (watch_load(&watch, resumefile) < 0) {
+            ms_log(1, "unable to load resume file [%s]\n", resumefile); watch_close(&watch); return -1;
+        }
+        resumed = 1;
+    }
+    for (n = 0; n < nwatchdirs; n++) {
+        if (watch_add(&watch, watchdirs[n]) < 0) {
+            watch_close(&watch); return -1;
+        }
+    }
+
+    /* catch up with anything written since last run before waiting for changes, only a first run reads every file */
+    dirty = catch_up(worker, &watch, resumed, ppmsr);
+
+    saved = time(NULL);
+    while (running) {
+        if ((rc = watch_next(&watch, 1000, path, sizeof(path))) < 0) {
+            ms_log(1, "unable to watch directories: %s\n", strerror(errno)); break;
+        }
+        if (rc == WATCH_RESCAN) {
+            ms_log(1, "watch events lost, rescanning directories\n");
+            if (catch_up(worker, &watch, 1, ppmsr))
+                dirty = 1;
+        }
+        else if (rc > 0) {
+            name = ((name = strrchr(path, '/')) != NULL) ? name + 1 : path;
+            if ((watched(name)) && (follow_file(worker, &watch, path, ppmsr) > 0))
+                dirty = 1;
+        }
+
+        now = time(NULL);
+        (void) gts_expire(worker->output, now);
+        if (now - saved >= WATCH_SAVE) {
+            if (watch_expire(&watch, now) > 0)
+                dirty = 1;
+            if ((resumefile != NULL) && (dirty) && (watch_save(&watch, resumefile) == 0))
+                dirty = 0;
+            saved = now;
+        }
+    }
+
+    if ((resumefile != NULL) && (dirty))
+        (void) watch_save(&watch, resumefile);
+    watch_close(&watch);
+
+    return 0;
+}
+
+/* read every file, decoding and processing only the records of owned streams */
+static void *worker_thread(void *arg) {
+    worker_t *worker = (worker_t *) arg;
+    reader_t reader;
+    MSRecord *msr = NULL;
+    char *record;
+    int reclen;
+    int n;
+
+    if (mergefiles)
+        merge_records(worker, &msr);
+    else for (n = 0; n < nfiles; n++) {
+        if (open_input(&reader, files[n]) < 0)
+            continue;
+        while (reader_next(&reader, &record, &reclen) == MS_NOERROR) {
+            if (handle_record(worker, record, reclen, &msr) < 0)
+                break;
+        }
+        reader_close(&reader);
+    }
+    (void) flush_batch(worker);
+    steim_release(&worker->steim, msr);
+    msr_free(&msr);
+
+    return NULL;
 }
 
 int main(int argc, char **argv) {
@@ -125,18 +745,16 @@ int main(int argc, char **argv) {
 
   MSRecord *msr = NULL;
 
-    char srcname[100];
-    crex_tidal_t tidal;
+    reader_t reader;
+    char *record;
+    int reclen;
 
-    crex_stream_t *sp = NULL;
-    crex_stream_t *stream = NULL;
-    crex_stream_t *streams = NULL;
+    worker_t *workers = NULL;
+    char *arg;
 
     int nfirs = 0;
     char *firnames[FIR_MAX_FILTERS];
 
-    int psamples = 0;
-
   int rc;
   int option_index = 0;
   struct option long_options[] = {
@@ -152,15 +770,25 @@ int main(int argc, char **argv) {
     {"zone", 1, 0, 'Z'},
     {"tide", 1, 0, 'T'},
     {"gts", 1, 0, 'G'},
+    {"cache", 1, 0, 'C'},
+    {"workers", 1, 0, 'j'},
+    {"merge", 0, 0, 'g'},
+    {"start", 1, 0, 'b'},
+    {"end", 1, 0, 'E'},
+    {"include", 1, 0, 'i'},
+    {"exclude", 1, 0, 'e'},
+    {"index", 0, 0, 'X'},
+    {"watch", 1, 0, 'w'},
+    {"resume", 1, 0, 'R'},
+    {"deadline", 1, 0, 'D'},
+    {"batch", 1, 0, 'k'},
     {0, 0, 0, 0}
   };
 
   /* adjust output logging ... -> syslog maybe? */
   ms_loginit (log_print, program_prefix, err_print, program_prefix);
 
-    memset(&tidal, 0, sizeof(crex_tidal_t));
-
-  while ((rc = getopt_long(argc, argv, "hvN:F:I:G:A:B:T:L:Z:", long_options, &option_index)) != EOF) {
+  while ((rc = getopt_long(argc, argv, "hvN:F:I:G:C:j:gb:E:i:e:Xw:R:D:k:A:B:T:L:Z:", long_options, &option_index)) != EOF) {
     switch(rc) {
     case '?':
       (void) fprintf(stderr, "usage: %s\n", program_usage);
@@ -176,6 +804,18 @@ int main(int argc, char **argv) {
             (void) fprintf(stderr, "\t-F --filter\tadd a decimation firfilter\n");
       (void) fprintf(stderr, "\t-I --tag\tprovide CREX ID tag [%s]\n", tag);
       (void) fprintf(stderr, "\t-G --gts\tprovide a directory for GTS minute files [%s]\n", gts);
+      (void) fprintf(stderr, "\t-C --cache\tnumber of pending gts minute files [%d]\n", gtsfiles);
+      (void) fprintf(stderr, "\t-j --workers\tprocess the streams of the given files using parallel threads [%d]\n", nworkers);
+      (void) fprintf(stderr, "\t-g --merge\tmerge the given files by record start time, dropping duplicates and overlaps\n");
+      (void) fprintf(stderr, "\t-b --start\tonly process records ending at or after this time [<all>]\n");
+      (void) fprintf(stderr, "\t-E --end\tonly process records starting before this time [<all>]\n");
+      (void) fprintf(stderr, "\t-i --include\tonly process streams matching these srcname patterns [<all>]\n");
+      (void) fprintf(stderr, "\t-e --exclude\tnever process streams matching these srcname patterns [<none>]\n");
+      (void) fprintf(stderr, "\t-X --index\tfind the selected records via %s sidecar indexes, built or extended once before reading, or held in memory if they cannot be saved\n", MSINDEX_SUFFIX);
+      (void) fprintf(stderr, "\t-w --watch\tfollow the files of this directory, processing only appended records\n");
+      (void) fprintf(stderr, "\t-R --resume\tkeep the offsets of watched files in this file [<none>]\n");
+      (void) fprintf(stderr, "\t-D --deadline\tseconds before publishing a pending gts minute file, when watching [%d]\n", deadline);
+      (void) fprintf(stderr, "\t-k --batch\tprocess up to this many contiguous records of a stream in one pass [%d]\n", batching);
       (void) fprintf(stderr, "\t-A --alpha\tadd offset to calculated tidal heights [%g]\n", alpha);
       (void) fprintf(stderr, "\t-B --beta\tscale calculated tidal heights [%g]\n", beta);
       (void) fprintf(stderr, "\t-L --latitude\tprovide reference latitude [%g]\n", latitude);
@@ -191,6 +831,59 @@ int main(int argc, char **argv) {
     case 'G':
       gts = optarg;
       break;
+    case 'C':
+      gtsfiles = atoi(optarg);
+      break;
+    case 'j':
+      nworkers = (atoi(optarg) > 0) ? atoi(optarg) : 1;
+      break;
+    case 'g':
+      mergefiles = 1;
+      break;
+    case 'b':
+      if ((windowstart = ms_timestr2hptime(optarg)) == HPTERROR) {
+        ms_log(1, "invalid start time [%s]\n", optarg); exit(-1);
+      }
+      break;
+    case 'E':
+      if ((windowend = ms_timestr2hptime(optarg)) == HPTERROR) {
+        ms_log(1, "invalid end time [%s]\n", optarg); exit(-1);
+      }
+      break;
+    case 'i':
+      for (arg = strtok(strdup(optarg), ","); arg != NULL; arg = strtok(NULL, ",")) {
+        if (ninclude >= MATCH_PATTERNS) {
+          ms_log(1, "too many stream patterns [%s]\n", optarg); exit(-1);
+        }
+        include[ninclude++] = arg;
+      }
+      break;
+    case 'e':
+      for (arg = strtok(strdup(optarg), ","); arg != NULL; arg = strtok(NULL, ",")) {
+        if (nexclude >= MATCH_PATTERNS) {
+          ms_log(1, "too many stream patterns [%s]\n", optarg); exit(-1);
+        }
+        exclude[nexclude++] = arg;
+      }
+      break;
+    case 'X':
+      indexing = 1;
+      break;
+    case 'w':
+      if (nwatchdirs >= WATCH_DIRS) {
+        ms_log(1, "too many watched directories [%s]\n", optarg); exit(-1);
+      }
+      watchdirs[nwatchdirs++] = optarg;
+      break;
+    case 'R':
+      resumefile = optarg;
+      break;
+    case 'D':
+      deadline = atoi(optarg);
+      break;
+    case 'k':
+      batching = (atoi(optarg) > 0) ? atoi(optarg) : 1;
+      break;
     case 'A':
       alpha = atof(optarg);
       break;
@@ -233,70 +926,115 @@ int main(int argc, char **argv) {
         ms_log(1, "could not load fir filter file [%s]\n", firfile); exit(-1);
     }
 
-    do {
-        if (verbose)
-      ms_log (0, "process miniseed data from %s\n", (optind < argc) ? argv[optind] : "<stdin>");
+    /* per stream processing state */
+    if ((streams = registry_new(0)) == NULL) {
+        ms_log(1, "memory error!\n"); exit(-1);
+    }
 
-    while ((rc = ms_readmsr (&msr, (optind < argc) ? argv[optind] : "-", 0, NULL, NULL, 1, 1, (verbose > 1) ? 1 : 0)) == MS_NOERROR) {
-      if (verbose > 1)
-        msr_print(msr, (verbose > 2) ? 1 : 0);
-            msr_srcname(msr, srcname, 0);
-            for (stream = streams; stream != NULL; stream = stream->next) {
-                if (strcmp(stream->srcname, srcname) == 0)
-                    break;
-            }
-            if (stream == NULL) {
-                if ((stream = (crex_stream_t *) malloc(sizeof(crex_stream_t))) == NULL) {
-                    ms_log(1, "memory error!\n"); exit(-1);
-                }
-                memset(stream, 0, sizeof(crex_stream_t));
-                strcpy(stream->srcname, srcname);
-
-                /* Insert passed ctd values. */
-                strncpy(stream->ctd.id, tag, 24);
-
-                stream->alpha = alpha;
-                stream->beta = beta;
-
-                /* Insert default ctd values. */
-                stream->ctd.time = 0;
-                stream->ctd.temp = -1;
-                stream->ctd.autoQC = 11;
-                stream->ctd.manualQC = 7;
-                stream->ctd.offset = 0;
-                stream->ctd.increment = 1;
-
-                /* reset the CREX data arrays */
-                for (n = 0; n < CREX_BUF_SIZE; n++) {
-                    stream->ctd.mes[n] = CREX_NO_DATA;
-                    stream->ctd.res[n] = CREX_NO_DATA;
-                }
+    /* each worker has its own minute files, which are only published once complete unless watching for more data */
+    if ((workers = (worker_t *) calloc(nworkers, sizeof(worker_t))) == NULL) {
+        ms_log(1, "memory error!\n"); exit(-1);
+    }
+    for (n = 0; n < nworkers; n++) {
+        workers[n].id = n;
+        workers[n].tidal = tidal;
+        workers[n].crexout.text_handler = text_handler;
+        workers[n].crexout.extra = &workers[n];
+        if ((workers[n].output = gts_new(gts, gtsfiles, (nwatchdirs > 0) ? deadline : -1)) == NULL) {
+            ms_log(1, "memory error!\n"); exit(-1);
+        }
+    }
 
-                if (streams != NULL) {
-                    stream->next = streams;
-                }
-                streams = stream;
-            }
+    /* any indexes are built, or brought up to date, once and before any reading */
+    if ((nwatchdirs == 0) && (optind < argc)) {
+        files = &argv[optind];
+        nfiles = argc - optind;
+        if ((indexing) && (selecting()))
+            index_files();
+    }
 
-      if (process_crex(msr, &tidal, stream, record_handler, NULL, &psamples, -1.0, verbose) < 0) {
-            ms_log (1, "error processing mseed block\n"); break;
-      }
+    /* watched files are followed serially, so every stream stays warm from one file to the next */
+    if (nwatchdirs > 0) {
+        struct sigaction sa;
 
-            if (verbose)
-                ms_log(0, "packed: %d samples\n", psamples);
+        if (optind < argc) {
+            ms_log(1, "files cannot be given when watching directories\n"); exit(-1);
+        }
+
+        sa.sa_handler = term_handler;
+        sa.sa_flags = 0;
+        sigemptyset (&sa.sa_mask);
+        sigaction (SIGINT, &sa, NULL);
+        sigaction (SIGTERM, &sa, NULL);
+
+        if (verbose)
+            ms_log (0, "watching %d directories\n", nwatchdirs);
+        if (watch_files(&workers[0], &msr) < 0)
+            exit(-1);
+    }
+    /* files can be read by more than one worker, but stdin is read serially */
+    else if ((nworkers > 1) && (optind < argc)) {
+        if (verbose)
+            ms_log (0, "scanning %d files\n", nfiles);
+        (void) scan_files(workers);
+
+        for (n = 0; n < nworkers; n++) {
+            if (pthread_create(&workers[n].thread, NULL, worker_thread, &workers[n]) != 0) {
+                ms_log(1, "unable to start worker [%d]\n", n); exit(-1);
+            }
+        }
+        for (n = 0; n < nworkers; n++)
+            pthread_join(workers[n].thread, NULL);
+    }
+    else if ((mergefiles) && (optind < argc)) {
+        if (verbose)
+            ms_log (0, "merging %d files\n", nfiles);
+        merge_records(&workers[0], &msr);
+    }
+    else do {
+        if (verbose)
+      ms_log (0, "process miniseed data from %s\n", (optind < argc) ? argv[optind] : "<stdin>");
+
+    if (open_input(&reader, (optind < argc) ? argv[optind] : "-") < 0)
+        continue;
+    while ((rc = reader_next(&reader, &record, &reclen)) == MS_NOERROR) {
+            if (handle_record(&workers[0], record, reclen, &msr) < 0)
+                break;
     }
     if (rc != MS_ENDOFFILE )
-        ms_log (2, "error reading stdin: %s\n", ms_errorstr(rc));
+        ms_log (2, "error reading %s: %s\n", (optind < argc) ? argv[optind] : "<stdin>", ms_errorstr(rc));
 
     /* Cleanup memory and close file */
-    ms_readmsr (&msr, NULL, 0, NULL, NULL, 0, 0, (verbose > 1) ? 1 : 0);
+    reader_close(&reader);
     } while((++optind) < argc);
+    (void) flush_batch(&workers[0]);
+    steim_release(&workers[0].steim, msr);
+    msr_free(&msr);
+
+    if ((verbose) && (batching > 1)) {
+        for (n = 0; n < nworkers; n++)
+            ms_log (0, "worker %d: %lu batches of up to %d records\n", n, workers[n].batches, batching);
+    }
+    if ((verbose) && (mergefiles)) {
+        for (n = 0; n < nworkers; n++)
+            ms_log (0, "worker %d: dropped %lu duplicate and %lu overlapping records, trimmed %lu\n", n,
+                workers[n].duplicates, workers[n].overlaps, workers[n].trimmed);
+    }
 
-    stream = streams;
-    while (stream != NULL) {
-        sp = stream; stream = stream->next;
-        free((char *) sp);
+    for (n = 0; n < nworkers; n++) {
+        gts_free(workers[n].output);
+        steim_free(&workers[n].steim);
+        msr_free(&workers[n].batch);
+        free(workers[n].batchrecord);
+        free((char *) workers[n].batchsamples);
     }
+    free((char *) workers);
+    for (n = 0; (inputs != NULL) && (n < nfiles); n++)
+        free((char *) inputs[n].ranges);
+    free((char *) inputs);
+    free((char *) owners);
+    free((char *) spans);
+    registry_free(streams);
 
   /* closing down */
   if (verbose)
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/* system includes */
+#include <stdio.h>
+#include <string.h>
+
+#include "mshdr.h"
+
+unsigned int mshdr_u16(unsigned char *p, int swap) {
+    return (swap) ? (unsigned int) (p[0] | (p[1] << 8)) : (unsigned int) ((p[0] << 8) | p[1]);
+}
+
+int32_t mshdr_i32(unsigned char *p, int swap) {
+    return (swap) ? (int32_t) ((uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24)) :
+        (int32_t) (((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | (uint32_t) p[3]);
+}
+
+/* copy a blank padded header code, dropping every space and stopping at any nul, as ms_strncpclean does */
+static char *mshdr_code(char *dst, unsigned char *src, int len) {
+    int n;
+
+    for (n = 0; (n < len) && (src[n] != '\0'); n++) {
+        if (src[n] != ' ')
+            *dst++ = (char) src[n];
+    }
+
+    return dst;
+}
+
+/* pick out the header fields of a raw record, returns -1 if it is too short to hold a header */
+int mshdr_read(mshdr_t *hdr, char *record, int reclen) {
+    unsigned char *rec = (unsigned char *) record;
+    unsigned char *b;
+    unsigned int offset, next, type;
+    unsigned int year, day;
+    int n;
+
+    memset(hdr, 0, sizeof(mshdr_t));
+    hdr->record = record;
+    hdr->reclen = reclen;
+    hdr->encoding = -1;
+
+    if (reclen < MSHDR_SIZE)
+        return -1;
+
+    for (n = 0; n < 6; n++) {
+        if ((rec[n] < '0') || (rec[n] > '9')) {
+            hdr->sequence = 0; break;
+        }
+        hdr->sequence = 10 * hdr->sequence + (rec[n] - '0');
+    }
+
+    year = mshdr_u16(rec + 20, 0);
+    day = mshdr_u16(rec + 22, 0);
+    hdr->swap = ((year < 1900) || (year > 2100) || (day < 1) || (day > 366));
+
+    hdr->btime.year = (uint16_t) mshdr_u16(rec + 20, hdr->swap);
+    hdr->btime.day = (uint16_t) mshdr_u16(rec + 22, hdr->swap);
+    hdr->btime.hour = rec[24];
+    hdr->btime.min = rec[25];
+    hdr->btime.sec = rec[26];
+    hdr->btime.unused = 0;
+    hdr->btime.fract = (uint16_t) mshdr_u16(rec + 28, hdr->swap);
+    hdr->numsamples = mshdr_u16(rec + 30, hdr->swap);
+    hdr->factor = mshdr_u16(rec + 32, hdr->swap);
+    hdr->dataoffset = mshdr_u16(rec + 44, hdr->swap);
+
+    for (offset = mshdr_u16(rec + 46, hdr->swap); (offset >= MSHDR_SIZE) && (offset + 8 <= (unsigned int) reclen); offset = next) {
+        b = rec + offset;
+        type = mshdr_u16(b, hdr->swap);
+        next = mshdr_u16(b + 2, hdr->swap);
+        if (type == 1000)
+            hdr->encoding = b[4];
+        else if (type == 1001)
+            hdr->usec = (signed char) b[5];
+        if (next <= offset)
+            break;
+    }
+
+    return 0;
+}
+
+/* the record start time, with any microseconds and any time correction not yet applied */
+hptime_t mshdr_starttime(mshdr_t *hdr) {
+    unsigned char *rec = (unsigned char *) hdr->record;
+    hptime_t starttime = ms_btime2hptime(&hdr->btime) + hdr->usec;
+
+    /* in 0.0001 seconds */
+    if ((rec[36] & 0x02) == 0)
+        starttime += (hptime_t) mshdr_i32(rec + 40, hdr->swap) * (HPTMODULUS / 10000);
+
+    return starttime;
+}
+
+/* the NET_STA_LOC_CHAN srcname from the header codes */
+void mshdr_srcname(char *record, char *srcname) {
+    unsigned char *rec = (unsigned char *) record;
+    char *p;
+
+    p = mshdr_code(srcname, rec + 18, 2); *p++ = '_';
+    p = mshdr_code(p, rec + 8, 5); *p++ = '_';
+    p = mshdr_code(p, rec + 13, 2); *p++ = '_';
+    p = mshdr_code(p, rec + 15, 3); *p = '\0';
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef _MSHDR_H
+#define _MSHDR_H
+
+#include <stdint.h>
+#include <libmseed.h>
+
+/*
+ * mshdr: read the fixed header and blockettes of a raw miniseed record, without unpacking it
+ *
+ * The header byte order is whichever reading gives a sensible year and day, and only the
+ * blockette 1000 encoding and blockette 1001 microseconds are picked out of the blockettes.
+ */
+
+#define MSHDR_SIZE 48 /* fixed section of the data header */
+
+typedef struct mshdr_s {
+    char *record;
+    int reclen;
+    int swap; /* little endian header */
+
+    int sequence; /* the ascii sequence number, zero if it is not one */
+    BTime btime;
+    unsigned int numsamples;
+    unsigned int factor; /* sample rate factor, zero when there are no samples */
+    unsigned int dataoffset;
+    int encoding; /* from blockette 1000, or -1 */
+    int usec; /* from blockette 1001 */
+} mshdr_t;
+
+extern unsigned int mshdr_u16(unsigned char *p, int swap);
+extern int32_t mshdr_i32(unsigned char *p, int swap);
+
+extern int mshdr_read(mshdr_t *hdr, char *record, int reclen);
+extern hptime_t mshdr_starttime(mshdr_t *hdr);
+extern void mshdr_srcname(char *record, char *srcname);
+
+#endif /* _MSHDR_H */
@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+/* system includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+
+#include "msindex.h"
+
+#define MSINDEX_MAGIC "MSGTSIX1"
+
+typedef struct msindex_header_s {
+    char magic[8];
+    uint32_t blocksize; /* sizeof(msindex_block_t), as a layout check */
+    uint32_t nblocks;
+    uint64_t size;
+    int64_t mtime;
+    uint64_t indexed;
+} msindex_header_t;
+
+static int msindex_read(msindex_t *index, char *sidecar) {
+    msindex_header_t header;
+    FILE *fp;
+
+    if ((fp = fopen(sidecar, "r")) == NULL)
+        return -1;
+    if ((fread(&header, sizeof(header), 1, fp) != 1) || (memcmp(header.magic, MSINDEX_MAGIC, sizeof(header.magic)) != 0) ||
+        (header.blocksize != sizeof(msindex_block_t))) {
+        fclose(fp); return -1;
+    }
+    if ((header.nblocks > 0) && ((index->blocks = (msindex_block_t *) calloc(header.nblocks, sizeof(msindex_block_t))) == NULL)) {
+        fclose(fp); return -1;
+    }
+    if (fread(index->blocks, sizeof(msindex_block_t), header.nblocks, fp) != header.nblocks) {
+        fclose(fp); msindex_free(index); return -1;
+    }
+    fclose(fp);
+
+    index->nblocks = index->maxblocks = (int) header.nblocks;
+    index->size = header.size;
+    index->mtime = header.mtime;
+    index->indexed = header.indexed;
+
+    return 0;
+}
+
+/* replace the sidecar, which may well not be possible on a read only archive, so failures are only logged in verbose mode */
+static int msindex_write(msindex_t *index, char *sidecar) {
+    msindex_header_t header;
+    char tmpfile[1024];
+    FILE *fp;
+    int fd;
+    int rv = 0;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MSINDEX_MAGIC, sizeof(header.magic));
+    header.blocksize = sizeof(msindex_block_t);
+    header.nblocks = (uint32_t) index->nblocks;
+    header.size = index->size;
+    header.mtime = index->mtime;
+    header.indexed = index->indexed;
+
+    snprintf(tmpfile, sizeof(tmpfile), "%s.XXXXXX", sidecar);
+    if ((fd = mkstemp(tmpfile)) < 0) {
+        ms_log(0, "index kept in memory, unable to write: %s - %s\n", sidecar, strerror(errno)); return -1;
+    }
+    (void) fchmod(fd, 0644);
+    if ((fp = fdopen(fd, "w")) == NULL) {
+        (void) close(fd); (void) unlink(tmpfile); return -1;
+    }
+    if ((fwrite(&header, sizeof(header), 1, fp) != 1) ||
+        (fwrite(index->blocks, sizeof(msindex_block_t), index->nblocks, fp) != (size_t) index->nblocks))
+        rv = -1;
+    if (fclose(fp) != 0)
+        rv = -1;
+
+    if ((rv < 0) || (rename(tmpfile, sidecar) != 0)) {
+        ms_log(0, "index kept in memory, unable to write: %s - %s\n", sidecar, strerror(errno)); (void) unlink(tmpfile); return -1;
+    }
+
+    return 0;
+}
+
+/* add a record to the index, extending the last block when it carries on the same stream */
+static int msindex_add(msindex_t *index, uint64_t offset, int reclen, char *srcname, hptime_t start, hptime_t end) {
+    msindex_block_t *block = (index->nblocks > 0) ? &index->blocks[index->nblocks - 1] : NULL;
+    msindex_block_t *blocks;
+
+    if ((block != NULL) && (block->offset + block->length == offset) && (block->length + (uint64_t) reclen <= MSINDEX_BLOCK) &&
+        (strcmp(block->srcname, srcname) == 0)) {
+        block->length += (uint64_t) reclen;
+        if (start < block->start)
+            block->start = start;
+        if (end > block->end)
+            block->end = end;
+        return 0;
+    }
+
+    if (index->nblocks == index->maxblocks) {
+        if ((blocks = (msindex_block_t *) realloc(index->blocks, 2 * (index->maxblocks + 1) * sizeof(msindex_block_t))) == NULL)
+            return -1;
+        index->blocks = blocks;
+        index->maxblocks = 2 * (index->maxblocks + 1);
+    }
+    block = &index->blocks[index->nblocks++];
+    memset(block, 0, sizeof(msindex_block_t));
+    block->offset = offset;
+    block->length = (uint64_t) reclen;
+    block->start = start;
+    block->end = end;
+    strncpy(block->srcname, srcname, sizeof(block->srcname) - 1);
+
+    return 0;
+}
+
+/* header only scan of anything beyond what has been indexed */
+static int msindex_scan(msindex_t *index, char *file) {
+    reader_t reader;
+    MSRecord *msr = NULL;
+    char srcname[100];
+    char *record;
+    int reclen;
+    int rv = 0;
+
+    if (reader_open(&reader, file) < 0)
+        return -1;
+
+    /* an index is only extended if its last block still starts with a record of the same stream */
+    if ((index->nblocks > 0) && (reader_seek(&reader, (size_t) index->blocks[index->nblocks - 1].offset) == 0) &&
+        (reader_next(&reader, &record, &reclen) == MS_NOERROR) && (msr_unpack (record, reclen, &msr, 0, 0) == MS_NOERROR)) {
+        msr_srcname(msr, srcname, 0);
+        if ((strcmp(srcname, index->blocks[index->nblocks - 1].srcname) != 0) ||
+            (msr->starttime < index->blocks[index->nblocks - 1].start) || (msr->starttime > index->blocks[index->nblocks - 1].end))
+            index->nblocks = 0;
+    }
+    else
+        index->nblocks = 0;
+    if (index->nblocks == 0)
+        index->indexed = 0;
+
+    if (reader_seek(&reader, (size_t) index->indexed) < 0) {
+        msr_free(&msr); reader_close(&reader); return -1;
+    }
+    while (reader_next(&reader, &record, &reclen) == MS_NOERROR) {
+        if (msr_unpack (record, reclen, &msr, 0, 0) != MS_NOERROR)
+            continue;
+        msr_srcname(msr, srcname, 0);
+        if (msindex_add(index, (uint64_t) (record - reader.map), reclen, srcname, msr->starttime, msr_endtime(msr)) < 0) {
+            ms_log(1, "memory error!\n"); rv = -1; break;
+        }
+        index->indexed = (uint64_t) (record - reader.map) + (uint64_t) reclen;
+    }
+    msr_free(&msr);
+    reader_close(&reader);
+
+    return rv;
+}
+
+/* index a file, reusing any sidecar that is still current and extending it over appended records, the index is still usable if it cannot be saved */
+int msindex_load(msindex_t *index, char *file, int sidecar) {
+    char name[1024];
+    struct stat st;
+
+    memset(index, 0, sizeof(msindex_t));
+    if ((stat(file, &st) < 0) || (!S_ISREG(st.st_mode)))
+        return -1;
+
+    snprintf(name, sizeof(name), "%s%s", file, MSINDEX_SUFFIX);
+    if ((sidecar) && (msindex_read(index, name) == 0)) {
+        if ((index->size == (uint64_t) st.st_size) && (index->mtime == (int64_t) st.st_mtime))
+            return 0;
+        /* anything other than appending means starting again */
+        if (index->size >= (uint64_t) st.st_size)
+            msindex_free(index);
+    }
+
+    if (msindex_scan(index, file) < 0) {
+        msindex_free(index); return -1;
+    }
+    index->size = (uint64_t) st.st_size;
+    index->mtime = (int64_t) st.st_mtime;
+
+    if (sidecar)
+        (void) msindex_write(index, name);
+
+    return 0;
+}
+
+/* the offset ranges of blocks overlapping the time window, matching any include and no exclude patterns, merged where adjacent */
+int msindex_select(msindex_t *index, hptime_t start, hptime_t end, int ninclude, char **include, int nexclude, char **exclude, reader_range_t **ranges) {
+    msindex_block_t *block;
+    int nranges = 0;
+    int n, i;
+
+    if ((*ranges = (reader_range_t *) calloc(index->nblocks + 1, sizeof(reader_range_t))) == NULL)
+        return -1;
+
+    for (n = 0; n < index->nblocks; n++) {
+        block = &index->blocks[n];
+        if (((start != 0) && (block->end < start)) || ((end != 0) && (block->start >= end)))
+            continue;
+        for (i = 0; (i < ninclude) && (fnmatch(include[i], block->srcname, 0) != 0); i++);
+        if ((ninclude > 0) && (i == ninclude))
+            continue;
+        for (i = 0; (i < nexclude) && (fnmatch(exclude[i], block->srcname, 0) != 0); i++);
+        if (i < nexclude)
+            continue;
+
+        if ((nranges > 0) && ((*ranges)[nranges - 1].offset + (*ranges)[nranges - 1].length == (size_t) block->offset))
+            (*ranges)[nranges - 1].length += (size_t) block->length;
+        else {
+            (*ranges)[nranges].offset = (size_t) block->offset;
+            (*ranges)[nranges++].length = (size_t) block->length;
+        }
+    }
+
+    return nranges;
+}
+
+void msindex_free(msindex_t *index) {
+    free((char *) index->blocks);
+    memset(index, 0, sizeof(msindex_t));
+}
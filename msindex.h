@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+#ifndef _MSINDEX_H
+#define _MSINDEX_H
+
+#include <stdint.h>
+#include <libmseed.h>
+
+#include "reader.h"
+
+/*
+ * msindex: where each stream and time range lives within a miniseed file
+ *
+ * Runs of consecutive records from the same stream are kept as blocks with their offsets
+ * and time span, found with a header only scan. The index can be kept in a sidecar file
+ * next to the data, which is reused while the file is unchanged and only extended over
+ * anything appended since. Like the checkpoint file it is a host format. If the sidecar
+ * cannot be written, such as on a read only archive, the index is only held in memory.
+ */
+
+#define MSINDEX_SUFFIX ".msidx"
+#define MSINDEX_BLOCK (1024 * 1024) /* longest run of records kept as one block */
+
+typedef struct msindex_block_s {
+    uint64_t offset;
+    uint64_t length;
+    hptime_t start; /* first sample */
+    hptime_t end; /* last sample */
+    char srcname[64];
+} msindex_block_t;
+
+typedef struct msindex_s {
+    uint64_t size; /* of the file when indexed */
+    int64_t mtime;
+    uint64_t indexed; /* end of the last whole record indexed */
+    int nblocks;
+    int maxblocks;
+    msindex_block_t *blocks;
+} msindex_t;
+
+extern int msindex_load(msindex_t *index, char *file, int sidecar);
+extern int msindex_select(msindex_t *index, hptime_t start, hptime_t end, int ninclude, char **include, int nexclude, char **exclude, reader_range_t **ranges);
+extern void msindex_free(msindex_t *index);
+
+#endif /* _MSINDEX_H */
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/* system includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "reader.h"
+
+/* open a file for reading, mapping it where possible */
+int reader_open(reader_t *reader, char *file) {
+    struct stat st;
+
+    memset(reader, 0, sizeof(reader_t));
+    reader->file = file;
+    reader->fd = -1;
+
+    if (strcmp(file, "-") == 0)
+        return 0;
+
+    if ((reader->fd = open(file, O_RDONLY)) < 0) {
+        ms_log(2, "failed to open input file: %s - %s\n", file, strerror(errno)); return -1;
+    }
+    if ((fstat(reader->fd, &st) < 0) || (!S_ISREG(st.st_mode)) || (st.st_size == 0)) {
+        (void) close(reader->fd); reader->fd = -1; return 0;
+    }
+
+    /* a private mapping, so the file can never be touched by any in place unpacking */
+    reader->map = (char *) mmap(NULL, (size_t) st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, reader->fd, 0);
+    if (reader->map == MAP_FAILED) {
+        reader->map = NULL; (void) close(reader->fd); reader->fd = -1; return 0;
+    }
+    reader->size = (size_t) st.st_size;
+    (void) madvise(reader->map, reader->size, MADV_SEQUENTIAL);
+
+    /* the mapping outlives the descriptor, which matters when many files are open at once */
+    (void) close(reader->fd);
+    reader->fd = -1;
+
+    return 0;
+}
+
+/* return the next data record, MS_ENDOFFILE at the end, or a libmseed error code */
+int reader_next(reader_t *reader, char **record, int *reclen) {
+    size_t remaining;
+    int rc;
+    int len;
+
+    if (reader->map == NULL) {
+        if ((rc = ms_readmsr_r (&reader->msfp, &reader->msr, reader->file, 0, NULL, NULL, 1, 0, 0)) != MS_NOERROR)
+            return rc;
+        *record = reader->msr->record;
+        *reclen = reader->msr->reclen;
+        return MS_NOERROR;
+    }
+
+    while ((remaining = reader->size - reader->offset) >= MINRECLEN) {
+        /* step over anything between the wanted ranges */
+        if (reader->nranges > 0) {
+            while ((reader->range < reader->nranges) && (reader->offset >= reader->ranges[reader->range].offset + reader->ranges[reader->range].length))
+                reader->range++;
+            if (reader->range >= reader->nranges)
+                break;
+            if (reader->offset < reader->ranges[reader->range].offset) {
+                reader->offset = reader->ranges[reader->range].offset; continue;
+            }
+        }
+
+        len = ms_detect(reader->map + reader->offset, (remaining > MAXRECLEN) ? MAXRECLEN : (int) remaining);
+
+        /* skip anything that does not look like a data record */
+        if (len < 0) {
+            reader->offset += MINRECLEN; continue;
+        }
+
+        /*
+         * no blockette 1000 or following header, so the record can only be the rest of the file, as long as that is
+         * short enough for a record and the file has stopped growing, otherwise it is passed over as unreadable
+         */
+        if (len == 0) {
+            if ((reader->follow) && (remaining <= MAXRECLEN))
+                break;
+            if (remaining > MAXRECLEN) {
+                reader->offset += MINRECLEN; continue;
+            }
+            len = (int) remaining;
+        }
+        if ((reader->follow) && ((size_t) len > remaining))
+            break;
+        if ((len < MINRECLEN) || ((size_t) len > remaining)) {
+            ms_log(2, "truncated record in %s at offset %lld\n", reader->file, (long long) reader->offset);
+            reader->offset = reader->size; return MS_GENERROR;
+        }
+
+        *record = reader->map + reader->offset;
+        *reclen = len;
+        reader->offset += (size_t) len;
+
+        return MS_NOERROR;
+    }
+
+    return MS_ENDOFFILE;
+}
+
+/* carry on reading from an offset in a mapped file */
+int reader_seek(reader_t *reader, size_t offset) {
+    if ((reader->map == NULL) || (offset > reader->size))
+        return -1;
+    reader->offset = offset;
+
+    return 0;
+}
+
+/* only return the records within these ranges, in offset order, of a mapped file, which the reader then frees */
+int reader_limit(reader_t *reader, reader_range_t *ranges, int nranges) {
+    if (reader->map == NULL)
+        return -1;
+    reader->ranges = ranges;
+    reader->nranges = nranges;
+    reader->range = 0;
+
+    /* an empty selection still has to stop the reader */
+    if (nranges == 0)
+        reader->offset = reader->size;
+
+    return 0;
+}
+
+void reader_close(reader_t *reader) {
+    if (reader->map != NULL)
+        (void) munmap(reader->map, reader->size);
+    if (reader->fd >= 0)
+        (void) close(reader->fd);
+    if ((reader->msfp != NULL) || (reader->msr != NULL))
+        ms_readmsr_r (&reader->msfp, &reader->msr, NULL, 0, NULL, NULL, 0, 0, 0);
+
+    free((char *) reader->ranges);
+
+    reader->map = NULL;
+    reader->fd = -1;
+    reader->ranges = NULL;
+    reader->nranges = 0;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef _READER_H
+#define _READER_H
+
+#include <sys/types.h>
+#include <libmseed.h>
+
+/*
+ * reader: step through the raw records of a miniseed file
+ *
+ * Regular files are memory mapped and records are returned as pointers into the mapping,
+ * with the record length taken from the fixed header, so nothing is copied before unpacking.
+ * Anything that cannot be mapped, including stdin, is streamed through libmseed instead.
+ */
+
+/* a run of whole records within a file */
+typedef struct reader_range_s {
+    size_t offset;
+    size_t length;
+} reader_range_t;
+
+typedef struct reader_s {
+    char *file;
+    int fd;
+
+    char *map; /* mapped file, or NULL when streaming */
+    size_t size;
+    size_t offset; /* start of the next record */
+
+    int nranges; /* only records in these ranges are returned, when set */
+    int range;
+    reader_range_t *ranges;
+
+    int follow; /* the file may still be growing, so a partial last record is left for later */
+
+    MSFileParam *msfp; /* streaming fallback */
+    MSRecord *msr;
+} reader_t;
+
+extern int reader_open(reader_t *reader, char *file);
+extern int reader_next(reader_t *reader, char **record, int *reclen);
+extern int reader_seek(reader_t *reader, size_t offset);
+extern int reader_limit(reader_t *reader, reader_range_t *ranges, int nranges);
+extern void reader_close(reader_t *reader);
+
+#endif /* _READER_H */
@@ -0,0 +1,282 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/* system includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "registry.h"
+#include "hash.h"
+
+/* the fir filter slots of a stream, of which only those in use are packed */
+#define REGISTRY_FIRS offsetof(crex_stream_t, firs)
+#define REGISTRY_FIRS_END (offsetof(crex_stream_t, firs) + sizeof(((crex_stream_t *) 0)->firs))
+#define REGISTRY_TAIL (sizeof(crex_stream_t) - REGISTRY_FIRS_END)
+
+static registry_entry_t *registry_entry(registry_t *reg, int index) {
+    return &reg->chunks[index / REGISTRY_CHUNK][index % REGISTRY_CHUNK];
+}
+
+/* find the slot holding srcname, or the empty slot where it belongs */
+static registry_slot_t *registry_probe(registry_t *reg, const char *srcname, unsigned int hash) {
+    registry_slot_t *slot;
+    unsigned int mask = (unsigned int) reg->nslots - 1;
+    unsigned int n;
+
+    for (n = hash & mask; ; n = (n + 1) & mask) {
+        slot = &reg->slots[n];
+        if (slot->index < 0)
+            return slot;
+        if ((slot->hash == hash) && (strcmp(registry_entry(reg, slot->index)->srcname, srcname) == 0))
+            return slot;
+    }
+}
+
+/* double the hash table, keeping the load factor under a half */
+static int registry_grow(registry_t *reg) {
+    registry_slot_t *slots = reg->slots;
+    int nslots = reg->nslots;
+    int n;
+
+    if ((reg->slots = (registry_slot_t *) malloc(2 * nslots * sizeof(registry_slot_t))) == NULL) {
+        reg->slots = slots; return -1;
+    }
+    reg->nslots = 2 * nslots;
+    for (n = 0; n < reg->nslots; n++)
+        reg->slots[n].index = -1;
+
+    for (n = 0; n < nslots; n++) {
+        if (slots[n].index < 0)
+            continue;
+        *registry_probe(reg, registry_entry(reg, slots[n].index)->srcname, slots[n].hash) = slots[n];
+    }
+    free((char *) slots);
+
+    return 0;
+}
+
+/* a packed state for the filter count from the pool, a block of them is added when there are none free */
+static char *registry_alloc(registry_t *reg, int nfirs) {
+    size_t size = registry_packsize(nfirs);
+    char **blocks;
+    char *block, *state;
+    size_t n, count;
+
+    if (reg->unused[nfirs] == NULL) {
+        count = (size < REGISTRY_BLOCK) ? REGISTRY_BLOCK / size : 1;
+        if ((blocks = (char **) realloc(reg->blocks, (reg->nblocks + 1) * sizeof(char *))) == NULL)
+            return NULL;
+        reg->blocks = blocks;
+        if ((block = (char *) malloc(count * size)) == NULL)
+            return NULL;
+        reg->blocks[reg->nblocks++] = block;
+        reg->blockbytes += count * size;
+
+        /* each free state starts with the next on the list */
+        for (n = 0; n < count; n++) {
+            memcpy(block + n * size, &reg->unused[nfirs], sizeof(char *));
+            reg->unused[nfirs] = block + n * size;
+        }
+    }
+    state = reg->unused[nfirs];
+    memcpy(&reg->unused[nfirs], state, sizeof(char *));
+
+    return state;
+}
+
+/* hand a packed state back to the pool */
+static void registry_release(registry_t *reg, int nfirs, char *state) {
+    memcpy(state, &reg->unused[nfirs], sizeof(char *));
+    reg->unused[nfirs] = state;
+}
+
+registry_t *registry_new(int hint) {
+    registry_t *reg;
+    int n;
+
+    if ((reg = (registry_t *) malloc(sizeof(registry_t))) == NULL)
+        return NULL;
+    memset(reg, 0, sizeof(registry_t));
+
+    for (reg->nslots = 16; reg->nslots < 2 * hint; reg->nslots *= 2);
+    if ((reg->slots = (registry_slot_t *) malloc(reg->nslots * sizeof(registry_slot_t))) == NULL) {
+        free((char *) reg); return NULL;
+    }
+    for (n = 0; n < reg->nslots; n++)
+        reg->slots[n].index = -1;
+
+    return reg;
+}
+
+void registry_free(registry_t *reg) {
+    int n;
+
+    if (reg == NULL)
+        return;
+
+    for (n = 0; n < reg->nchunks; n++)
+        free((char *) reg->chunks[n]);
+    for (n = 0; n < reg->nblocks; n++)
+        free(reg->blocks[n]);
+    free((char *) reg->chunks);
+    free((char *) reg->blocks);
+    free((char *) reg->slots);
+    free((char *) reg);
+}
+
+/* return the index of the stream matching srcname, or -1 if not known */
+int registry_lookup(registry_t *reg, const char *srcname) {
+    return registry_probe(reg, srcname, hash_string(srcname))->index;
+}
+
+/* add a stream for srcname, without any state yet, returning its index, or -1 on memory errors */
+int registry_insert(registry_t *reg, const char *srcname) {
+    registry_entry_t **chunks;
+    registry_entry_t *entry;
+    registry_slot_t *slot;
+    unsigned int hash = hash_string(srcname);
+
+    if ((2 * (reg->nstreams + 1) > reg->nslots) && (registry_grow(reg) < 0))
+        return -1;
+
+    if (reg->nstreams == reg->nchunks * REGISTRY_CHUNK) {
+        if ((chunks = (registry_entry_t **) realloc(reg->chunks, (reg->nchunks + 1) * sizeof(registry_entry_t *))) == NULL)
+            return -1;
+        reg->chunks = chunks;
+        if ((reg->chunks[reg->nchunks] = (registry_entry_t *) calloc(REGISTRY_CHUNK, sizeof(registry_entry_t))) == NULL)
+            return -1;
+        reg->nchunks++;
+    }
+
+    entry = registry_entry(reg, reg->nstreams);
+    strncpy(entry->srcname, srcname, sizeof(entry->srcname) - 1);
+
+    slot = registry_probe(reg, entry->srcname, hash);
+    slot->hash = hash;
+    slot->index = reg->nstreams;
+
+    return reg->nstreams++;
+}
+
+/* unpack a stream into the given state, returns 1 if it has never been saved and so is only zeroed with its srcname */
+int registry_load(registry_t *reg, int index, crex_stream_t *stream) {
+    registry_entry_t *entry = registry_entry(reg, index);
+
+    if (entry->state == NULL) {
+        memset(stream, 0, sizeof(crex_stream_t));
+        strncpy(stream->srcname, entry->srcname, sizeof(stream->srcname) - 1);
+        return 1;
+    }
+
+    return registry_unpack(entry->state, registry_packsize(entry->nfirs), stream);
+}
+
+/* pack a stream back into the registry, moving it to a state of another size if its filter count has changed */
+int registry_save(registry_t *reg, int index, crex_stream_t *stream) {
+    registry_entry_t *entry = registry_entry(reg, index);
+    int nfirs = (stream->nfirs > 0) ? stream->nfirs : 0;
+    char *state;
+
+    if (nfirs > FIR_MAX_FILTERS)
+        nfirs = FIR_MAX_FILTERS;
+    if ((entry->state == NULL) || (entry->nfirs != nfirs)) {
+        if ((state = registry_alloc(reg, nfirs)) == NULL)
+            return -1;
+        if (entry->state != NULL)
+            registry_release(reg, entry->nfirs, entry->state);
+        entry->state = state;
+        entry->nfirs = nfirs;
+    }
+    registry_pack(stream, entry->state);
+
+    return 0;
+}
+
+/* the packed state of a stream, or NULL if it has never been saved */
+char *registry_packed(registry_t *reg, int index, size_t *len) {
+    registry_entry_t *entry = registry_entry(reg, index);
+
+    *len = (entry->state != NULL) ? registry_packsize(entry->nfirs) : 0;
+
+    return entry->state;
+}
+
+char *registry_name(registry_t *reg, int index) {
+    return registry_entry(reg, index)->srcname;
+}
+
+int registry_count(registry_t *reg) {
+    return reg->nstreams;
+}
+
+/* memory allocated for the streams, their packed states and their lookup */
+size_t registry_bytes(registry_t *reg) {
+    return sizeof(registry_t) + (size_t) reg->nchunks * (REGISTRY_CHUNK * sizeof(registry_entry_t) + sizeof(registry_entry_t *)) +
+        (size_t) reg->nslots * sizeof(registry_slot_t) + reg->blockbytes + (size_t) reg->nblocks * sizeof(char *);
+}
+
+/* the packed length of a stream with this many filters, its filter count then the state around the unused slots */
+size_t registry_packsize(int nfirs) {
+    return sizeof(uint32_t) + REGISTRY_FIRS + (size_t) nfirs * sizeof(firfilter_t) + REGISTRY_TAIL;
+}
+
+/* pack a stream into a state of registry_packsize(stream->nfirs) bytes */
+void registry_pack(crex_stream_t *stream, char *state) {
+    uint32_t nfirs = (stream->nfirs > 0) ? (uint32_t) stream->nfirs : 0;
+    char *p = (char *) stream;
+
+    if (nfirs > FIR_MAX_FILTERS)
+        nfirs = FIR_MAX_FILTERS;
+
+    memcpy(state, &nfirs, sizeof(nfirs)); state += sizeof(nfirs);
+    memcpy(state, p, REGISTRY_FIRS); state += REGISTRY_FIRS;
+    memcpy(state, stream->firs, nfirs * sizeof(firfilter_t)); state += nfirs * sizeof(firfilter_t);
+    memcpy(state, p + REGISTRY_FIRS_END, REGISTRY_TAIL);
+}
+
+/* unpack a stream, leaving its unused fir filter slots as they were and clearing its list link, returns -1 if the state is short */
+int registry_unpack(char *state, size_t len, crex_stream_t *stream) {
+    char *p = (char *) stream;
+    uint32_t nfirs;
+
+    if (len < sizeof(nfirs))
+        return -1;
+    memcpy(&nfirs, state, sizeof(nfirs)); state += sizeof(nfirs);
+    if ((nfirs > FIR_MAX_FILTERS) || (len < registry_packsize((int) nfirs)))
+        return -1;
+
+    memcpy(p, state, REGISTRY_FIRS); state += REGISTRY_FIRS;
+    memcpy(stream->firs, state, nfirs * sizeof(firfilter_t)); state += nfirs * sizeof(firfilter_t);
+    memcpy(p + REGISTRY_FIRS_END, state, REGISTRY_TAIL);
+    stream->nfirs = (int) nfirs;
+    stream->next = NULL;
+
+    return 0;
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef _REGISTRY_H
+#define _REGISTRY_H
+
+#include <stddef.h>
+#include <libcrex.h>
+
+/*
+ * registry: srcname indexed store of crex_stream_t state
+ *
+ * Streams are found via an open addressing hash on the srcname, and kept in fixed size chunks of
+ * small entries, so a name remains valid for the life of the registry. The crex state of a stream
+ * is only allocated when it is first saved, and is held packed: the state around its fir filter
+ * slots and only the filters in use, so its size follows the configured filters whatever libcrex
+ * does with the slots. Packed states come from a pool, one free list for each filter count.
+ *
+ * A stream is unpacked into a full crex_stream_t owned by the caller to be worked on, and saved
+ * back afterwards; the packed form is also what checkpoint snapshots hold.
+ */
+
+#define REGISTRY_CHUNK 64 /* entries per storage chunk */
+#define REGISTRY_BLOCK 262144 /* bytes of packed states allocated at a time, or one state if larger */
+
+typedef struct registry_slot_s {
+    unsigned int hash; /* cached srcname hash */
+    int index; /* stream index, or -1 when empty */
+} registry_slot_t;
+
+typedef struct registry_entry_s {
+    char srcname[64];
+    int nfirs; /* fir filters in the packed state */
+    char *state; /* packed, or NULL until first saved */
+} registry_entry_t;
+
+typedef struct registry_s {
+    int nstreams; /* streams in use */
+    int nchunks; /* storage chunks allocated */
+    registry_entry_t **chunks;
+
+    int nslots; /* hash table size, always a power of two */
+    registry_slot_t *slots;
+
+    char *unused[FIR_MAX_FILTERS + 1]; /* free packed states, by filter count */
+    int nblocks;
+    char **blocks;
+    size_t blockbytes; /* allocated for packed states */
+} registry_t;
+
+extern registry_t *registry_new(int hint);
+extern void registry_free(registry_t *reg);
+
+extern int registry_lookup(registry_t *reg, const char *srcname);
+extern int registry_insert(registry_t *reg, const char *srcname);
+
+extern int registry_load(registry_t *reg, int index, crex_stream_t *stream);
+extern int registry_save(registry_t *reg, int index, crex_stream_t *stream);
+extern char *registry_packed(registry_t *reg, int index, size_t *len);
+extern char *registry_name(registry_t *reg, int index);
+extern int registry_count(registry_t *reg);
+extern size_t registry_bytes(registry_t *reg);
+
+extern size_t registry_packsize(int nfirs);
+extern void registry_pack(crex_stream_t *stream, char *state);
+extern int registry_unpack(char *state, size_t len, crex_stream_t *stream);
+
+#endif /* _REGISTRY_H */
@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/* system includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <libmseed.h>
+
+#include "ring.h"
+
+/* back off period when waiting on the other side of the ring */
+static void ring_pause(void) {
+    struct timespec ts = { 0, 1000000L };
+    (void) nanosleep(&ts, NULL);
+}
+
+ring_t *ring_new(size_t size, size_t recsize, char *spoolfile) {
+    pthread_condattr_t attr;
+    ring_t *ring;
+    size_t n;
+    int errsv = 0;
+
+    if ((ring = (ring_t *) malloc(sizeof(ring_t))) == NULL)
+        return NULL;
+    memset(ring, 0, sizeof(ring_t));
+
+    for (n = 16; n < size; n *= 2);
+    ring->size = n;
+    ring->recsize = recsize;
+    if ((ring->records = (char *) malloc(ring->size * ring->recsize)) == NULL) {
+        free((char *) ring); return NULL;
+    }
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->pending, 0);
+    atomic_init(&ring->waiting, 0);
+    ring->waker = ring;
+
+    /* waits are timed against the monotonic clock, as the wall clock may be stepped */
+    pthread_mutex_init(&ring->waitlock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&ring->wakeup, &attr);
+    pthread_condattr_destroy(&attr);
+
+    pthread_mutex_init(&ring->lock, NULL);
+    ring->spool = -1;
+    if (spoolfile != NULL) {
+        if ((ring->spool = open(spoolfile, O_RDWR | O_CREAT | O_TRUNC, 0600)) < 0) {
+            errsv = errno; ms_log(2, "failed to open spool file: %s - %s\n", spoolfile, strerror(errsv));
+            ring_free(ring); return NULL;
+        }
+        ring->spoolfile = strdup(spoolfile);
+    }
+
+    return ring;
+}
+
+void ring_free(ring_t *ring) {
+    if (ring == NULL)
+        return;
+
+    if (ring->spool >= 0) {
+        (void) close(ring->spool);
+        (void) unlink(ring->spoolfile);
+    }
+    free(ring->spoolfile);
+    pthread_mutex_destroy(&ring->lock);
+    pthread_cond_destroy(&ring->wakeup);
+    pthread_mutex_destroy(&ring->waitlock);
+    free(ring->records);
+    free((char *) ring);
+}
+
+/* number of records waiting in memory */
+size_t ring_count(ring_t *ring) {
+    return atomic_load_explicit(&ring->head, memory_order_acquire) - atomic_load_explicit(&ring->tail, memory_order_acquire);
+}
+
+/* whether there is nothing left for the consumer, in memory or spooled */
+int ring_empty(ring_t *ring) {
+    return (ring_count(ring) == 0) && (atomic_load(&ring->pending) == 0);
+}
+
+static int ring_push(ring_t *ring, char *record) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    if (head - tail >= ring->size)
+        return -1;
+
+    memcpy(ring->records + (head & (ring->size - 1)) * ring->recsize, record, ring->recsize);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    if (head + 1 - tail > ring->peak)
+        ring->peak = head + 1 - tail;
+
+    return 0;
+}
+
+static int ring_pop(ring_t *ring, char *record) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    if (head == tail)
+        return -1;
+
+    memcpy(record, ring->records + (tail & (ring->size - 1)) * ring->recsize, ring->recsize);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+
+    return 0;
+}
+
+/* append a record to the overflow spool */
+static int ring_spill(ring_t *ring, char *record) {
+    int errsv = 0;
+    int rv = 0;
+
+    pthread_mutex_lock(&ring->lock);
+    if (pwrite(ring->spool, record, ring->recsize, (off_t) (ring->nwritten * ring->recsize)) != (ssize_t) ring->recsize) {
+        errsv = errno; ms_log(2, "failed to write spool file: %s - %s\n", ring->spoolfile, strerror(errsv)); rv = -1;
+    }
+    else {
+        ring->nwritten++;
+        atomic_fetch_add(&ring->pending, 1);
+    }
+    pthread_mutex_unlock(&ring->lock);
+
+    return rv;
+}
+
+/* read back the oldest spooled record, resetting the spool once empty */
+static int ring_unspill(ring_t *ring, char *record) {
+    int errsv = 0;
+    int rv = 0;
+
+    pthread_mutex_lock(&ring->lock);
+    if (pread(ring->spool, record, ring->recsize, (off_t) (ring->nread * ring->recsize)) != (ssize_t) ring->recsize) {
+        errsv = errno; ms_log(2, "failed to read spool file: %s - %s\n", ring->spoolfile, strerror(errsv)); rv = -1;
+    }
+    if (++ring->nread == ring->nwritten) {
+        ring->nread = ring->nwritten = 0;
+        (void) ftruncate(ring->spool, 0);
+    }
+    atomic_fetch_sub(&ring->pending, 1);
+    pthread_mutex_unlock(&ring->lock);
+
+    return rv;
+}
+
+/* pairs with the fence in ring_waitany, either the consumer sees the record or it is seen to be waiting */
+static void ring_notify(ring_t *ring) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&ring->waker->waiting, memory_order_relaxed))
+        ring_wake(ring);
+}
+
+/* queue a record from the producer, returns -1 if it had to be dropped */
+int ring_put(ring_t *ring, char *record) {
+    int waiting = 0;
+
+    ring->received++;
+
+    /* once spooling, keep spooling until the consumer has caught up */
+    if ((ring->spool >= 0) && (atomic_load(&ring->pending) > 0)) {
+        if (ring_spill(ring, record) < 0) {
+            ring->dropped++; return -1;
+        }
+        ring->spooled++;
+        return 0;
+    }
+
+    while (ring_push(ring, record) < 0) {
+        if (ring->spool >= 0) {
+            if (ring_spill(ring, record) < 0) {
+                ring->dropped++; return -1;
+            }
+            ring->spooled++;
+            return 0;
+        }
+        if (!waiting++)
+            ring->blocked++;
+        ring_pause();
+    }
+
+    ring_notify(ring);
+
+    return 0;
+}
+
+/* queue a record from the producer without ever waiting, spooling or dropping it if the ring is full */
+int ring_offer(ring_t *ring, char *record) {
+    ring->received++;
+
+    if (((ring->spool >= 0) && (atomic_load(&ring->pending) > 0)) || (ring_push(ring, record) < 0)) {
+        if ((ring->spool < 0) || (ring_spill(ring, record) < 0)) {
+            ring->dropped++; return -1;
+        }
+        ring->spooled++;
+        return 0;
+    }
+
+    ring_notify(ring);
+
+    return 0;
+}
+
+/* take the next record for the consumer, returns -1 if none are waiting */
+int ring_get(ring_t *ring, char *record) {
+    if (ring_pop(ring, record) == 0)
+        return 0;
+    if (atomic_load(&ring->pending) > 0)
+        return ring_unspill(ring, record);
+
+    return -1;
+}
+
+/* wait for the producer to queue something, or for the given milliseconds to pass */
+void ring_wait(ring_t *ring, int msec) {
+    ring_waitany(&ring, 1, msec);
+}
+
+/* wait for a record on any of the rings, which must share their wakeup, or for the given milliseconds to pass */
+void ring_waitany(ring_t **rings, int nrings, int msec) {
+    ring_t *waker = rings[0]->waker;
+    struct timespec ts;
+    int n;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_sec += msec / 1000;
+    ts.tv_nsec += (long) (msec % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++; ts.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&waker->waitlock);
+    atomic_store_explicit(&waker->waiting, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    for (n = 0; (n < nrings) && (ring_empty(rings[n])); n++);
+    if (n == nrings)
+        (void) pthread_cond_timedwait(&waker->wakeup, &waker->waitlock, &ts);
+    atomic_store_explicit(&waker->waiting, 0, memory_order_relaxed);
+    pthread_mutex_unlock(&waker->waitlock);
+}
+
+/* wake a waiting consumer, such as when there will be nothing more to queue */
+void ring_wake(ring_t *ring) {
+    ring_t *waker = ring->waker;
+
+    pthread_mutex_lock(&waker->waitlock);
+    pthread_cond_signal(&waker->wakeup);
+    pthread_mutex_unlock(&waker->waitlock);
+}
+
+/* have the consumer of ring woken by the wakeup of another, so it can wait on both, before either is used */
+void ring_share(ring_t *ring, ring_t *with) {
+    ring->waker = with->waker;
+}
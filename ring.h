@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef _RING_H
+#define _RING_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+/*
+ * ring: bounded lock free single producer, single consumer queue of raw records
+ *
+ * When the ring is full the producer waits for the consumer or, if the ring was given a
+ * spool file, appends the record to it for the consumer to read back once the ring has
+ * been drained, so record order is always kept. A producer which must never wait offers
+ * its records instead, and those which cannot be queued or spooled are dropped. An idle
+ * consumer can wait for the next record, the producer only takes the lock to wake it
+ * while it is actually waiting. A consumer draining several rings shares one wakeup
+ * between them, so it can wait for a record on any of them.
+ */
+
+#define RING_RECSIZE 512 /* raw seedlink record length, the usual entry size */
+#define RING_SIZE 4096 /* default number of records */
+
+typedef struct ring_s {
+    atomic_size_t head; /* next record to write, producer owned */
+    char pad[64 - sizeof(atomic_size_t)];
+    atomic_size_t tail; /* next record to read, consumer owned */
+
+    size_t size; /* always a power of two */
+    size_t recsize; /* bytes in each entry */
+    char *records;
+
+    /* producer statistics */
+    size_t peak;
+    unsigned long received;
+    unsigned long blocked;
+    unsigned long spooled;
+    unsigned long dropped;
+
+    /* overflow spool, guarded by the lock */
+    pthread_mutex_t lock;
+    char *spoolfile;
+    int spool;
+    atomic_ulong pending;
+    unsigned long nwritten;
+    unsigned long nread;
+
+    /* consumer wakeup */
+    struct ring_s *waker; /* the ring whose wakeup is used, itself unless shared */
+    atomic_int waiting;
+    pthread_mutex_t waitlock;
+    pthread_cond_t wakeup;
+} ring_t;
+
+extern ring_t *ring_new(size_t size, size_t recsize, char *spoolfile);
+extern void ring_free(ring_t *ring);
+
+extern int ring_put(ring_t *ring, char *record);
+extern int ring_offer(ring_t *ring, char *record);
+extern int ring_get(ring_t *ring, char *record);
+extern void ring_wait(ring_t *ring, int msec);
+extern void ring_waitany(ring_t **rings, int nrings, int msec);
+extern void ring_wake(ring_t *ring);
+extern void ring_share(ring_t *ring, ring_t *with);
+
+extern size_t ring_count(ring_t *ring);
+extern int ring_empty(ring_t *ring);
+
+#endif /* _RING_H */
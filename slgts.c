@@ -36,12 +36,30 @@
 #include <errno.h>
 #include <time.h>
 #include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <poll.h>
+#include <sys/stat.h>
 
 /* libmseed library includes */
 #include <libmseed.h>
 #include <libslink.h>
 #include <libtidal.h>
 #include <libcrex.h>
+#include <libdali.h>
+
+#include "registry.h"
+#include "gts.h"
+#include "crexout.h"
+#include "ring.h"
+#include "stats.h"
+#include "filter.h"
+#include "steim.h"
+#include "checkpoint.h"
+#include "datalink.h"
+#include "streamconf.h"
+#include "hash.h"
+#include "mshdr.h"
 
 #define PROGRAM "slgts" /* program name */
 
@@ -61,7 +79,7 @@
 /* program variables */
 static char *program_name = PROGRAM;
 static char *program_version = PROGRAM " (" PACKAGE_VERSION ") (c) GNS 2014 (m.chadwick@gns.cri.nz)";
-static char *program_usage = PROGRAM " [-hv][-I <tag>][-A <alpha>][-B <beta>][-L <latitude>][-Z <zone>][-T <label/amp/lag> ...][<seedlink_options>] [<server>] [<gts_dir>]";
+static char *program_usage = PROGRAM " [-hv][-C <files>][-D <deadline>][-j <workers>][-q <records>][-o <spool>][-r <report>][-M <metrics>][-m <interval>][-c <catchup>][-P <checkpoint>][-p <interval>][-W <datalink>][-i <patterns>][-e <patterns>][-I <tag>][-A <alpha>][-B <beta>][-L <latitude>][-Z <zone>][-T <label/amp/lag> ...][-f <config>][-a <server>[=<streams>] ...][<seedlink_options>] [<server>] [<gts_dir>]";
 static char *program_prefix = "[" PROGRAM "] ";
 
 static int verbose = 0; /* program verbosity */
@@ -75,6 +93,8 @@ static double latitude = 0.0;
 
 static char *seedlink = ":18000"; /* datalink server to use */
 static char *gts = NULL; /* gts directory to use */
+static int gtsfiles = GTS_FILES; /* pending gts minute files */
+static int deadline = 5; /* seconds before publishing a pending gts minute file */
 
 /* possible options */
 static int unimode = 0;
@@ -85,17 +105,151 @@ static char *streamfile = NULL;
 static int stateint = 300;
 
 static SLCD *slconn = NULL;
+
+/* upstream seedlink servers, the first is the command line server */
+#define MAX_SERVERS 16
+#define SERVER_POLL 100 /* milliseconds to wait when no server has data */
+#define STATE_MARK "#SLGTSST" /* queued as a raw record behind the records a statefile save covers, followed by the server number */
+
+/* a stream position noted for a statefile save */
+typedef struct server_position_s {
+    int seqnum;
+    char timestamp[20];
+} server_position_t;
+
+typedef struct server_s {
+    SLCD *slconn;
+    char *streams; /* stream list for this server, otherwise the command line selection */
+    char statefile[1024];
+    int packetcnt;
+    int active;
+
+    /* the statefile is only saved once every worker has processed the records received before the position was noted */
+    int saving; /* waiting for the workers */
+    atomic_int waiting; /* workers yet to reach the mark */
+    int npositions; /* cleared when the stream list changes */
+    int maxpositions;
+    server_position_t *positions; /* in stream list order */
+} server_t;
+
+static int nservers = 0;
+static server_t servers[MAX_SERVERS];
 static char *firfile = FIRFILTERS;
 
+/* FIR filter config */
+static int nfirs = 0;
+static char *firnames[FIR_MAX_FILTERS];
+
+static crex_tidal_t tidal;
+
+/* per-stream settings, with the command line settings for any other streams, reloaded on SIGHUP */
+#define RELOAD_MARK "#SLGTSHU" /* queued as a raw record to move each worker onto the new settings */
+static char *configfile = NULL;
+static streamconfig_t *streamconfig = NULL;
+static streamconfig_t *retired = NULL; /* the previous settings, until every worker has moved on */
+static atomic_int reloading = 0; /* workers yet to apply the new settings */
+static volatile sig_atomic_t reload = 0;
+static time_t firloaded = 0; /* modification time of the loaded fir filters file */
+
+/* processing pipeline */
+static int nworkers = 1; /* processing threads */
+static int queuesize = RING_SIZE; /* records queued for each processing thread */
+static char *spoolfile = NULL; /* overflow spool, otherwise block when a queue is full */
+static int reportint = 60; /* seconds between pipeline reports */
+
+static atomic_int collecting = 1;
+
+/* catch-up mode for backfilling streams, once data is later than this many seconds, until it is back within half of that */
+#define CATCHUP_STATE 10 /* state is saved this many times less often while catching up */
+static int catchupint = 300;
+static atomic_int catchingup = 0; /* streams currently catching up */
+
+/* processing statistics */
+static char *metricsfile = NULL; /* prometheus text file */
+static int metricsint = 60; /* seconds between metrics updates */
+static volatile sig_atomic_t dumpstats = 0;
+
+/* optional datalink output, alongside any gts directory */
+static char *datalinkaddr = NULL;
+static datalink_t *datalink = NULL;
+
+/* header checks before records are queued */
+static filter_t *filter = NULL;
+
+/* snapshots of the seedlink position and stream state, gathered by the workers and written by their own thread */
+#define CHECKPOINT_MARK "#SLGTSCP" /* queued as a raw record to ask each worker for its streams */
+static char *checkpointfile = NULL;
+static int checkpointint = 60; /* seconds between snapshots */
+static checkpoint_t snapshot;
+static pthread_mutex_t snapshot_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t snapshot_cond = PTHREAD_COND_INITIALIZER;
+static int snapshot_busy = 0; /* gathering or writing a snapshot */
+static int snapshot_waiting = 0; /* workers yet to add their streams */
+static int snapshot_stop = 0;
+
+/* what a worker keeps for each stream alongside its crex state, in one slot for locality */
+#define RECENT_RECORDS 16 /* start times remembered for each stream, to spot copies from redundant servers */
+
+typedef struct worker_stream_s {
+    stats_stream_t stats;
+    hptime_t latest; /* start of the newest record processed */
+    hptime_t recent[RECENT_RECORDS]; /* start of the records processed most recently, as a ring */
+    int nrecent;
+    int nextrecent;
+    int conf; /* stream config in use */
+    int catchup; /* backfilling, so only complete minute files are published */
+} worker_stream_t;
+
+typedef struct worker_s {
+    int id;
+    pthread_t thread;
+    ring_t *ring; /* raw records from the seedlink connection */
+    registry_t *streams; /* streams owned by this worker */
+    crex_stream_t *stream; /* the stream being worked on, unpacked from the registry */
+    gts_t *output;
+    streamconfig_t *config; /* the settings this worker is using */
+    crex_tidal_t *tidals; /* a copy of each distinct tidal model, indexed as the stream config models */
+    crexout_t crexout; /* process_crex output, as text */
+    steim_t steim; /* decoded samples */
+    int catchup; /* the stream of the record being processed is catching up */
+    hptime_t newest; /* end time of the record being processed */
+
+    stats_t stats; /* only touched by the worker */
+    stats_t shared; /* a copy of stats for the other threads, refreshed once a second under the lock */
+    unsigned long decoded, fallback; /* shared steim counters */
+    checkpoint_t part; /* streams and pending minute files for the snapshot being gathered */
+    int nstate;
+    worker_stream_t *state; /* indexed as the registry */
+    pthread_mutex_t lock; /* held while adding streams, and around the shared and per stream statistics */
+} worker_t;
+
+/* stop collecting from every server */
+static void terminate_servers(void) {
+    int n;
+
+    for (n = 0; n < nservers; n++)
+        sl_terminate(servers[n].slconn);
+}
+
 /* handle any KILL/TERM signals */
 static void term_handler(int sig) {
-	sl_terminate(slconn); return;
+	terminate_servers(); return;
 }
 
 static void dummy_handler (int sig) {
 	return;
 }
 
+/* reload the stream settings on SIGHUP */
+static void hup_handler (int sig) {
+	reload = 1;
+}
+
+/* dump the processing statistics on SIGUSR1 */
+static void usr1_handler (int sig) {
+	dumpstats = 1;
+}
+
 static void log_print(char *message) {
 	if (verbose)
 		fprintf(stderr, "%s", message);
@@ -105,73 +259,882 @@ static void err_print(char *message) {
 	fprintf(stderr, "error: %s", message);
 }
 
-static void record_handler (char *record, int reclen, void *extra) {
-    static MSRecord *msr = NULL;
-    BTime btime;
-    int mon, mday;
-    hptime_t endtime;
-    char streamid[100];
-    char samples[512];
-    char tmpfile[1024];
-    char outfile[1024];
-    int errsv = 0;
-    FILE *fp = NULL;
-    int rv;
+static void text_handler (char *srcname, hptime_t starttime, int sequence, char *text, int len, void *extra) {
+    worker_t *worker = (worker_t *) extra;
+    char timestr[64];
 
 	/* logging */
-	if (verbose > 0)
-		msr_print(msr, (verbose > 2) ? 1 : 0);
+	if ((verbose > 0) && (!worker->catchup))
+		ms_log(0, "%s %s: %d crex characters\n", srcname, ms_hptime2seedtimestr(starttime, timestr, 1), len);
 
-    if ((rv = msr_unpack (record, reclen, &msr, 1, 0)) != MS_NOERROR) {
-        ms_log (2, "error unpacking mseed record: %s", ms_errorstr(rv)); return;
+    if (worker->output)
+        (void) gts_write(worker->output, srcname, starttime, worker->newest, sequence, text, len);
+    else
+        fprintf(stdout, "%.*s\n", len, text);
+}
+
+/* send the packed CREX record to the datalink server, and its text to any gts directory */
+static void record_handler (char *record, int reclen, void *extra) {
+    worker_t *worker = (worker_t *) extra;
+    char srcname[64];
+    hptime_t starttime;
+    int sequence;
+    char *text;
+    int len;
+
+    (void) datalink_put(datalink, worker->id, record, reclen, worker->newest);
+
+    if ((worker->output) && (crexout_text(record, reclen, srcname, &starttime, &sequence, &text, &len) == 0))
+        text_handler(srcname, starttime, sequence, text, len, extra);
+}
+
+/* (re)start a stream with its configured crex and fir filter settings */
+static int setup_stream(crex_stream_t *stream, double samprate, streamconf_t *conf) {
+    int n;
+
+    /* Insert passed ctd values. */
+    strncpy(stream->ctd.id, conf->tag, 24);
+
+    stream->alpha = conf->alpha;
+    stream->beta = conf->beta;
+
+    /* Insert default ctd values. */
+    stream->ctd.time = 0;
+    stream->ctd.temp = -1;
+    stream->ctd.autoQC = 11;
+    stream->ctd.manualQC = 7;
+    stream->ctd.offset = 0;
+    stream->ctd.increment = 1;
+
+    /* reset the CREX data arrays */
+    for (n = 0; n < CREX_BUF_SIZE; n++) {
+        stream->ctd.mes[n] = CREX_NO_DATA;
+        stream->ctd.res[n] = CREX_NO_DATA;
     }
-    if ((msr->sampletype == 'a') && (msr->numsamples > 0)) {
-        memset(samples, 0, sizeof(samples));
-        strncpy(samples, msr->datasamples, msr->numsamples);
 
-        if (gts) {
-            msr_srcname (msr, streamid, 0);
-            if (ms_hptime2btime (msr->starttime, &btime) < 0) {
-                ms_log (2, "error unpacking hptime"); return;
-            }
-            ms_doy2md(btime.year, btime.day, &mon, &mday);
-            sprintf(outfile, "%s/%s.%04d%02d%02d%02d%02d.txt", gts, streamid, btime.year, mon, mday, btime.hour, btime.min);
-            sprintf(tmpfile, "%s/.%s.%04d%02d%02d%02d%02d.txt", gts, streamid, btime.year, mon, mday, btime.hour, btime.min);
-            if ((fp = fopen(tmpfile, "a")) == NULL) {
-                errsv = errno; ms_log(2, "failed to open output file: %s - %s\n", tmpfile, strerror(errsv)); return;
+    /* and the fir filters themselves */
+    stream->nfirs = conf->nfirs;
+    for (n = 0; n < stream->nfirs; n++) {
+        if (firfilter_find(conf->firnames[n], &stream->firs[n]) < 0) {
+            ms_log(1, "could not find fir filter [%s]\n", conf->firnames[n]); return -1;
+        }
+    }
+
+    stream->delay = 0LL;
+    stream->samprate = samprate;
+    for (n = 0; n < stream->nfirs; n++) {
+        stream->delay -= (hptime_t) MS_EPOCH2HPTIME(((stream->firs[n].minimum) ? 0.0 : ((double) stream->firs[n].length / 2.0 - 0.5) / stream->samprate));
+        stream->samprate /= (double) stream->firs[n].decimate;
+    }
+
+    return 0;
+}
+
+/* add a stream to the registry with its configured crex and fir filter settings, which are left unpacked in stream, returning its index */
+static int new_stream(registry_t *streams, char *srcname, double samprate, streamconf_t *conf, crex_stream_t *stream) {
+    int index;
+
+    if ((index = registry_insert(streams, srcname)) < 0) {
+        ms_log(1, "memory error!\n"); return -1;
+    }
+    (void) registry_load(streams, index, stream);
+
+    if (setup_stream(stream, samprate, conf) < 0)
+        return -1;
+    if (registry_save(streams, index, stream) < 0) {
+        ms_log(1, "memory error!\n"); return -1;
+    }
+
+    return index;
+}
+
+/* would the configured fir filters differ from those of a stream, the definitions are compared as the coefficients are opaque */
+static int stream_firs_changed(crex_stream_t *stream, streamconf_t *conf) {
+    firfilter_t fir;
+    int n;
+
+    if (stream->nfirs != conf->nfirs)
+        return 1;
+    for (n = 0; n < stream->nfirs; n++) {
+        if (firfilter_find(conf->firnames[n], &fir) < 0)
+            return 1;
+        if ((strcmp(fir.name, stream->firs[n].name) != 0) || (fir.length != stream->firs[n].length) ||
+            (fir.decimate != stream->firs[n].decimate) || (fir.minimum != stream->firs[n].minimum))
+            return 1;
+    }
+
+    return 0;
+}
+
+/* a copy of each distinct tidal model of the settings, as a worker may not share them with other workers, only between its streams */
+static crex_tidal_t *config_tidals(streamconfig_t *config) {
+    crex_tidal_t *tidals;
+
+    if ((tidals = (crex_tidal_t *) malloc((config->nmodels + 1) * sizeof(crex_tidal_t))) == NULL) {
+        ms_log(1, "memory error!\n"); return NULL;
+    }
+    memcpy(tidals, config->models, config->nmodels * sizeof(crex_tidal_t));
+
+    return tidals;
+}
+
+/* which worker owns a NET_STA_LOC_CHAN stream */
+static int srcname_worker(char *srcname) {
+    return (int) (hash_string(srcname) % (unsigned int) nworkers);
+}
+
+/* as srcname_worker, for the stream of a raw record, named from its fixed header the way libmseed names it */
+static int record_worker(char *record) {
+    char srcname[16];
+
+    mshdr_srcname(record, srcname);
+
+    return srcname_worker(srcname);
+}
+
+/* make room for the statistics, newest start time and config of a stream */
+static int worker_state(worker_t *worker, int index) {
+    worker_stream_t *state;
+
+    if (index < worker->nstate)
+        return 0;
+    if ((state = (worker_stream_t *) realloc(worker->state, 2 * (index + 1) * sizeof(worker_stream_t))) == NULL) {
+        ms_log(1, "memory error!\n"); return -1;
+    }
+    memset(state + worker->nstate, 0, (2 * (index + 1) - worker->nstate) * sizeof(worker_stream_t));
+    worker->state = state;
+    worker->nstate = 2 * (index + 1);
+
+    return 0;
+}
+
+/* has a record with this start time been processed for the stream recently */
+static int worker_recent(worker_stream_t *state, hptime_t starttime) {
+    int n;
+
+    for (n = 0; n < state->nrecent; n++) {
+        if (state->recent[n] == starttime)
+            return 1;
+    }
+
+    return 0;
+}
+
+/* memory held for the streams of a worker, with its lock held */
+static size_t worker_bytes(worker_t *worker) {
+    return registry_bytes(worker->streams) + (size_t) worker->nstate * sizeof(worker_stream_t) +
+        (size_t) worker->config->nmodels * sizeof(crex_tidal_t);
+}
+
+/* unpack and convert a single raw record */
+static int process_record(worker_t *worker, char *record, MSRecord **ppmsr) {
+    char srcname[100];
+    crex_stream_t *stream = NULL;
+    stats_stream_t *streamstats;
+    worker_stream_t *state;
+    int psamples = 0;
+    double t0, t1, latency;
+    int index, conf;
+    int rc;
+
+    /*
+     * with redundant servers only the first copy of each record is processed, checked from the header alone, anything
+     * else that is not newer, such as a gap filled by the other server, is still processed as late data
+     */
+    if (nservers > 1) {
+        steim_release(&worker->steim, *ppmsr);
+        if (msr_unpack (record, SLRECSIZE, ppmsr, 0, 0) != MS_NOERROR) {
+            sl_log(2, 0, "error parsing record\n"); return 0;
+        }
+        msr_srcname(*ppmsr, srcname, 0);
+        if (((index = registry_lookup(worker->streams, srcname)) >= 0) && ((*ppmsr)->starttime <= worker->state[index].latest) &&
+            (worker_recent(&worker->state[index], (*ppmsr)->starttime))) {
+            worker->stats.duplicates++; return 0;
+        }
+    }
+
+    /* unpack record header and data samples */
+    t0 = stats_now();
+    if ((rc = steim_unpack (&worker->steim, record, SLRECSIZE, ppmsr, 1)) != MS_NOERROR) {
+        sl_log(2, 0, "error parsing record\n"); return 0;
+    }
+    t1 = stats_now();
+    stats_add(&worker->stats.stages[STATS_UNPACK], t1 - t0);
+
+    if ((verbose > 1) && (!worker->catchup))
+        msr_print(*ppmsr, (verbose > 2) ? 1 : 0);
+    msr_srcname(*ppmsr, srcname, 0);
+    /* new streams are held by the registry from their first record, and any stream is unpacked while it is worked on */
+    stream = worker->stream;
+    if ((index = registry_lookup(worker->streams, srcname)) < 0) {
+        conf = streamconfig_match(worker->config, srcname);
+        pthread_mutex_lock(&worker->lock);
+        if (((index = new_stream(worker->streams, srcname, (*ppmsr)->samprate, &worker->config->confs[conf], stream)) >= 0) &&
+            (worker_state(worker, index) < 0))
+            index = -1;
+        if (index >= 0)
+            worker->state[index].conf = conf;
+        pthread_mutex_unlock(&worker->lock);
+        if (index < 0)
+            return -1;
+    }
+    else if (registry_load(worker->streams, index, stream) < 0) {
+        ms_log(1, "corrupt stream state [%s]\n", srcname); return -1;
+    }
+    t0 = stats_now();
+    stats_add(&worker->stats.stages[STATS_LOOKUP], t0 - t1);
+    state = &worker->state[index];
+
+    /*
+     * while a stream is catching up its minute files are only published once a later minute arrives, which leaves each
+     * written once, and it only leaves once well within the threshold so a stream near it does not keep changing over
+     */
+    worker->newest = msr_endtime(*ppmsr);
+    latency = stats_wallclock() - (double) MS_HPTIME2EPOCH((double) worker->newest);
+    if ((catchupint > 0) && ((state->catchup) ? (latency <= (double) catchupint / 2.0) : (latency > (double) catchupint))) {
+        state->catchup = !state->catchup;
+        atomic_fetch_add(&catchingup, (state->catchup) ? 1 : -1);
+        if (verbose)
+            ms_log(0, "%s: %s catch-up mode, data latency %.0fs\n", srcname, (state->catchup) ? "entering" : "leaving", latency);
+    }
+    worker->catchup = state->catchup;
+    if (worker->output) {
+        worker->output->hold = state->catchup;
+        worker->output->deadline = (worker->config->confs[state->conf].deadline >= 0) ? worker->config->confs[state->conf].deadline : deadline;
+    }
+
+    if (process_crex(*ppmsr, &worker->tidals[worker->config->confs[state->conf].model], stream, crexout_handler, &worker->crexout, &psamples, -1.0, (worker->catchup) ? 0 : verbose) < 0) {
+        ms_log (1, "error processing mseed block\n"); return -1;
+    }
+    if (registry_save(worker->streams, index, stream) < 0) {
+        ms_log(1, "memory error!\n"); return -1;
+    }
+    t1 = stats_now();
+    stats_add(&worker->stats.stages[STATS_PROCESS], t1 - t0);
+
+    /* late text goes into its minute file, which is patched in place if already published */
+    if ((*ppmsr)->starttime > state->latest)
+        state->latest = (*ppmsr)->starttime;
+    else
+        worker->stats.late++;
+    state->recent[state->nextrecent] = (*ppmsr)->starttime;
+    state->nextrecent = (state->nextrecent + 1) % RECENT_RECORDS;
+    if (state->nrecent < RECENT_RECORDS)
+        state->nrecent++;
+
+    stats_add(&worker->stats.latency, latency);
+    worker->stats.records++;
+
+    pthread_mutex_lock(&worker->lock);
+    streamstats = &state->stats;
+    streamstats->records++;
+    streamstats->process += t1 - t0;
+    streamstats->latency = latency;
+    if (latency > streamstats->maxlatency)
+        streamstats->maxlatency = latency;
+    pthread_mutex_unlock(&worker->lock);
+
+    if ((verbose) && (!worker->catchup) && (psamples > 0))
+         ms_log(0, "packed: %d samples\n", psamples);
+
+    return 0;
+}
+
+/* gather the worker streams and pending minute files into its own part of the snapshot, which is merged in once all are done */
+static void worker_checkpoint(worker_t *worker) {
+    gts_file_t *file;
+    char *state;
+    size_t len;
+    int n;
+
+    if (worker->output)
+        (void) gts_sync(worker->output);
+
+    /* the part is left alone until the snapshot is written, which is before the next mark is queued */
+    checkpoint_clear(&worker->part);
+    for (n = 0; n < registry_count(worker->streams); n++) {
+        if (((state = registry_packed(worker->streams, n, &len)) != NULL) && (checkpoint_stream(&worker->part, state, len) < 0))
+            ms_log(1, "memory error!\n");
+    }
+    for (n = 0; (worker->output) && (n < worker->output->nfiles); n++) {
+        file = &worker->output->files[n];
+        if ((file->minute != 0) && (!file->patch) && (checkpoint_pending(&worker->part, file->streamid, file->minute, gts_length(worker->output, file)) < 0))
+            ms_log(1, "memory error!\n");
+    }
+
+    pthread_mutex_lock(&snapshot_lock);
+    if (--snapshot_waiting == 0)
+        pthread_cond_signal(&snapshot_cond);
+    pthread_mutex_unlock(&snapshot_lock);
+}
+
+/* move the streams of a worker onto new settings, only restarting those whose fir filters have changed */
+static int worker_reload(worker_t *worker, streamconfig_t *config) {
+    crex_tidal_t *tidals;
+    crex_stream_t *stream;
+    streamconf_t *conf, *old;
+    double samprate;
+    int restarted = 0, updated = 0;
+    int index, n;
+    int rc = 0;
+
+    if ((tidals = config_tidals(config)) == NULL) {
+        atomic_fetch_sub(&reloading, 1); return -1;
+    }
+
+    /* also keeps the fir definitions steady while they are compared */
+    pthread_mutex_lock(&worker->lock);
+    stream = worker->stream;
+    for (index = 0; (index < registry_count(worker->streams)) && (index < worker->nstate); index++) {
+        if (registry_load(worker->streams, index, stream) < 0) {
+            rc = -1; continue;
+        }
+        old = &worker->config->confs[worker->state[index].conf];
+        worker->state[index].conf = streamconfig_match(config, stream->srcname);
+        conf = &config->confs[worker->state[index].conf];
+
+        if (stream_firs_changed(stream, conf)) {
+            for (samprate = stream->samprate, n = 0; n < stream->nfirs; n++)
+                samprate *= (double) stream->firs[n].decimate;
+            if (setup_stream(stream, samprate, conf) < 0)
+                rc = -1;
+            restarted++;
+        }
+        else if ((strncmp(stream->ctd.id, conf->tag, 24) != 0) || (stream->alpha != conf->alpha) || (stream->beta != conf->beta) ||
+            (memcmp(&old->tidal, &conf->tidal, sizeof(crex_tidal_t)) != 0)) {
+            strncpy(stream->ctd.id, conf->tag, 24);
+            stream->alpha = conf->alpha;
+            stream->beta = conf->beta;
+            updated++;
+        }
+        if (registry_save(worker->streams, index, stream) < 0)
+            rc = -1;
+    }
+    free(worker->tidals);
+    worker->tidals = tidals;
+    worker->config = config;
+    pthread_mutex_unlock(&worker->lock);
+
+    if (verbose)
+        ms_log(0, "worker %d: %d streams restarted with new filters, %d updated, %d unchanged\n",
+            worker->id, restarted, updated, registry_count(worker->streams) - restarted - updated);
+
+    /* once every worker has moved on the previous settings can go */
+    atomic_fetch_sub(&reloading, 1);
+
+    return rc;
+}
+
+/* copy the worker statistics for the metrics and reports */
+static void worker_share(worker_t *worker) {
+    pthread_mutex_lock(&worker->lock);
+    memcpy(&worker->shared, &worker->stats, sizeof(stats_t));
+    worker->decoded = worker->steim.decoded;
+    worker->fallback = worker->steim.fallback;
+    pthread_mutex_unlock(&worker->lock);
+}
+
+/* drain the worker queue until collection has stopped and nothing is left */
+static void *worker_thread(void *arg) {
+    worker_t *worker = (worker_t *) arg;
+    MSRecord *msr = NULL;
+    char record[RING_RECSIZE];
+    time_t now, expired = 0;
+    int failed = 0;
+
+    for (;;) {
+        if (ring_get(worker->ring, record) == 0) {
+            /* everything queued before the mark has been processed */
+            if (memcmp(record, CHECKPOINT_MARK, 8) == 0)
+                worker_checkpoint(worker);
+            else if (memcmp(record, STATE_MARK, 8) == 0)
+                atomic_fetch_sub(&servers[(unsigned char) record[8]].waiting, 1);
+            else if (memcmp(record, RELOAD_MARK, 8) == 0) {
+                if ((worker_reload(worker, streamconfig) < 0) && (!failed)) {
+                    terminate_servers(); failed = 1;
+                }
             }
-            fprintf(fp, "%s", samples);
-            fclose(fp);
-            if (rename(tmpfile, outfile) != 0) {
-                errsv = errno; ms_log(2, "failed to rename temporary file: %s - %s\n", outfile, strerror(errsv)); return;
+            /* stop collecting on errors, but keep draining so the connection thread never blocks */
+            else if ((!failed) && (process_record(worker, record, &msr) < 0)) {
+                terminate_servers(); failed = 1;
             }
         }
+        else if (!atomic_load(&collecting) && ring_empty(worker->ring)) {
+            break;
+        }
         else {
-            fprintf(stdout, "%s\n", samples);
+            /* woken by the next record, or in time to check the deadlines */
+            ring_wait(worker->ring, 1000);
+        }
+
+        /* publish minute files held past their deadline, which are in whole seconds so only checked once a second, and share the statistics */
+        if ((now = time(NULL)) != expired) {
+            if (worker->output)
+                (void) gts_expire(worker->output, now);
+            worker_share(worker);
+            expired = now;
         }
     }
+    worker_share(worker);
+
+    steim_release(&worker->steim, msr);
+    msr_free(&msr);
+
+    return NULL;
 }
 
-int main(int argc, char **argv) {
+/* merge in the part gathered by every worker, and write the snapshot */
+static void write_snapshot(worker_t *workers) {
     int n;
 
-	char buf[1024];
+    for (n = 0; n < nworkers; n++) {
+        if (checkpoint_merge(&snapshot, &workers[n].part) < 0) {
+            ms_log(1, "memory error!\n"); return;
+        }
+    }
+    (void) checkpoint_write(&snapshot, checkpointfile);
+}
 
-    char srcname[100];
-    crex_tidal_t tidal;
+/* write each snapshot once every worker has added to it */
+static void *checkpoint_thread(void *arg) {
+    worker_t *workers = (worker_t *) arg;
 
-    crex_stream_t *sp = NULL;
-    crex_stream_t *stream = NULL;
-    crex_stream_t *streams = NULL;
+    pthread_mutex_lock(&snapshot_lock);
+    for (;;) {
+        if ((snapshot_busy) && (snapshot_waiting == 0)) {
+            /* nothing else touches the snapshot, or the worker parts, until it is marked idle */
+            pthread_mutex_unlock(&snapshot_lock);
+            write_snapshot(workers);
+            pthread_mutex_lock(&snapshot_lock);
+            checkpoint_clear(&snapshot);
+            snapshot_busy = 0;
+        }
+        else if (snapshot_stop) {
+            break;
+        }
+        else {
+            pthread_cond_wait(&snapshot_cond, &snapshot_lock);
+        }
+    }
+    pthread_mutex_unlock(&snapshot_lock);
+
+    return NULL;
+}
+
+/* add the seedlink position of every server to the snapshot */
+static void checkpoint_servers(void) {
+    SLstream *curstream;
+    int n;
+
+    for (n = 0; n < nservers; n++) {
+        for (curstream = servers[n].slconn->streams; curstream != NULL; curstream = curstream->next) {
+            if (checkpoint_station(&snapshot, servers[n].slconn->sladdr, curstream->net, curstream->sta, curstream->seqnum, curstream->timestamp) < 0)
+                ms_log(1, "memory error!\n");
+        }
+    }
+}
+
+/* note the seedlink position, then queue a mark behind the records it covers, skipped if the last snapshot is still going */
+static void start_checkpoint(worker_t *workers) {
+    char mark[RING_RECSIZE];
+    int n;
+
+    pthread_mutex_lock(&snapshot_lock);
+    if (snapshot_busy) {
+        pthread_mutex_unlock(&snapshot_lock); return;
+    }
+    snapshot_busy = 1;
+    snapshot_waiting = nworkers;
+    checkpoint_servers();
+    pthread_mutex_unlock(&snapshot_lock);
+
+    memset(mark, 0, sizeof(mark));
+    memcpy(mark, CHECKPOINT_MARK, 8);
+    for (n = 0; n < nworkers; n++)
+        (void) ring_put(workers[n].ring, mark);
+}
+
+/* note the seedlink position of a server, then queue a mark behind the records it covers */
+static void start_savestate(worker_t *workers, int index) {
+    server_t *server = &servers[index];
+    server_position_t *positions;
+    SLstream *curstream;
+    char mark[RING_RECSIZE];
+    int n;
+
+    for (n = 0, curstream = server->slconn->streams; curstream != NULL; curstream = curstream->next, n++);
+    if (n > server->maxpositions) {
+        if ((positions = (server_position_t *) realloc(server->positions, n * sizeof(server_position_t))) == NULL) {
+            ms_log(1, "memory error!\n"); return;
+        }
+        server->positions = positions;
+        server->maxpositions = n;
+    }
+    for (n = 0, curstream = server->slconn->streams; curstream != NULL; curstream = curstream->next, n++) {
+        server->positions[n].seqnum = curstream->seqnum;
+        strncpy(server->positions[n].timestamp, curstream->timestamp, sizeof(server->positions[n].timestamp));
+    }
+    server->npositions = n;
+    server->saving = 1;
+    atomic_store(&server->waiting, nworkers);
+
+    memset(mark, 0, sizeof(mark));
+    memcpy(mark, STATE_MARK, 8);
+    mark[8] = (char) index;
+    for (n = 0; n < nworkers; n++)
+        (void) ring_put(workers[n].ring, mark);
+}
+
+/* once every worker has passed the mark, save the statefile of a server at the position noted then */
+static void finish_savestate(server_t *server) {
+    server_position_t current;
+    SLstream *curstream;
+    int n;
+
+    if ((!server->saving) || (atomic_load(&server->waiting) > 0))
+        return;
+
+    /* a new stream list since leaves the position for the next save */
+    if (server->npositions > 0) {
+        for (n = 0, curstream = server->slconn->streams; (curstream != NULL) && (n < server->npositions); curstream = curstream->next, n++) {
+            current.seqnum = curstream->seqnum;
+            strncpy(current.timestamp, curstream->timestamp, sizeof(current.timestamp));
+            curstream->seqnum = server->positions[n].seqnum;
+            strncpy(curstream->timestamp, server->positions[n].timestamp, sizeof(curstream->timestamp));
+            server->positions[n] = current;
+        }
+        sl_savestate (server->slconn, server->statefile);
+        for (n = 0, curstream = server->slconn->streams; (curstream != NULL) && (n < server->npositions); curstream = curstream->next, n++) {
+            curstream->seqnum = server->positions[n].seqnum;
+            strncpy(curstream->timestamp, server->positions[n].timestamp, sizeof(curstream->timestamp));
+        }
+    }
+    server->saving = 0;
+}
 
-    /* FIR filter config */
-    int nfirs = 0;
-    char *firnames[FIR_MAX_FILTERS];
+/* carry on from a snapshot, using its seedlink position and the stream state of any matching configuration */
+static void restore_checkpoint(worker_t *workers) {
+    checkpoint_t restored;
+    checkpoint_station_t *station;
+    crex_stream_t *stream;
+    size_t offset = 0;
+    SLstream *curstream;
+    streamconf_t *conf;
+    worker_t *worker;
+    int index;
+    int nstreams = 0;
+    int n, i;
+
+    memset(&restored, 0, sizeof(restored));
+    if (checkpoint_read(&restored, checkpointfile) < 0)
+        return;
+    stream = workers[0].stream;
+
+    for (n = 0; n < restored.nstations; n++) {
+        station = &restored.stations[n];
+        for (i = 0; i < nservers; i++) {
+            if (strcmp(servers[i].slconn->sladdr, station->server) != 0)
+                continue;
+            for (curstream = servers[i].slconn->streams; curstream != NULL; curstream = curstream->next) {
+                if ((strcmp(curstream->net, station->net) == 0) && (strcmp(curstream->sta, station->sta) == 0)) {
+                    curstream->seqnum = station->seqnum;
+                    strncpy(curstream->timestamp, station->timestamp, sizeof(curstream->timestamp) - 1);
+                }
+            }
+        }
+    }
+
+    /* the first worker's scratch stream is free until the workers start */
+    while (checkpoint_nextstream(&restored, &offset, stream) == 0) {
+        /* the filter history is only any use with the same filter definitions, as checked on a reload */
+        conf = &streamconfig->confs[streamconfig_match(streamconfig, stream->srcname)];
+        if (stream_firs_changed(stream, conf))
+            continue;
+
+        worker = &workers[srcname_worker(stream->srcname)];
+        if ((registry_lookup(worker->streams, stream->srcname) >= 0) || ((index = registry_insert(worker->streams, stream->srcname)) < 0))
+            continue;
+        if (worker_state(worker, index) < 0)
+            break;
+
+        strncpy(stream->ctd.id, conf->tag, 24);
+        stream->alpha = conf->alpha;
+        stream->beta = conf->beta;
+        if (registry_save(worker->streams, index, stream) < 0)
+            break;
+        worker->state[index].conf = (int) (conf - streamconfig->confs);
+        nstreams++;
+    }
+
+    for (n = 0; n < restored.npending; n++) {
+        worker = &workers[srcname_worker(restored.pending[n].streamid)];
+        if (worker->output)
+            (void) gts_resume(worker->output, restored.pending[n].streamid, restored.pending[n].minute, restored.pending[n].length);
+    }
+
+    if (verbose)
+        ms_log(0, "restored %d stations, %d of %d streams and %d pending minute files from %s\n",
+            restored.nstations, nstreams, restored.nstreams, restored.npending, checkpointfile);
+
+    checkpoint_free(&restored);
+}
+
+/* the command line settings, and any per-stream settings over them */
+static streamconfig_t *load_config(void) {
+    streamconfig_t *config;
+
+    if ((config = (streamconfig_t *) malloc(sizeof(streamconfig_t))) == NULL) {
+        ms_log(1, "memory error!\n"); return NULL;
+    }
+    if (streamconfig_init(config, tag, alpha, beta, &tidal, nfirs, firnames) < 0) {
+        ms_log(1, "memory error!\n"); free((char *) config); return NULL;
+    }
+    if ((configfile) && (streamconfig_load(config, configfile) < 0)) {
+        ms_log(1, "unable to load stream config [%s]\n", configfile);
+        streamconfig_free(config); free((char *) config); return NULL;
+    }
+    if (verbose)
+        ms_log(0, "%d stream settings share %d tidal models\n", config->nconfs, config->nmodels);
+
+    return config;
+}
+
+/* load the fir filter definitions if they are needed and the file has changed since they were last loaded */
+static int load_firs(streamconfig_t *config) {
+    struct stat st;
+    int n;
+
+    if (!streamconfig_firs(config))
+        return 0;
+    if (stat(firfile, &st) < 0)
+        st.st_mtime = 0;
+    else if (st.st_mtime == firloaded)
+        return 0;
+    if (firfilter_load(firfile) < 0) {
+        ms_log(1, "could not load fir filter file [%s]\n", firfile); return -1;
+    }
+    firloaded = st.st_mtime;
+    if (verbose)
+        ms_log(0, "loaded fir filters from %s\n", firfile);
+
+    return 0;
+}
+
+/* re-read the stream list of a server, keeping the position of its stations and only reconnecting when it has changed */
+static int reload_streams(server_t *server) {
+    SLCD *reread;
+    SLstream *curstream, *newstream, *streams;
+
+    if ((server->streams) || (streamfile == NULL))
+        return 0;
+    if ((reread = sl_newslcd()) == NULL) {
+        ms_log(1, "memory error!\n"); return -1;
+    }
+    if (sl_read_streamlist (reread, streamfile, selectors) < 0) {
+        ms_log(1, "unable to read streams [%s]\n", streamfile); sl_freeslcd(reread); return -1;
+    }
+
+    for (curstream = server->slconn->streams, newstream = reread->streams; (curstream != NULL) && (newstream != NULL); curstream = curstream->next, newstream = newstream->next) {
+        if ((strcmp(curstream->net, newstream->net) != 0) || (strcmp(curstream->sta, newstream->sta) != 0) ||
+            (strcmp((curstream->selectors) ? curstream->selectors : "", (newstream->selectors) ? newstream->selectors : "") != 0))
+            break;
+    }
+    if ((curstream == NULL) && (newstream == NULL)) {
+        sl_freeslcd(reread); return 0;
+    }
+
+    for (newstream = reread->streams; newstream != NULL; newstream = newstream->next) {
+        for (curstream = server->slconn->streams; curstream != NULL; curstream = curstream->next) {
+            if ((strcmp(curstream->net, newstream->net) == 0) && (strcmp(curstream->sta, newstream->sta) == 0)) {
+                newstream->seqnum = curstream->seqnum;
+                strncpy(newstream->timestamp, curstream->timestamp, sizeof(newstream->timestamp) - 1);
+            }
+        }
+    }
+
+    /* the old list goes with the temporary connection, the selection is only negotiated when connecting */
+    streams = server->slconn->streams;
+    server->slconn->streams = reread->streams;
+    server->npositions = 0;
+    reread->streams = streams;
+    sl_freeslcd(reread);
+    if (server->slconn->link != -1)
+        (void) sl_disconnect(server->slconn);
+
+    return 1;
+}
+
+/* apply any changed stream lists, fir filters and stream settings, leaving each worker to move its streams over */
+static void reload_config(worker_t *workers) {
+    firfilter_t fir;
+    streamconfig_t *config;
+    char mark[SLRECSIZE];
+    double t0 = stats_now();
+    int nchanged = 0;
+    int rc;
+    int n, i;
+
+    for (n = 0; n < nservers; n++) {
+        if (reload_streams(&servers[n]) > 0)
+            nchanged++;
+    }
+
+    if ((config = load_config()) == NULL) {
+        ms_log(1, "keeping the current stream settings\n"); return;
+    }
+
+    /* the fir definitions are only replaced while no worker can be looking them up */
+    for (n = 0; n < nworkers; n++)
+        pthread_mutex_lock(&workers[n].lock);
+    rc = load_firs(config);
+    for (n = 0; (rc == 0) && (n < config->nconfs); n++) {
+        for (i = 0; (rc == 0) && (i < config->confs[n].nfirs); i++) {
+            if ((rc = firfilter_find(config->confs[n].firnames[i], &fir)) < 0)
+                ms_log(1, "could not find fir filter [%s]\n", config->confs[n].firnames[i]);
+        }
+    }
+    for (n = 0; n < nworkers; n++)
+        pthread_mutex_unlock(&workers[n].lock);
+    if (rc < 0) {
+        ms_log(1, "keeping the current stream settings\n");
+        streamconfig_free(config); free((char *) config); return;
+    }
+
+    retired = streamconfig;
+    streamconfig = config;
+    atomic_store(&reloading, nworkers);
+
+    memset(mark, 0, sizeof(mark));
+    memcpy(mark, RELOAD_MARK, 8);
+    for (n = 0; n < nworkers; n++)
+        (void) ring_put(workers[n].ring, mark);
+
+    if (verbose)
+        ms_log(0, "reloaded %d stream settings and %d changed stream lists in %.3f ms\n", config->nconfs - 1, nchanged, 1000.0 * (stats_now() - t0));
+}
+
+/* write the aggregate and per stream statistics, atomically replacing any metrics file */
+static void write_metrics(worker_t *workers, stats_t *collect) {
+    char tmpfile[1024];
+    stats_t stats;
+    stats_stream_t *copies = NULL;
+    stats_stream_t **streamstats = NULL;
+    char **names = NULL;
+    FILE *fp = stderr;
+    int nstreams = 0;
+    int n, i;
+
+    memcpy(&stats, collect, sizeof(stats_t));
+    if (datalink)
+        stats.datalinkdropped = datalink_dropped(datalink);
+
+    /* streams may be added while this runs, so take a copy under each worker lock */
+    for (n = 0; n < nworkers; n++) {
+        pthread_mutex_lock(&workers[n].lock);
+        stats_merge(&stats, &workers[n].shared);
+        if (((names = (char **) realloc(names, (nstreams + registry_count(workers[n].streams) + 1) * sizeof(char *))) == NULL) ||
+            ((copies = (stats_stream_t *) realloc(copies, (nstreams + registry_count(workers[n].streams) + 1) * sizeof(stats_stream_t))) == NULL)) {
+            pthread_mutex_unlock(&workers[n].lock);
+            ms_log(1, "memory error!\n"); free(names); free(copies); return;
+        }
+        for (i = 0; (i < registry_count(workers[n].streams)) && (i < workers[n].nstate); i++, nstreams++) {
+            names[nstreams] = registry_name(workers[n].streams, i);
+            copies[nstreams] = workers[n].state[i].stats;
+        }
+        stats.streams += (unsigned long) registry_count(workers[n].streams);
+        stats.streambytes += (unsigned long) worker_bytes(&workers[n]);
+        pthread_mutex_unlock(&workers[n].lock);
+    }
+    if ((streamstats = (stats_stream_t **) calloc(nstreams + 1, sizeof(stats_stream_t *))) == NULL) {
+        ms_log(1, "memory error!\n"); free(names); free(copies); return;
+    }
+    for (n = 0; n < nstreams; n++)
+        streamstats[n] = &copies[n];
+
+    if (metricsfile) {
+        snprintf(tmpfile, sizeof(tmpfile), "%s.tmp", metricsfile);
+        if ((fp = fopen(tmpfile, "w")) == NULL) {
+            ms_log(2, "failed to open metrics file: %s - %s\n", tmpfile, strerror(errno));
+            free(names); free(copies); free(streamstats); return;
+        }
+    }
+
+    stats_write(fp, PROGRAM, &stats);
+    stats_write_streams(fp, PROGRAM, nstreams, names, streamstats);
+
+    if (metricsfile) {
+        fclose(fp);
+        if (rename(tmpfile, metricsfile) != 0)
+            ms_log(2, "failed to rename metrics file: %s - %s\n", metricsfile, strerror(errno));
+    }
+
+    free(names);
+    free(copies);
+    free(streamstats);
+}
+
+/* log queue occupancy and overflow handling for each worker */
+static void report_workers(worker_t *workers, stats_t *collect) {
+    stats_t stats;
+    ring_t *ring;
+    int n;
+
+    ms_log(0, "skipped %lu records (%lu bytes) before decoding\n", collect->skipped, collect->skippedbytes);
+
+    memset(&stats, 0, sizeof(stats_t));
+    for (n = 0; n < nworkers; n++) {
+        pthread_mutex_lock(&workers[n].lock);
+        stats_merge(&stats, &workers[n].shared);
+        pthread_mutex_unlock(&workers[n].lock);
+    }
+    ms_log(0, "sample to file: p50 %gs p99 %gs over %lu publications\n",
+        stats_quantile(&stats.published, 0.5), stats_quantile(&stats.published, 0.99), stats.published.count);
+    ms_log(0, "late records: %lu, published minute files patched %lu\n", stats.late, stats.patched);
+    if (datalink)
+        ms_log(0, "datalink: sent %lu records, dropped %lu\n", datalink->written, datalink_dropped(datalink));
+
+    for (n = 0; n < nworkers; n++) {
+        pthread_mutex_lock(&workers[n].lock);
+        stats.streams += (unsigned long) registry_count(workers[n].streams);
+        stats.streambytes += (unsigned long) worker_bytes(&workers[n]);
+        pthread_mutex_unlock(&workers[n].lock);
+    }
+    ms_log(0, "stream state: %lu streams in %lu bytes (%lu per stream, each crex stream %lu)\n", stats.streams, stats.streambytes,
+        (stats.streams > 0) ? stats.streambytes / stats.streams : 0UL, (unsigned long) sizeof(crex_stream_t));
+
+    for (n = 0; n < nworkers; n++) {
+        ring = workers[n].ring;
+        pthread_mutex_lock(&workers[n].lock);
+        ms_log(0, "worker %d: queued %lu/%lu (peak %lu) received %lu blocked %lu spooled %lu (pending %lu) dropped %lu steim %lu (libmseed %lu)\n", n,
+            (unsigned long) ring_count(ring), (unsigned long) ring->size, (unsigned long) ring->peak,
+            ring->received, ring->blocked, ring->spooled, (unsigned long) atomic_load(&ring->pending), ring->dropped,
+            workers[n].decoded, workers[n].fallback);
+        pthread_mutex_unlock(&workers[n].lock);
+    }
+}
+
+int main(int argc, char **argv) {
+    int n;
+
+    char spoolname[1024];
+    worker_t *worker = NULL;
+    worker_t *workers = NULL;
+    time_t report = 0;
+    time_t metrics = 0;
+    time_t checkpoint = 0;
+    pthread_t checkpointer;
+    server_t *server;
+    struct pollfd fds[MAX_SERVERS];
+    int nactive, nfds, idle;
+    char *extra[MAX_SERVERS];
+    int nextra = 0;
+    char *arg;
+    sigset_t sigs, oldsigs;
+
+    stats_t collect;
+    double received, queued;
 
-	MSRecord *msr = NULL;
 	SLpacket *slpack = NULL;
-	int packetcnt = 0;
-    int psamples = 0;
 
 	int rc;
 	int option_index = 0;
@@ -185,7 +1148,22 @@ int main(int argc, char **argv) {
 		{"streams", 1, 0, 'S'},
 		{"selectors", 1, 0, 's'},
 		{"statefile", 1, 0, 'x'},
+		{"server", 1, 0, 'a'},
 		{"update", 1, 0, 'u'},
+		{"cache", 1, 0, 'C'},
+		{"deadline", 1, 0, 'D'},
+		{"workers", 1, 0, 'j'},
+		{"queue", 1, 0, 'q'},
+		{"overflow", 1, 0, 'o'},
+		{"report", 1, 0, 'r'},
+		{"metrics", 1, 0, 'M'},
+		{"metrics-interval", 1, 0, 'm'},
+		{"catchup", 1, 0, 'c'},
+		{"checkpoint", 1, 0, 'P'},
+		{"checkpoint-interval", 1, 0, 'p'},
+		{"datalink", 1, 0, 'W'},
+		{"include", 1, 0, 'i'},
+		{"exclude", 1, 0, 'e'},
 		{"firfile", 1, 0, 'N'},
 		{"filter", 1, 0, 'F'},
 		{"tag", 1, 0, 'I'},
@@ -194,6 +1172,7 @@ int main(int argc, char **argv) {
 		{"latitude", 1, 0, 'L'},
 		{"zone", 1, 0, 'Z'},
 		{"tide", 1, 0, 'T'},
+		{"config", 1, 0, 'f'},
 		{0, 0, 0, 0}
 	};
 
@@ -205,13 +1184,18 @@ int main(int argc, char **argv) {
 	sigemptyset (&sa.sa_mask);
 	sigaction (SIGALRM, &sa, NULL);
 
+	sa.sa_handler = usr1_handler;
+	sigaction (SIGUSR1, &sa, NULL);
+
 	sa.sa_handler = term_handler;
 	sigaction (SIGINT, &sa, NULL);
 	sigaction (SIGQUIT, &sa, NULL);
 	sigaction (SIGTERM, &sa, NULL);
 
-	sa.sa_handler = SIG_IGN;
+	sa.sa_handler = hup_handler;
 	sigaction (SIGHUP, &sa, NULL);
+
+	sa.sa_handler = SIG_IGN;
 	sigaction (SIGPIPE, &sa, NULL);
 
 	/* adjust output logging ... -> syslog maybe? */
@@ -219,8 +1203,9 @@ int main(int argc, char **argv) {
 
 	/* get a new connection description */
 	slconn = sl_newslcd();
+	servers[nservers++].slconn = slconn;
 
-	while ((rc = getopt_long(argc, argv, "hvd:t:k:l:S:s:x:u:N:F:I:A:B:L:T:Z:", long_options, &option_index)) != EOF) {
+	while ((rc = getopt_long(argc, argv, "hvd:t:k:l:S:s:x:a:u:C:D:j:q:o:r:M:m:c:P:p:W:i:e:N:F:I:A:B:L:T:Z:f:", long_options, &option_index)) != EOF) {
 		switch(rc) {
 		case '?':
 			(void) fprintf(stderr, "usage: %s\n", program_usage);
@@ -239,7 +1224,22 @@ int main(int argc, char **argv) {
 			(void) fprintf(stderr, "\t-S --streams\talternative seedlink streams [%s]\n", (multiselect) ? multiselect : "<null>");
 			(void) fprintf(stderr, "\t-s --selectors\talternative seedlink selectors [%s]\n", (selectors) ? selectors : "<null>");
 			(void) fprintf(stderr, "\t-x --statefile\tseedlink statefile [%s]\n", (statefile) ? statefile : "<null>");
+			(void) fprintf(stderr, "\t-a --server\tadd another seedlink server, optionally with its own streams [<server>[=<streams>]]\n");
 			(void) fprintf(stderr, "\t-u --update\talternative state flush interval [%d]\n", stateint);
+			(void) fprintf(stderr, "\t-C --cache\tnumber of pending gts minute files [%d]\n", gtsfiles);
+			(void) fprintf(stderr, "\t-D --deadline\tseconds before publishing a pending gts minute file [%d]\n", deadline);
+			(void) fprintf(stderr, "\t-j --workers\tnumber of processing threads [%d]\n", nworkers);
+			(void) fprintf(stderr, "\t-q --queue\trecords queued for each processing thread [%d]\n", queuesize);
+			(void) fprintf(stderr, "\t-o --overflow\tspool full queues to this file rather than blocking [%s]\n", (spoolfile) ? spoolfile : "<null>");
+			(void) fprintf(stderr, "\t-r --report\tseconds between verbose queue reports [%d]\n", reportint);
+			(void) fprintf(stderr, "\t-M --metrics\twrite processing statistics to a prometheus text file [%s]\n", (metricsfile) ? metricsfile : "<null>");
+			(void) fprintf(stderr, "\t-m --metrics-interval\tseconds between metrics file updates [%d]\n", metricsint);
+			(void) fprintf(stderr, "\t-c --catchup\tstream data latency in seconds that starts catch-up mode, which ends within half of it, zero disables [%d]\n", catchupint);
+			(void) fprintf(stderr, "\t-P --checkpoint\tsnapshot the seedlink position and stream state to this file [%s]\n", (checkpointfile) ? checkpointfile : "<null>");
+			(void) fprintf(stderr, "\t-p --checkpoint-interval\tseconds between snapshots [%d]\n", checkpointint);
+			(void) fprintf(stderr, "\t-W --datalink\talso send CREX records to this datalink server [%s]\n", (datalinkaddr) ? datalinkaddr : "<null>");
+			(void) fprintf(stderr, "\t-i --include\tonly decode streams matching these srcname patterns [<all>]\n");
+			(void) fprintf(stderr, "\t-e --exclude\tnever decode streams matching these srcname patterns [<none>]\n");
             (void) fprintf(stderr, "\t-N --firfile\tprovide an alternative fir-filters file [%s]\n", firfile);
             (void) fprintf(stderr, "\t-F --filter\tadd a decimation firfilter\n");
             (void) fprintf(stderr, "\t-I --tag\tprovide CREX ID tag [%s]\n", tag);
@@ -248,6 +1248,7 @@ int main(int argc, char **argv) {
             (void) fprintf(stderr, "\t-L --latitude\tprovide reference latitude [%g]\n", latitude);
             (void) fprintf(stderr, "\t-Z --zone\tprovide reference time zone offet [%g]\n", zone);
             (void) fprintf(stderr, "\t-T --tide\tprovide tidal constants [<label>/<amplitude>/<lag>]\n");
+            (void) fprintf(stderr, "\t-f --config\tper-stream settings, overriding the above for matching srcnames [%s]\n", (configfile) ? configfile : "<null>");
 			exit(0); /*NOTREACHED*/
 		case 'v':
 			verbose++;
@@ -273,9 +1274,60 @@ int main(int argc, char **argv) {
 		case 'x':
 			statefile = optarg;
 			break;
+		case 'a':
+			if (nextra + 1 >= MAX_SERVERS) {
+				ms_log(1, "too many seedlink servers [%s]\n", optarg); exit(-1);
+			}
+			extra[nextra++] = optarg;
+			break;
 		case 'u':
 			stateint = atoi(optarg);
 			break;
+		case 'C':
+			gtsfiles = atoi(optarg);
+			break;
+		case 'D':
+			deadline = atoi(optarg);
+			break;
+		case 'j':
+			nworkers = (atoi(optarg) > 0) ? atoi(optarg) : 1;
+			break;
+		case 'q':
+			queuesize = atoi(optarg);
+			break;
+		case 'o':
+			spoolfile = optarg;
+			break;
+		case 'r':
+			reportint = atoi(optarg);
+			break;
+		case 'M':
+			metricsfile = optarg;
+			break;
+		case 'm':
+			metricsint = atoi(optarg);
+			break;
+		case 'c':
+			catchupint = atoi(optarg);
+			break;
+		case 'P':
+			checkpointfile = optarg;
+			break;
+		case 'p':
+			checkpointint = atoi(optarg);
+			break;
+		case 'W':
+			datalinkaddr = optarg;
+			break;
+		case 'i':
+		case 'e':
+			if ((filter == NULL) && ((filter = filter_new()) == NULL)) {
+				ms_log(1, "memory error!\n"); exit(-1);
+			}
+			if (filter_add(filter, optarg, (rc == 'e')) < 0) {
+				ms_log(1, "too many stream patterns [%s]\n", optarg); exit(-1);
+			}
+			break;
         case 'N':
             firfile = optarg;
             break;
@@ -306,6 +1358,9 @@ int main(int argc, char **argv) {
                 tidal.tides[tidal.num_tides].lag = atof(strtok(NULL, "/")) / 360.0;
                 tidal.num_tides++;
             }
+            break;
+        case 'f':
+            configfile = optarg;
             break;
 		}
 	}
@@ -321,134 +1376,299 @@ int main(int argc, char **argv) {
     tidal.zone = zone;
     tidal.latitude = latitude;
 
+    /* the command line settings, and any per-stream settings over them */
+    if ((streamconfig = load_config()) == NULL)
+        exit(-1);
+    if ((configfile) && (verbose))
+        ms_log(0, "loaded %d stream settings from %s\n", streamconfig->nconfs - 1, configfile);
+
     /* load the base firfilter definitions if required */
-    if ((nfirs > 0) && (firfilter_load(firfile) < 0)) {
-        ms_log(1, "could not load fir filter file [%s]\n", firfile); exit(-1);
-    }
+    if (load_firs(streamconfig) < 0)
+        exit(-1);
 
     slconn->sladdr = seedlink;
 
-	if (streamfile) {
-		if (sl_read_streamlist (slconn, streamfile, selectors) < 0) {
-		 ms_log(1, "unable to read streams [%s]\n", streamfile); exit(-1);
-		}
-	}
-	else if (multiselect) {
-		if (sl_parse_streamlist (slconn, multiselect, selectors) < 0) {
-			ms_log(1, "unable to load streams [%s]\n", multiselect); exit(-1);
-		}
-	}
-	else {
-		if (sl_setuniparams (slconn, selectors, -1, 0) < 0) {
-			ms_log(1, "unable to load selectors [%s]\n", selectors); exit(-1);
-		}
-	}
-
-	/* recover any statefile info ... */
-	if ((statefile) && (sl_recoverstate (slconn, statefile) < 0)) {
-		ms_log (1, "unable to recover statefile [%s]\n", statefile);
-	}
-
-	/* loop with the connection manager */
-	while (sl_collect (slconn, &slpack)) {
-		if (sl_packettype(slpack) != SLDATA)
-            continue;
-		
-		/* unpack record header and data samples */
-		if ((rc = msr_unpack (slpack->msrecord, SLRECSIZE, &msr, 1, 1)) != MS_NOERROR) {
-			sl_log(2, 0, "error parsing record\n");
-		}
+    /* any other servers share the connection settings */
+    for (n = 0; n < nextra; n++) {
+        server = &servers[nservers++];
+        if ((server->slconn = sl_newslcd()) == NULL) {
+            ms_log(1, "memory error!\n"); exit(-1);
+        }
+        server->slconn->netdly = slconn->netdly;
+        server->slconn->netto = slconn->netto;
+        server->slconn->keepalive = slconn->keepalive;
+        if ((arg = strchr(extra[n], '=')) != NULL) {
+            *arg++ = '\0'; server->streams = arg;
+        }
+        server->slconn->sladdr = extra[n];
+    }
 
-		if (verbose > 1)
-			msr_print(msr, (verbose > 2) ? 1 : 0);
-        msr_srcname(msr, srcname, 0);
-        for (stream = streams; stream != NULL; stream = stream->next) {
-            if (strcmp(stream->srcname, srcname) == 0)
-                break;
+    for (n = 0; n < nservers; n++) {
+        server = &servers[n];
+        if (server->streams) {
+            if (sl_parse_streamlist (server->slconn, server->streams, selectors) < 0) {
+                ms_log(1, "unable to load streams [%s]\n", server->streams); exit(-1);
+            }
         }
-        if (stream == NULL) {
-            if ((stream = (crex_stream_t *) malloc(sizeof(crex_stream_t))) == NULL) {
-                ms_log(1, "memory error!\n"); exit(-1);
+        else if (streamfile) {
+            if (sl_read_streamlist (server->slconn, streamfile, selectors) < 0) {
+                ms_log(1, "unable to read streams [%s]\n", streamfile); exit(-1);
             }
-            memset(stream, 0, sizeof(crex_stream_t));
-            strcpy(stream->srcname, srcname);
-
-            /* Insert passed ctd values. */
-            strncpy(stream->ctd.id, tag, 24);
-
-            stream->alpha = alpha;
-            stream->beta = beta;
-
-            /* Insert default ctd values. */
-            stream->ctd.time = 0;
-            stream->ctd.temp = -1;
-            stream->ctd.autoQC = 11;
-            stream->ctd.manualQC = 7;
-            stream->ctd.offset = 0;
-            stream->ctd.increment = 1;
-
-            /* reset the CREX data arrays */
-            for (n = 0; n < CREX_BUF_SIZE; n++) {
-                stream->ctd.mes[n] = CREX_NO_DATA;
-                stream->ctd.res[n] = CREX_NO_DATA;
+        }
+        else if (multiselect) {
+            if (sl_parse_streamlist (server->slconn, multiselect, selectors) < 0) {
+                ms_log(1, "unable to load streams [%s]\n", multiselect); exit(-1);
             }
+        }
+        else {
+            if (sl_setuniparams (server->slconn, selectors, -1, 0) < 0) {
+                ms_log(1, "unable to load selectors [%s]\n", selectors); exit(-1);
+            }
+        }
 
-            /* and the fir filters themselves */
-            stream->nfirs = nfirs;
-            for (n = 0; n < stream->nfirs; n++) {
-                if (firfilter_find(firnames[n], &stream->firs[n]) < 0) {
-                    ms_log(1, "could not find fir filter [%s]\n", firnames[n]); exit(-1);
-                }
+        /* recover any statefile info, each extra server has its own */
+        if (statefile) {
+            if (n > 0)
+                snprintf(server->statefile, sizeof(server->statefile), "%s.%d", statefile, n);
+            else
+                snprintf(server->statefile, sizeof(server->statefile), "%s", statefile);
+            if (sl_recoverstate (server->slconn, server->statefile) < 0)
+                ms_log (1, "unable to recover statefile [%s]\n", server->statefile);
+        }
+        server->active = 1;
+    }
+
+    /* the datalink sender has a queue for each worker */
+    if (datalinkaddr) {
+        dl_loginit(verbose, log_print, program_prefix, err_print, program_prefix);
+        if ((datalink = datalink_new(datalinkaddr, program_name, nworkers, queuesize, spoolfile)) == NULL) {
+            ms_log(1, "unable to set up datalink output [%s]\n", datalinkaddr); exit(-1);
+        }
+    }
+
+    /* processing threads, each owning the streams hashed to it */
+    if ((workers = (worker_t *) calloc(nworkers, sizeof(worker_t))) == NULL) {
+        ms_log(1, "memory error!\n"); exit(-1);
+    }
+    for (n = 0; n < nworkers; n++) {
+        worker = &workers[n];
+        worker->id = n;
+        worker->config = streamconfig;
+        if ((worker->tidals = config_tidals(streamconfig)) == NULL)
+            exit(-1);
+        worker->crexout.text_handler = text_handler;
+        if (datalinkaddr)
+            worker->crexout.record_handler = record_handler;
+        worker->crexout.extra = worker;
+        if (spoolfile)
+            snprintf(spoolname, sizeof(spoolname), "%s.%d", spoolfile, n);
+        if ((worker->ring = ring_new(queuesize, RING_RECSIZE, (spoolfile) ? spoolname : NULL)) == NULL) {
+            ms_log(1, "unable to create worker queue [%d]\n", n); exit(-1);
+        }
+        if (((worker->streams = registry_new(0)) == NULL) || ((worker->stream = (crex_stream_t *) malloc(sizeof(crex_stream_t))) == NULL)) {
+            ms_log(1, "memory error!\n"); exit(-1);
+        }
+        /* buffered minute files, otherwise records go to stdout */
+        if ((gts) && ((worker->output = gts_new(gts, gtsfiles, deadline)) == NULL)) {
+            ms_log(1, "memory error!\n"); exit(-1);
+        }
+        /* text for a minute already published, late or from before a restart, is merged into its file */
+        if (worker->output) {
+            worker->output->stats = &worker->stats;
+            worker->output->merge = 1;
+        }
+        pthread_mutex_init(&worker->lock, NULL);
+    }
+    memset(&collect, 0, sizeof(stats_t));
+
+    /* a snapshot overrides the statefile, as it matches the stream state */
+    if (checkpointfile)
+        restore_checkpoint(workers);
+
+    /* non-data records are always skipped, even without any patterns */
+    if ((filter == NULL) && ((filter = filter_new()) == NULL)) {
+        ms_log(1, "memory error!\n"); exit(-1);
+    }
+
+    /* signals are left to the collection thread */
+    sigfillset(&sigs);
+    pthread_sigmask(SIG_BLOCK, &sigs, &oldsigs);
+    for (n = 0; n < nworkers; n++) {
+        if (pthread_create(&workers[n].thread, NULL, worker_thread, &workers[n]) != 0) {
+            ms_log(1, "unable to start worker [%d]\n", n); exit(-1);
+        }
+    }
+    if ((datalink) && (datalink_start(datalink) < 0)) {
+        ms_log(1, "unable to start datalink sender\n"); exit(-1);
+    }
+    if ((checkpointfile) && (pthread_create(&checkpointer, NULL, checkpoint_thread, workers) != 0)) {
+        ms_log(1, "unable to start checkpoint thread\n"); exit(-1);
+    }
+    pthread_sigmask(SIG_SETMASK, &oldsigs, NULL);
+
+	/* loop over the server connections, only queueing the records */
+    nactive = nservers;
+    while (nactive > 0) {
+        idle = 1;
+        for (n = 0; n < nservers; n++) {
+            server = &servers[n];
+            if (!server->active)
+                continue;
+
+            received = stats_now();
+            if ((rc = sl_collect_nb (server->slconn, &slpack)) == SLTERMINATE) {
+                server->active = 0; nactive--; continue;
             }
+            if (rc != SLPACKET)
+                continue;
+            idle = 0;
+
+            queued = stats_now();
+            stats_add(&collect.stages[STATS_RECEIVE], queued - received);
 
-            stream->delay = 0LL;
-            stream->samprate = msr->samprate;
-            for (n = 0; n < stream->nfirs; n++) {
-                stream->delay -= (hptime_t) MS_EPOCH2HPTIME(((stream->firs[n].minimum) ? 0.0 : ((double) stream->firs[n].length / 2.0 - 0.5) / stream->samprate));
-                stream->samprate /= (double) stream->firs[n].decimate;
+            if (sl_packettype(slpack) != SLDATA)
+                continue;
+
+            /* only wanted data records are queued, and so decoded */
+            if (filter_record(filter, slpack->msrecord, SLRECSIZE)) {
+                (void) ring_put(workers[record_worker(slpack->msrecord)].ring, slpack->msrecord);
+                stats_add(&collect.stages[STATS_QUEUE], stats_now() - queued);
+            }
+            else {
+                collect.skipped++;
+                collect.skippedbytes += SLRECSIZE;
             }
 
-            if (streams != NULL) {
-                stream->next = streams;
+            /* Save intermediate state files, less often while backfilling, unless snapshots replace them */
+            if (statefile && stateint && !checkpointfile) {
+                if (++server->packetcnt >= ((atomic_load(&catchingup) > 0) ? CATCHUP_STATE * stateint : stateint)) {
+                    if (!server->saving)
+                        start_savestate(workers, n);
+                    server->packetcnt = 0;
+                }
             }
+        }
+
+        /* the records covered by a save have all been processed */
+        for (n = 0; n < nservers; n++)
+            finish_savestate(&servers[n]);
 
-            streams = stream;
+        /* periodic, or requested, statistics */
+        if ((dumpstats) || ((metricsfile) && (metricsint > 0) && (time(NULL) >= metrics))) {
+            write_metrics(workers, &collect);
+            metrics = time(NULL) + metricsint;
+            dumpstats = 0;
         }
 
-        if (process_crex(msr, &tidal, stream, record_handler, NULL, &psamples, -1.0, verbose) < 0) {
-            ms_log (1, "error processing mseed block\n"); break;
+        if ((verbose) && (reportint > 0) && (time(NULL) >= report)) {
+            if (report > 0)
+                report_workers(workers, &collect);
+            report = time(NULL) + reportint;
         }
 
-        if ((verbose) && (psamples > 0))
-             ms_log(0, "packed: %d samples\n", psamples);
+        /* new settings, once every worker has moved off any previous ones */
+        if ((retired) && (atomic_load(&reloading) == 0)) {
+            streamconfig_free(retired); free((char *) retired); retired = NULL;
+        }
+        if ((reload) && (retired == NULL)) {
+            reload = 0;
+            reload_config(workers);
+        }
 
-		/* done with it */
-		msr_free(&msr);
+        if ((checkpointfile) && (checkpointint > 0) && (time(NULL) >= checkpoint)) {
+            if (checkpoint > 0)
+                start_checkpoint(workers);
+            checkpoint = time(NULL) + checkpointint;
+        }
 
-		/* Save intermediate state files */
-		if (statefile && stateint) {
-			if (++packetcnt >= stateint) {
-				sl_savestate (slconn, statefile);
-				packetcnt = 0;
-			}
-		}
-	}
+        /* wait for any connected server, reconnections and keep alives are handled on the next pass */
+        if ((idle) && (nactive > 0)) {
+            for (n = 0, nfds = 0; n < nservers; n++) {
+                if ((servers[n].active) && (servers[n].slconn->link >= 0)) {
+                    fds[nfds].fd = servers[n].slconn->link;
+                    fds[nfds].events = POLLIN;
+                    fds[nfds++].revents = 0;
+                }
+            }
+            (void) poll(fds, nfds, SERVER_POLL);
+        }
+    }
 
 	/* closing down */
 	if (verbose)
 		ms_log (0, "stopping\n");
 
-	if (statefile && slconn->terminate)
-		(void) sl_savestate (slconn, statefile);
+    for (n = 0; n < nservers; n++) {
+        if (servers[n].slconn->link != -1)
+            (void) sl_disconnect (servers[n].slconn);
+    }
+
+    /* let the workers drain their queues */
+    atomic_store(&collecting, 0);
+    for (n = 0; n < nworkers; n++)
+        ring_wake(workers[n].ring);
+    for (n = 0; n < nworkers; n++)
+        pthread_join(workers[n].thread, NULL);
 
-	if (slconn->link != -1)
-		(void) sl_disconnect (slconn);
+    /* only once everything received has been processed */
+    for (n = 0; n < nservers; n++) {
+        if (statefile && servers[n].slconn->terminate)
+            (void) sl_savestate (servers[n].slconn, servers[n].statefile);
+        free((char *) servers[n].positions);
+    }
+
+    /* a final snapshot once everything has been processed */
+    if (checkpointfile) {
+        pthread_mutex_lock(&snapshot_lock);
+        snapshot_stop = 1;
+        pthread_cond_signal(&snapshot_cond);
+        pthread_mutex_unlock(&snapshot_lock);
+        pthread_join(checkpointer, NULL);
 
-    stream = streams;
-    while (stream != NULL) {
-        sp = stream; stream = stream->next;
-        free((char *) sp);
+        checkpoint_clear(&snapshot);
+        snapshot_busy = 1;
+        snapshot_waiting = nworkers;
+        checkpoint_servers();
+        for (n = 0; n < nworkers; n++)
+            worker_checkpoint(&workers[n]);
+        write_snapshot(workers);
+        checkpoint_free(&snapshot);
+    }
+
+    /* send anything still queued for the datalink server */
+    if (datalink) {
+        datalink_stop(datalink);
+        collect.datalinkdropped = datalink_dropped(datalink);
+        if (verbose)
+            ms_log(0, "datalink: %lu records in %lu batches, %lu connections, %lu without text, %lu dropped\n",
+                datalink->written, datalink->batches, datalink->connects, datalink->skipped, collect.datalinkdropped);
+        datalink_free(datalink);
+        datalink = NULL;
+    }
+
+    if (verbose)
+        report_workers(workers, &collect);
+    if (metricsfile)
+        write_metrics(workers, &collect);
+
+    for (n = 0; n < nworkers; n++) {
+        gts_free(workers[n].output);
+        registry_free(workers[n].streams);
+        free((char *) workers[n].stream);
+        ring_free(workers[n].ring);
+        free(workers[n].state);
+        free(workers[n].tidals);
+        steim_free(&workers[n].steim);
+        checkpoint_free(&workers[n].part);
+        pthread_mutex_destroy(&workers[n].lock);
+    }
+    free((char *) workers);
+    filter_free(filter);
+    if (retired) {
+        streamconfig_free(retired); free((char *) retired);
     }
+    streamconfig_free(streamconfig);
+    free((char *) streamconfig);
 
 	/* closing down */
 	if (verbose)
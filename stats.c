@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/* system includes */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+
+static char *stats_stages[STATS_STAGES] = {
+    "receive", "queue", "unpack", "lookup", "process", "open", "write", "rename"
+};
+
+/* monotonic clock, in seconds */
+double stats_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1.0e9;
+}
+
+/* real time clock, in seconds, for comparing with sample times */
+double stats_wallclock(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1.0e9;
+}
+
+/* upper bound of the bucket holding the given quantile, zero if empty */
+double stats_quantile(stats_hist_t *hist, double q) {
+    unsigned long count = 0;
+    double limit = 1.0e-6;
+    int n;
+
+    if (hist->count == 0)
+        return 0.0;
+
+    for (n = 0; n < STATS_BUCKETS; n++, limit *= 2.0) {
+        count += hist->buckets[n];
+        if ((double) count >= q * (double) hist->count)
+            return limit;
+    }
+
+    return limit;
+}
+
+void stats_add(stats_hist_t *hist, double seconds) {
+    double limit = 1.0e-6;
+    int n;
+
+    for (n = 0; (n < STATS_BUCKETS) && (seconds > limit); n++)
+        limit *= 2.0;
+    if (n < STATS_BUCKETS)
+        hist->buckets[n]++;
+
+    hist->count++;
+    hist->sum += seconds;
+}
+
+static void stats_merge_hist(stats_hist_t *hist, stats_hist_t *from) {
+    int n;
+
+    hist->count += from->count;
+    hist->sum += from->sum;
+    for (n = 0; n < STATS_BUCKETS; n++)
+        hist->buckets[n] += from->buckets[n];
+}
+
+void stats_merge(stats_t *stats, stats_t *from) {
+    int n;
+
+    stats->records += from->records;
+    stats->skipped += from->skipped;
+    stats->skippedbytes += from->skippedbytes;
+    stats->duplicates += from->duplicates;
+    stats->late += from->late;
+    stats->patched += from->patched;
+    stats->datalinkdropped += from->datalinkdropped;
+    stats->streams += from->streams;
+    stats->streambytes += from->streambytes;
+    for (n = 0; n < STATS_STAGES; n++)
+        stats_merge_hist(&stats->stages[n], &from->stages[n]);
+    stats_merge_hist(&stats->latency, &from->latency);
+    stats_merge_hist(&stats->published, &from->published);
+}
+
+static void stats_write_hist(FILE *fp, char *name, char *label, stats_hist_t *hist) {
+    unsigned long count = 0;
+    double limit = 1.0e-6;
+    int n;
+
+    for (n = 0; n < STATS_BUCKETS; n++, limit *= 2.0) {
+        count += hist->buckets[n];
+        fprintf(fp, "%s_bucket{%s%sle=\"%g\"} %lu\n", name, label, (*label) ? "," : "", limit, count);
+    }
+    fprintf(fp, "%s_bucket{%s%sle=\"+Inf\"} %lu\n", name, label, (*label) ? "," : "", hist->count);
+    fprintf(fp, "%s_sum%s%s%s %.9f\n", name, (*label) ? "{" : "", label, (*label) ? "}" : "", hist->sum);
+    fprintf(fp, "%s_count%s%s%s %lu\n", name, (*label) ? "{" : "", label, (*label) ? "}" : "", hist->count);
+}
+
+/* aggregate counters and histograms */
+void stats_write(FILE *fp, char *prefix, stats_t *stats) {
+    char name[128];
+    char label[64];
+    int n;
+
+    fprintf(fp, "# HELP %s_records_total Data records processed.\n", prefix);
+    fprintf(fp, "# TYPE %s_records_total counter\n", prefix);
+    fprintf(fp, "%s_records_total %lu\n", prefix, stats->records);
+
+    fprintf(fp, "# HELP %s_skipped_records_total Records dropped by the header checks before decoding.\n", prefix);
+    fprintf(fp, "# TYPE %s_skipped_records_total counter\n", prefix);
+    fprintf(fp, "%s_skipped_records_total %lu\n", prefix, stats->skipped);
+    fprintf(fp, "# HELP %s_skipped_bytes_total Bytes dropped by the header checks before decoding.\n", prefix);
+    fprintf(fp, "# TYPE %s_skipped_bytes_total counter\n", prefix);
+    fprintf(fp, "%s_skipped_bytes_total %lu\n", prefix, stats->skippedbytes);
+    fprintf(fp, "# HELP %s_duplicate_records_total Records dropped as already received from another server.\n", prefix);
+    fprintf(fp, "# TYPE %s_duplicate_records_total counter\n", prefix);
+    fprintf(fp, "%s_duplicate_records_total %lu\n", prefix, stats->duplicates);
+    fprintf(fp, "# HELP %s_late_records_total Records starting before the newest already processed for their stream.\n", prefix);
+    fprintf(fp, "# TYPE %s_late_records_total counter\n", prefix);
+    fprintf(fp, "%s_late_records_total %lu\n", prefix, stats->late);
+    fprintf(fp, "# HELP %s_patched_files_total Published minute files rewritten to merge in late text.\n", prefix);
+    fprintf(fp, "# TYPE %s_patched_files_total counter\n", prefix);
+    fprintf(fp, "%s_patched_files_total %lu\n", prefix, stats->patched);
+    fprintf(fp, "# HELP %s_datalink_dropped_records_total Records dropped as the datalink sender had fallen behind.\n", prefix);
+    fprintf(fp, "# TYPE %s_datalink_dropped_records_total counter\n", prefix);
+    fprintf(fp, "%s_datalink_dropped_records_total %lu\n", prefix, stats->datalinkdropped);
+
+    fprintf(fp, "# HELP %s_streams Streams with conversion state held.\n", prefix);
+    fprintf(fp, "# TYPE %s_streams gauge\n", prefix);
+    fprintf(fp, "%s_streams %lu\n", prefix, stats->streams);
+    fprintf(fp, "# HELP %s_stream_state_bytes Memory allocated for the conversion state of every stream.\n", prefix);
+    fprintf(fp, "# TYPE %s_stream_state_bytes gauge\n", prefix);
+    fprintf(fp, "%s_stream_state_bytes %lu\n", prefix, stats->streambytes);
+
+    snprintf(name, sizeof(name), "%s_stage_seconds", prefix);
+    fprintf(fp, "# HELP %s Time spent in each processing stage.\n", name);
+    fprintf(fp, "# TYPE %s histogram\n", name);
+    for (n = 0; n < STATS_STAGES; n++) {
+        snprintf(label, sizeof(label), "stage=\"%s\"", stats_stages[n]);
+        stats_write_hist(fp, name, label, &stats->stages[n]);
+    }
+
+    snprintf(name, sizeof(name), "%s_data_latency_seconds", prefix);
+    fprintf(fp, "# HELP %s Wall clock less the end time of each record.\n", name);
+    fprintf(fp, "# TYPE %s histogram\n", name);
+    stats_write_hist(fp, name, "", &stats->latency);
+
+    snprintf(name, sizeof(name), "%s_sample_to_file_seconds", prefix);
+    fprintf(fp, "# HELP %s Wall clock at each minute file publication less the oldest sample behind it.\n", name);
+    fprintf(fp, "# TYPE %s histogram\n", name);
+    stats_write_hist(fp, name, "", &stats->published);
+}
+
+/* per stream counters, grouped by metric */
+void stats_write_streams(FILE *fp, char *prefix, int nstreams, char **names, stats_stream_t **streams) {
+    int n;
+
+    fprintf(fp, "# HELP %s_stream_records_total Data records processed for each stream.\n", prefix);
+    fprintf(fp, "# TYPE %s_stream_records_total counter\n", prefix);
+    for (n = 0; n < nstreams; n++)
+        fprintf(fp, "%s_stream_records_total{stream=\"%s\"} %lu\n", prefix, names[n], streams[n]->records);
+
+    fprintf(fp, "# HELP %s_stream_process_seconds_total Time spent converting each stream.\n", prefix);
+    fprintf(fp, "# TYPE %s_stream_process_seconds_total counter\n", prefix);
+    for (n = 0; n < nstreams; n++)
+        fprintf(fp, "%s_stream_process_seconds_total{stream=\"%s\"} %.9f\n", prefix, names[n], streams[n]->process);
+
+    fprintf(fp, "# HELP %s_stream_latency_seconds Data latency of the most recent record for each stream.\n", prefix);
+    fprintf(fp, "# TYPE %s_stream_latency_seconds gauge\n", prefix);
+    for (n = 0; n < nstreams; n++)
+        fprintf(fp, "%s_stream_latency_seconds{stream=\"%s\"} %.6f\n", prefix, names[n], streams[n]->latency);
+
+    fprintf(fp, "# HELP %s_stream_latency_max_seconds Largest data latency seen for each stream.\n", prefix);
+    fprintf(fp, "# TYPE %s_stream_latency_max_seconds gauge\n", prefix);
+    for (n = 0; n < nstreams; n++)
+        fprintf(fp, "%s_stream_latency_max_seconds{stream=\"%s\"} %.6f\n", prefix, names[n], streams[n]->maxlatency);
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <stdio.h>
+
+/*
+ * stats: low overhead counters and power of two histograms of processing times
+ *
+ * Times come from the monotonic clock and are kept in seconds, histogram buckets double
+ * from one microsecond. Output is in the Prometheus text exposition format.
+ */
+
+#define STATS_BUCKETS 32 /* 1us up to about 35 minutes */
+
+enum {
+    STATS_RECEIVE, /* waiting on the seedlink socket */
+    STATS_QUEUE, /* handing records to a processing thread */
+    STATS_UNPACK,
+    STATS_LOOKUP,
+    STATS_PROCESS,
+    STATS_OPEN, /* gts minute file handling */
+    STATS_WRITE,
+    STATS_RENAME,
+    STATS_STAGES
+};
+
+typedef struct stats_hist_s {
+    unsigned long count;
+    double sum;
+    unsigned long buckets[STATS_BUCKETS];
+} stats_hist_t;
+
+typedef struct stats_s {
+    unsigned long records;
+    unsigned long skipped; /* records dropped before decoding */
+    unsigned long skippedbytes;
+    unsigned long duplicates; /* records already received from another server */
+    unsigned long late; /* records starting before the newest already processed for their stream */
+    unsigned long patched; /* published minute files rewritten with late text */
+    unsigned long datalinkdropped; /* records neither queued nor spooled for the datalink sender */
+    unsigned long streams; /* stream state held, a gauge set when written */
+    unsigned long streambytes;
+    stats_hist_t stages[STATS_STAGES];
+    stats_hist_t latency; /* wall clock less the sample end time */
+    stats_hist_t published; /* wall clock at publishing less the oldest sample in the file */
+} stats_t;
+
+/* kept for every stream, so only counters, the histograms are for all streams together */
+typedef struct stats_stream_s {
+    unsigned long records;
+    double process; /* seconds in process_crex */
+    double latency; /* most recent data latency */
+    double maxlatency;
+} stats_stream_t;
+
+extern double stats_now(void);
+extern double stats_wallclock(void);
+
+extern double stats_quantile(stats_hist_t *hist, double q);
+extern void stats_add(stats_hist_t *hist, double seconds);
+extern void stats_merge(stats_t *stats, stats_t *from);
+
+extern void stats_write(FILE *fp, char *prefix, stats_t *stats);
+extern void stats_write_streams(FILE *fp, char *prefix, int nstreams, char **names, stats_stream_t **streams);
+
+#endif /* _STATS_H */
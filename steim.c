@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/* system includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+/* libmseed library includes */
+#include <libmseed.h>
+
+#include "steim.h"
+
+#define STEIM_FRAME 64 /* bytes */
+
+static inline uint32_t steim_word(unsigned char *p, int bigendian) {
+    return (bigendian) ? ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | (uint32_t) p[3]
+        : ((uint32_t) p[3] << 24) | ((uint32_t) p[2] << 16) | ((uint32_t) p[1] << 8) | (uint32_t) p[0];
+}
+
+/* sign extend the low bits of a word */
+static inline int32_t steim_signed(uint32_t w, int bits) {
+    return (int32_t) (w << (32 - bits)) >> (32 - bits);
+}
+
+/* unpack count differences of the given width, most significant first */
+static inline int steim_diffs(int32_t *diffs, uint32_t w, int count, int bits) {
+    int n;
+
+    for (n = 0; n < count; n++)
+        diffs[n] = steim_signed(w >> ((count - n - 1) * bits), bits);
+
+    return count;
+}
+
+/* decode the differences in the data frames, returning how many were found or -1 for a bad frame */
+static int steim_frames(unsigned char *data, int nframes, int steim2, int bigendian, int32_t *diffs, int limit, int32_t *x0, int32_t *xn) {
+    int32_t d[7];
+    uint32_t ctrl, w;
+    int ndiffs = 0;
+    int frame, n, i, count;
+
+    for (frame = 0; (frame < nframes) && (ndiffs < limit); frame++, data += STEIM_FRAME) {
+        ctrl = steim_word(data, bigendian);
+        for (n = 1; n < 16; n++) {
+            w = steim_word(data + 4 * n, bigendian);
+
+            /* integration constants */
+            if ((frame == 0) && (n == 1)) {
+                *x0 = (int32_t) w; continue;
+            }
+            if ((frame == 0) && (n == 2)) {
+                *xn = (int32_t) w; continue;
+            }
+
+            switch ((ctrl >> (30 - 2 * n)) & 0x03) {
+            case 0:
+                continue;
+            case 1:
+                count = steim_diffs(d, w, 4, 8);
+                break;
+            case 2:
+                if (!steim2) {
+                    count = steim_diffs(d, w, 2, 16); break;
+                }
+                switch (w >> 30) {
+                case 1: count = steim_diffs(d, w, 1, 30); break;
+                case 2: count = steim_diffs(d, w, 2, 15); break;
+                case 3: count = steim_diffs(d, w, 3, 10); break;
+                default: return -1;
+                }
+                break;
+            default:
+                if (!steim2) {
+                    count = steim_diffs(d, w, 1, 32); break;
+                }
+                switch (w >> 30) {
+                case 0: count = steim_diffs(d, w, 5, 6); break;
+                case 1: count = steim_diffs(d, w, 6, 5); break;
+                case 2: count = steim_diffs(d, w, 7, 4); break;
+                default: return -1;
+                }
+                break;
+            }
+
+            for (i = 0; (i < count) && (ndiffs < limit); i++)
+                diffs[ndiffs++] = d[i];
+        }
+    }
+
+    return ndiffs;
+}
+
+/* decode a steim record into the buffer, returning the number of samples or -1 */
+static int steim_decode(steim_t *steim, MSRecord *msr) {
+    int32_t *samples;
+    int32_t x0 = 0, xn = 0;
+    int nsamples = (int) msr->samplecnt;
+    int offset, nframes;
+    int n;
+
+    if ((msr->fsdh == NULL) || (nsamples <= 0))
+        return -1;
+
+    offset = msr->fsdh->data_offset;
+    if ((offset < 48) || (offset >= msr->reclen))
+        return -1;
+    nframes = (msr->reclen - offset) / STEIM_FRAME;
+
+    if (nsamples > steim->size) {
+        if ((samples = (int32_t *) realloc(steim->samples, nsamples * sizeof(int32_t))) == NULL)
+            return -1;
+        steim->samples = samples;
+        steim->size = nsamples;
+    }
+    samples = steim->samples;
+
+    if (steim_frames((unsigned char *) msr->record + offset, nframes, (msr->encoding == DE_STEIM2), (msr->byteorder != 0),
+            samples, nsamples, &x0, &xn) != nsamples)
+        return -1;
+
+    /* the first difference is relative to the previous record, so rebuild from the forward constant */
+    samples[0] = x0;
+    for (n = 1; n < nsamples; n++)
+        samples[n] = (int32_t) ((uint32_t) samples[n - 1] + (uint32_t) samples[n]);
+
+    /* the reverse constant checks the whole record */
+    if (samples[nsamples - 1] != xn)
+        return -1;
+
+    return nsamples;
+}
+
+/* unpack a record, decoding any steim samples into the reusable buffer */
+int steim_unpack(steim_t *steim, char *record, int reclen, MSRecord **ppmsr, flag verbose) {
+    int nsamples;
+    int rc;
+
+    steim_release(steim, *ppmsr);
+    if ((rc = msr_unpack(record, reclen, ppmsr, 0, verbose)) != MS_NOERROR)
+        return rc;
+
+    if ((((*ppmsr)->encoding == DE_STEIM1) || ((*ppmsr)->encoding == DE_STEIM2)) && ((nsamples = steim_decode(steim, *ppmsr)) > 0)) {
+        (*ppmsr)->datasamples = steim->samples;
+        (*ppmsr)->numsamples = nsamples;
+        (*ppmsr)->sampletype = 'i';
+        steim->decoded++;
+        return MS_NOERROR;
+    }
+
+    /* other encodings, and anything the checks did not like, are left to libmseed */
+    steim->fallback++;
+
+    return msr_unpack(record, reclen, ppmsr, 1, verbose);
+}
+
+/* the buffer is not owned by the record, so detach it before the record is reused or freed */
+void steim_release(steim_t *steim, MSRecord *msr) {
+    if ((msr == NULL) || (msr->datasamples == NULL) || (msr->datasamples != (void *) steim->samples))
+        return;
+
+    msr->datasamples = NULL;
+    msr->numsamples = 0;
+}
+
+void steim_free(steim_t *steim) {
+    free((char *) steim->samples);
+    steim->samples = NULL;
+    steim->size = 0;
+}
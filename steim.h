@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef _STEIM_H
+#define _STEIM_H
+
+#include <stdint.h>
+#include <libmseed.h>
+
+/*
+ * steim: built in scalar Steim1 and Steim2 decoding into a reusable sample buffer
+ *
+ * A plain C fast path, without any SIMD: differences are decoded a frame word at a time,
+ * and the samples rebuilt with a separate running sum over the whole buffer, which avoids
+ * libmseed's per sample checks and allocations. Any other encoding, or a record that does
+ * not decode cleanly, such as one failing its reverse integration constant, is left to libmseed.
+ */
+
+typedef struct steim_s {
+    int32_t *samples;
+    int size;
+    unsigned long decoded; /* records decoded here */
+    unsigned long fallback; /* records handed back to libmseed */
+} steim_t;
+
+extern int steim_unpack(steim_t *steim, char *record, int reclen, MSRecord **ppmsr, flag verbose);
+extern void steim_release(steim_t *steim, MSRecord *msr);
+extern void steim_free(steim_t *steim);
+
+#endif /* _STEIM_H */
@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+/* system includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fnmatch.h>
+
+#include "streamconf.h"
+
+#define STREAMCONF_LINE 4096
+
+static void streamconf_free(streamconf_t *conf) {
+    int n;
+
+    free(conf->pattern);
+    for (n = 0; n < conf->nfirs; n++)
+        free(conf->firnames[n]);
+}
+
+/* a copy of another stream config, with its own pattern and filter names */
+static int streamconf_copy(streamconf_t *conf, streamconf_t *from, char *pattern) {
+    int n;
+
+    *conf = *from;
+    conf->nfirs = 0;
+    if ((conf->pattern = strdup(pattern)) == NULL)
+        return -1;
+    for (n = 0; n < from->nfirs; n++, conf->nfirs++) {
+        if ((conf->firnames[n] = strdup(from->firnames[n])) == NULL) {
+            streamconf_free(conf); return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int streamconfig_add(streamconfig_t *config, char *pattern) {
+    streamconf_t *confs;
+
+    if ((confs = (streamconf_t *) realloc(config->confs, (config->nconfs + 1) * sizeof(streamconf_t))) == NULL)
+        return -1;
+    config->confs = confs;
+    if (streamconf_copy(&config->confs[config->nconfs], &config->confs[0], pattern) < 0)
+        return -1;
+    config->nconfs++;
+
+    return 0;
+}
+
+/* a tidal constituent, as for the command line, <label>/<amplitude>/<lag> with the lag in degrees */
+static int streamconf_tide(streamconf_t *conf, char *value, int replace) {
+    char *amplitude, *lag;
+
+    if (replace)
+        conf->tidal.num_tides = 0;
+    if (conf->tidal.num_tides >= LIBTIDAL_MAX_CONSTITUENTS)
+        return -1;
+    if (((amplitude = strchr(value, '/')) == NULL) || ((lag = strchr(amplitude + 1, '/')) == NULL))
+        return -1;
+    *amplitude++ = '\0'; *lag++ = '\0';
+
+    memset(conf->tidal.tides[conf->tidal.num_tides].name, 0, LIBTIDAL_CHARLEN);
+    strncpy(conf->tidal.tides[conf->tidal.num_tides].name, value, LIBTIDAL_CHARLEN - 1);
+    conf->tidal.tides[conf->tidal.num_tides].amplitude = atof(amplitude);
+    conf->tidal.tides[conf->tidal.num_tides].lag = atof(lag) / 360.0;
+    conf->tidal.num_tides++;
+
+    return 0;
+}
+
+static int streamconf_filter(streamconf_t *conf, char *value, int replace) {
+    int n;
+
+    if (replace) {
+        for (n = 0; n < conf->nfirs; n++)
+            free(conf->firnames[n]);
+        conf->nfirs = 0;
+    }
+    if (conf->nfirs >= FIR_MAX_FILTERS)
+        return -1;
+    if ((conf->firnames[conf->nfirs] = strdup(value)) == NULL)
+        return -1;
+    conf->nfirs++;
+
+    return 0;
+}
+
+static int streamconf_set(streamconf_t *conf, char *key, char *value, int *ntides, int *nfilters) {
+    if (strcmp(key, "tag") == 0) {
+        memset(conf->tag, 0, sizeof(conf->tag));
+        strncpy(conf->tag, value, sizeof(conf->tag) - 1);
+    }
+    else if (strcmp(key, "alpha") == 0)
+        conf->alpha = atof(value);
+    else if (strcmp(key, "beta") == 0)
+        conf->beta = atof(value);
+    else if (strcmp(key, "latitude") == 0)
+        conf->tidal.latitude = atof(value);
+    else if (strcmp(key, "zone") == 0)
+        conf->tidal.zone = atof(value);
+    else if (strcmp(key, "tide") == 0)
+        return streamconf_tide(conf, value, ((*ntides)++ == 0));
+    else if (strcmp(key, "filter") == 0)
+        return streamconf_filter(conf, value, ((*nfilters)++ == 0));
+    else if (strcmp(key, "deadline") == 0)
+        conf->deadline = atoi(value);
+    else
+        return -1;
+
+    return 0;
+}
+
+/* the same tidal model, comparing only the constituents in use */
+static int streamconf_tidal(crex_tidal_t *a, crex_tidal_t *b) {
+    int n;
+
+    if ((a->latitude != b->latitude) || (a->zone != b->zone) || (a->num_tides != b->num_tides))
+        return 0;
+    for (n = 0; n < a->num_tides; n++) {
+        if ((strncmp(a->tides[n].name, b->tides[n].name, LIBTIDAL_CHARLEN) != 0) ||
+            (a->tides[n].amplitude != b->tides[n].amplitude) || (a->tides[n].lag != b->tides[n].lag))
+            return 0;
+    }
+
+    return 1;
+}
+
+/* point every setting at one copy of each distinct tidal model */
+static int streamconfig_models(streamconfig_t *config) {
+    crex_tidal_t *models;
+    int n, m;
+
+    if ((models = (crex_tidal_t *) malloc((config->nconfs + 1) * sizeof(crex_tidal_t))) == NULL)
+        return -1;
+    free((char *) config->models);
+    config->models = models;
+    config->nmodels = 0;
+
+    for (n = 0; n < config->nconfs; n++) {
+        for (m = 0; (m < config->nmodels) && (!streamconf_tidal(&config->models[m], &config->confs[n].tidal)); m++);
+        if (m == config->nmodels)
+            config->models[config->nmodels++] = config->confs[n].tidal;
+        config->confs[n].model = m;
+    }
+
+    return 0;
+}
+
+/* start with the command line settings, which apply to any unmatched streams */
+int streamconfig_init(streamconfig_t *config, char *tag, double alpha, double beta, crex_tidal_t *tidal, int nfirs, char **firnames) {
+    streamconf_t conf;
+
+    memset(&conf, 0, sizeof(conf));
+    strncpy(conf.tag, tag, sizeof(conf.tag) - 1);
+    conf.alpha = alpha;
+    conf.beta = beta;
+    conf.tidal = *tidal;
+    conf.nfirs = nfirs;
+    memcpy(conf.firnames, firnames, nfirs * sizeof(char *));
+    conf.deadline = -1;
+
+    memset(config, 0, sizeof(streamconfig_t));
+    if ((config->confs = (streamconf_t *) malloc(sizeof(streamconf_t))) == NULL)
+        return -1;
+    if (streamconf_copy(&config->confs[0], &conf, "*") < 0) {
+        free((char *) config->confs); config->confs = NULL; return -1;
+    }
+    config->nconfs = 1;
+
+    return streamconfig_models(config);
+}
+
+/* add the patterns of a stream config file, in order */
+int streamconfig_load(streamconfig_t *config, char *file) {
+    char line[STREAMCONF_LINE];
+    streamconf_t *conf;
+    char *key, *value, *last;
+    int ntides, nfilters;
+    int lineno = 0;
+    FILE *fp;
+    int errsv;
+
+    if ((fp = fopen(file, "r")) == NULL) {
+        errsv = errno; ms_log(2, "failed to open stream config: %s - %s\n", file, strerror(errsv)); return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        lineno++;
+        if ((key = strchr(line, '#')) != NULL)
+            *key = '\0';
+        if ((key = strtok_r(line, " \t\r\n", &last)) == NULL)
+            continue;
+        if (streamconfig_add(config, key) < 0) {
+            ms_log(2, "memory error!\n"); fclose(fp); return -1;
+        }
+        conf = &config->confs[config->nconfs - 1];
+
+        ntides = nfilters = 0;
+        while ((key = strtok_r(NULL, " \t\r\n", &last)) != NULL) {
+            if ((value = strchr(key, '=')) != NULL)
+                *value++ = '\0';
+            if ((value == NULL) || (streamconf_set(conf, key, value, &ntides, &nfilters) < 0)) {
+                ms_log(2, "invalid stream config: %s:%d [%s]\n", file, lineno, key); fclose(fp); return -1;
+            }
+        }
+    }
+    fclose(fp);
+
+    if (streamconfig_models(config) < 0) {
+        ms_log(2, "memory error!\n"); return -1;
+    }
+
+    return 0;
+}
+
+void streamconfig_free(streamconfig_t *config) {
+    int n;
+
+    for (n = 0; n < config->nconfs; n++)
+        streamconf_free(&config->confs[n]);
+    free((char *) config->confs);
+    free((char *) config->models);
+
+    memset(config, 0, sizeof(streamconfig_t));
+}
+
+/* the first config pattern matching a srcname, the command line settings are last */
+int streamconfig_match(streamconfig_t *config, char *srcname) {
+    int n;
+
+    for (n = 1; n < config->nconfs; n++) {
+        if (fnmatch(config->confs[n].pattern, srcname, 0) == 0)
+            return n;
+    }
+
+    return 0;
+}
+
+/* are any fir filters configured, and so need loading */
+int streamconfig_firs(streamconfig_t *config) {
+    int n;
+
+    for (n = 0; n < config->nconfs; n++) {
+        if (config->confs[n].nfirs > 0)
+            return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+#ifndef _STREAMCONF_H
+#define _STREAMCONF_H
+
+#include <libmseed.h>
+#include <libcrex.h>
+
+/*
+ * streamconf: per-stream CREX settings, keyed on srcname patterns
+ *
+ * Each line of a stream config file is a srcname pattern followed by any of
+ *
+ *   tag=<id> alpha=<offset> beta=<scale> latitude=<degrees> zone=<hours>
+ *   tide=<label>/<amplitude>/<lag> ... filter=<name> ... deadline=<seconds>
+ *
+ * with anything not given taken from the command line settings, and a first
+ * tide or filter replacing the command line list. The first matching pattern
+ * wins, and streams matching none use the command line settings. Settings with
+ * the same latitude, zone and tidal constituents share one tidal model.
+ */
+
+typedef struct streamconf_s {
+    char *pattern;
+    char tag[25];
+    double alpha;
+    double beta;
+    crex_tidal_t tidal;
+    int model; /* index of the shared copy of its tidal model */
+    int nfirs;
+    char *firnames[FIR_MAX_FILTERS];
+    int deadline; /* seconds before a pending minute file is published, or -1 for the command line deadline */
+} streamconf_t;
+
+typedef struct streamconfig_s {
+    int nconfs;
+    streamconf_t *confs; /* the command line settings come first, matching everything */
+    int nmodels;
+    crex_tidal_t *models; /* the distinct tidal models of the settings */
+} streamconfig_t;
+
+extern int streamconfig_init(streamconfig_t *config, char *tag, double alpha, double beta, crex_tidal_t *tidal, int nfirs, char **firnames);
+extern int streamconfig_load(streamconfig_t *config, char *file);
+extern void streamconfig_free(streamconfig_t *config);
+
+extern int streamconfig_match(streamconfig_t *config, char *srcname);
+extern int streamconfig_firs(streamconfig_t *config);
+
+#endif /* _STREAMCONF_H */
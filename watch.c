@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+/* system includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <limits.h>
+#include <sys/inotify.h>
+
+#include <libmseed.h>
+
+#include "watch.h"
+#include "hash.h"
+
+#define WATCH_EVENTS (IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM)
+
+/* find the slot holding the path, or the empty slot where it belongs */
+static watch_slot_t *watch_probe(watch_t *watch, const char *path, unsigned int hash) {
+    watch_slot_t *slot;
+    unsigned int mask = (unsigned int) watch->nslots - 1;
+    unsigned int n;
+
+    for (n = hash & mask; ; n = (n + 1) & mask) {
+        slot = &watch->slots[n];
+        if (slot->index < 0)
+            return slot;
+        if ((slot->hash == hash) && (strcmp(watch->files[slot->index].path, path) == 0))
+            return slot;
+    }
+}
+
+/* double the hash table, keeping the load factor under a half */
+static int watch_grow(watch_t *watch) {
+    watch_slot_t *slots = watch->slots;
+    int nslots = watch->nslots;
+    int n;
+
+    if ((watch->slots = (watch_slot_t *) malloc(2 * nslots * sizeof(watch_slot_t))) == NULL) {
+        watch->slots = slots; return -1;
+    }
+    watch->nslots = 2 * nslots;
+    for (n = 0; n < watch->nslots; n++)
+        watch->slots[n].index = -1;
+
+    for (n = 0; n < nslots; n++) {
+        if (slots[n].index < 0)
+            continue;
+        *watch_probe(watch, watch->files[slots[n].index].path, slots[n].hash) = slots[n];
+    }
+    free((char *) slots);
+
+    return 0;
+}
+
+/* drop the file of a slot, closing the gap left in the probe sequence and moving the last file into its place */
+static void watch_remove(watch_t *watch, watch_slot_t *slot) {
+    unsigned int mask = (unsigned int) watch->nslots - 1;
+    unsigned int i = (unsigned int) (slot - watch->slots);
+    unsigned int j, home;
+    int index = slot->index;
+
+    free(watch->files[index].path);
+
+    /* later slots of the same run move back, unless that would put them before their home slot */
+    for (j = (i + 1) & mask; watch->slots[j].index >= 0; j = (j + 1) & mask) {
+        home = watch->slots[j].hash & mask;
+        if ((i <= j) ? ((i < home) && (home <= j)) : ((i < home) || (home <= j)))
+            continue;
+        watch->slots[i] = watch->slots[j];
+        i = j;
+    }
+    watch->slots[i].index = -1;
+
+    if (index != --watch->nfiles) {
+        watch->files[index] = watch->files[watch->nfiles];
+        watch_probe(watch, watch->files[index].path, hash_string(watch->files[index].path))->index = index;
+    }
+}
+
+int watch_open(watch_t *watch) {
+    int n;
+
+    memset(watch, 0, sizeof(watch_t));
+    watch->nslots = 16;
+    if ((watch->slots = (watch_slot_t *) malloc(watch->nslots * sizeof(watch_slot_t))) == NULL)
+        return -1;
+    for (n = 0; n < watch->nslots; n++)
+        watch->slots[n].index = -1;
+    if ((watch->events = (char *) malloc(WATCH_BUFFER)) == NULL) {
+        free((char *) watch->slots); return -1;
+    }
+    if ((watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+        ms_log(2, "unable to start watching: %s\n", strerror(errno)); free(watch->events); free((char *) watch->slots); return -1;
+    }
+
+    return 0;
+}
+
+int watch_add(watch_t *watch, char *dir) {
+    int wd;
+
+    if (watch->ndirs >= WATCH_DIRS) {
+        ms_log(2, "too many watched directories [%s]\n", dir); return -1;
+    }
+    if ((wd = inotify_add_watch(watch->fd, dir, WATCH_EVENTS | IN_ONLYDIR)) < 0) {
+        ms_log(2, "unable to watch directory: %s - %s\n", dir, strerror(errno)); return -1;
+    }
+    watch->dirs[watch->ndirs] = dir;
+    watch->wds[watch->ndirs++] = wd;
+
+    return 0;
+}
+
+static void watch_forget(watch_t *watch, char *path) {
+    watch_slot_t *slot = watch_probe(watch, path, hash_string(path));
+
+    if (slot->index >= 0)
+        watch_remove(watch, slot);
+}
+
+/* the next changed file, waiting up to timeout milliseconds, returns 0 on timeout or WATCH_RESCAN if events were lost; removed files are forgotten */
+int watch_next(watch_t *watch, int timeout, char *path, size_t size) {
+    struct inotify_event *event;
+    struct pollfd fds;
+    int n;
+
+    for (;;) {
+        while (watch->next < watch->nevents) {
+            event = (struct inotify_event *) (watch->events + watch->next);
+            watch->next += (ssize_t) (sizeof(struct inotify_event) + event->len);
+
+            /* the kernel queue overflowed, anything could have changed so the rest can be skipped */
+            if (event->mask & IN_Q_OVERFLOW) {
+                watch->next = watch->nevents; return WATCH_RESCAN;
+            }
+            if ((event->len == 0) || (event->mask & IN_ISDIR) || (event->name[0] == '.'))
+                continue;
+            for (n = 0; (n < watch->ndirs) && (watch->wds[n] != event->wd); n++);
+            if (n == watch->ndirs)
+                continue;
+            snprintf(path, size, "%s/%s", watch->dirs[n], event->name);
+
+            if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+                watch_forget(watch, path);
+            else
+                return 1;
+        }
+
+        fds.fd = watch->fd;
+        fds.events = POLLIN;
+        fds.revents = 0;
+        if ((n = poll(&fds, 1, timeout)) <= 0)
+            return ((n < 0) && (errno != EINTR)) ? -1 : 0;
+
+        watch->next = 0;
+        if ((watch->nevents = read(watch->fd, watch->events, WATCH_BUFFER)) < 0) {
+            watch->nevents = 0;
+            if ((errno != EAGAIN) && (errno != EINTR))
+                return -1;
+        }
+    }
+}
+
+void watch_close(watch_t *watch) {
+    int n;
+
+    if (watch->fd > 0)
+        (void) close(watch->fd);
+    for (n = 0; n < watch->nfiles; n++)
+        free(watch->files[n].path);
+    free((char *) watch->files);
+    free((char *) watch->slots);
+    free(watch->events);
+
+    memset(watch, 0, sizeof(watch_t));
+}
+
+/* the resume offset of a known file, or NULL */
+watch_file_t *watch_find(watch_t *watch, char *path) {
+    watch_slot_t *slot = watch_probe(watch, path, hash_string(path));
+
+    return (slot->index < 0) ? NULL : &watch->files[slot->index];
+}
+
+/* the resume offset of a file, starting from the beginning of any not seen before, which stays valid until the next call */
+watch_file_t *watch_file(watch_t *watch, char *path) {
+    watch_file_t *files;
+    watch_slot_t *slot;
+    unsigned int hash = hash_string(path);
+
+    slot = watch_probe(watch, path, hash);
+    if (slot->index >= 0) {
+        watch->files[slot->index].seen = time(NULL);
+        return &watch->files[slot->index];
+    }
+
+    if ((2 * (watch->nfiles + 1) > watch->nslots) && (watch_grow(watch) < 0))
+        return NULL;
+    if (watch->nfiles == watch->maxfiles) {
+        if ((files = (watch_file_t *) realloc(watch->files, 2 * (watch->maxfiles + 1) * sizeof(watch_file_t))) == NULL)
+            return NULL;
+        watch->files = files;
+        watch->maxfiles = 2 * (watch->maxfiles + 1);
+    }
+    if ((watch->files[watch->nfiles].path = strdup(path)) == NULL)
+        return NULL;
+    watch->files[watch->nfiles].offset = 0;
+    watch->files[watch->nfiles].seen = time(NULL);
+
+    slot = watch_probe(watch, path, hash);
+    slot->hash = hash;
+    slot->index = watch->nfiles;
+
+    return &watch->files[watch->nfiles++];
+}
+
+/* forget the files not looked up for WATCH_IDLE seconds, returning how many */
+int watch_expire(watch_t *watch, time_t now) {
+    int count = 0;
+    int n;
+
+    /* removing a file moves the last one into its place, which has already been checked */
+    for (n = watch->nfiles - 1; n >= 0; n--) {
+        if (now - watch->files[n].seen < WATCH_IDLE)
+            continue;
+        watch_remove(watch, watch_probe(watch, watch->files[n].path, hash_string(watch->files[n].path)));
+        count++;
+    }
+
+    return count;
+}
+
+/* read back saved offsets, one "<offset> <path>" line per file */
+int watch_load(watch_t *watch, char *file) {
+    char line[PATH_MAX + 32];
+    watch_file_t *entry;
+    unsigned long long offset;
+    char *path;
+    FILE *fp;
+
+    if ((fp = fopen(file, "r")) == NULL)
+        return -1;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        line[strcspn(line, "\n")] = '\0';
+        if ((path = strchr(line, ' ')) == NULL)
+            continue;
+        *path++ = '\0';
+        offset = strtoull(line, NULL, 10);
+        if ((entry = watch_file(watch, path)) == NULL) {
+            fclose(fp); return -1;
+        }
+        entry->offset = (size_t) offset;
+    }
+    fclose(fp);
+
+    return 0;
+}
+
+/* save the offsets to a temporary file, then rename it into place */
+int watch_save(watch_t *watch, char *file) {
+    char tmpfile[1024];
+    FILE *fp;
+    int rv = 0;
+    int n;
+
+    snprintf(tmpfile, sizeof(tmpfile), "%s.tmp", file);
+    if ((fp = fopen(tmpfile, "w")) == NULL) {
+        ms_log(2, "failed to open resume file: %s - %s\n", tmpfile, strerror(errno)); return -1;
+    }
+    for (n = 0; n < watch->nfiles; n++) {
+        if (fprintf(fp, "%llu %s\n", (unsigned long long) watch->files[n].offset, watch->files[n].path) < 0)
+            rv = -1;
+    }
+    if (fclose(fp) != 0)
+        rv = -1;
+
+    if ((rv < 0) || (rename(tmpfile, file) != 0)) {
+        ms_log(2, "failed to write resume file: %s - %s\n", file, strerror(errno)); (void) unlink(tmpfile); return -1;
+    }
+
+    return 0;
+}
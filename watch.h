@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2014 Institute of Geological & Nuclear Sciences Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *		notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *		notice, this list of conditions and the following disclaimer in the
+ *		documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+#ifndef _WATCH_H
+#define _WATCH_H
+
+#include <sys/types.h>
+#include <time.h>
+
+/*
+ * watch: follow the miniseed files written into a set of directories
+ *
+ * Directories are watched with inotify, and each file seen has the offset just past the
+ * last whole record processed, so only appended records are read when it changes again.
+ * The offsets can be saved and loaded, to carry on across restarts without reprocessing.
+ *
+ * Files are found via an open addressing hash on the path, as in the registry, and are
+ * forgotten once they have not changed for WATCH_IDLE seconds, so the table and the saved
+ * offsets only cover files still being written. Should inotify drop events the caller is
+ * told to rescan the directories.
+ */
+
+#define WATCH_DIRS 64 /* maximum watched directories */
+#define WATCH_BUFFER 65536 /* inotify events read at once */
+#define WATCH_IDLE (2 * 86400) /* seconds without a change before a file is forgotten */
+#define WATCH_RESCAN 2 /* returned by watch_next when events have been lost */
+
+typedef struct watch_file_s {
+    char *path;
+    size_t offset; /* end of the last whole record processed */
+    time_t seen; /* when last looked up */
+} watch_file_t;
+
+typedef struct watch_slot_s {
+    unsigned int hash; /* cached path hash */
+    int index; /* file index, or -1 when empty */
+} watch_slot_t;
+
+typedef struct watch_s {
+    int fd; /* inotify descriptor */
+    int ndirs;
+    char *dirs[WATCH_DIRS];
+    int wds[WATCH_DIRS];
+
+    int nfiles;
+    int maxfiles;
+    watch_file_t *files;
+
+    int nslots; /* hash table size, always a power of two */
+    watch_slot_t *slots;
+
+    char *events; /* events read, but not yet returned */
+    ssize_t nevents;
+    ssize_t next;
+} watch_t;
+
+extern int watch_open(watch_t *watch);
+extern int watch_add(watch_t *watch, char *dir);
+extern int watch_next(watch_t *watch, int timeout, char *path, size_t size);
+extern void watch_close(watch_t *watch);
+
+extern watch_file_t *watch_find(watch_t *watch, char *path);
+extern watch_file_t *watch_file(watch_t *watch, char *path);
+extern int watch_expire(watch_t *watch, time_t now);
+extern int watch_load(watch_t *watch, char *file);
+extern int watch_save(watch_t *watch, char *file);
+
+#endif /* _WATCH_H */